@@ -7,7 +7,9 @@ namespace Device {
         : m_fieldOffsets{}
         , m_fieldSemantics{}
         , m_fieldTypes{}
+        , m_fieldLookup{}
         , m_size{0}
+        , m_numLanes{1}
     {
     }
 
@@ -15,29 +17,32 @@ namespace Device {
     {
         m_size = 0;
 
+        // keep every field naturally aligned, also across consecutive elements.
+        U32 maxAlign = 1;
         m_fieldOffsets.clear();
         for (U32 fieldIndex = 0; fieldIndex < m_fieldSemantics.size(); ++fieldIndex)
         {
+            U32 align = AlignOf(m_fieldTypes[fieldIndex]);
+            maxAlign = std::max(maxAlign, align);
+            m_size = (m_size + align - 1) / align * align;
+
             m_fieldOffsets.push_back(m_size);
 
             m_size += SizeOf(m_fieldTypes[fieldIndex]);
         }
+        m_size = (m_size + maxAlign - 1) / maxAlign * maxAlign;
     }
 
     // Returns the field index.
     U32 LinearStruct::addField(Semantic const& semantic, Type const& type)
     {
-        for (U32 fieldIndex = 0; fieldIndex < m_fieldSemantics.size(); ++fieldIndex)
+        if (m_fieldLookup.has(semantic))
         {
-            Semantic const& fieldSemantic = m_fieldSemantics[fieldIndex];
-
-            if (semantic == fieldSemantic)
-            {
-                // use semantic as binding idertifier, do not permit override.
-                assert(0);
-            }
+            // use semantic as binding idertifier, do not permit override.
+            assert(0);
         }
 
+        m_fieldLookup.set(semantic, m_fieldSemantics.size());
         m_fieldSemantics.push_back(semantic);
         m_fieldTypes.push_back(type);
 
@@ -64,29 +69,51 @@ namespace Device {
         return m_fieldSemantics[fieldIndex];
     }
 
+    Type LinearStruct::getFieldType(U32 fieldIndex) const
+    {
+        return m_fieldTypes[fieldIndex];
+    }
+
     U32 LinearStruct::numFields() const
     {
         return m_fieldSemantics.size();
     }
 
-    U32 LinearStruct::getSize() const
+    void LinearStruct::setNumLanes(U32 numLanes)
+    {
+        assert(numLanes > 0);
+        m_numLanes = numLanes;
+    }
+
+    U32 LinearStruct::getNumLanes() const
+    {
+        return m_numLanes;
+    }
+
+    U32 LinearStruct::getLaneSize() const
     {
         return m_size;
     }
 
+    U32 LinearStruct::getSize() const
+    {
+        return m_size * m_numLanes;
+    }
+
     void LinearStruct::reset()
     {
         m_fieldOffsets.clear();
         m_fieldSemantics.clear();
         m_fieldTypes.clear();
+        m_fieldLookup.clear();
         m_size = 0;
+        m_numLanes = 1;
     }
 
-    // Returns the field index.
+    // Returns the field index, numFields() if not found.
     U32 LinearStruct::getFieldIndex(Semantic const& semantic) const
     {
-        auto const& itr = std::find(m_fieldSemantics.begin(), m_fieldSemantics.end(), semantic);
-        return itr - m_fieldSemantics.begin();
+        return m_fieldLookup.get(semantic, m_fieldSemantics.size());
     }
 
 
@@ -128,6 +155,16 @@ namespace Device {
         m_structure.reset();
     }
 
+    void FifoStream::setStructure(LinearStruct const& structure)
+    {
+        m_structure = structure;
+    }
+
+    LinearStruct const& FifoStream::getStructure() const
+    {
+        return m_structure;
+    }
+
     void FifoStream::setCapacity(U32 maxNumElements)
     {
         m_capacity = maxNumElements + 1;
@@ -141,6 +178,16 @@ namespace Device {
         m_begin = m_end = 0;
     }
 
+    U32 FifoStream::getCapacity() const
+    {
+        return m_capacity == 0 ? 0 : m_capacity - 1;
+    }
+
+    void FifoStream::clear()
+    {
+        m_begin = m_end = 0;
+    }
+
     U32 FifoStream::getNumElements() const
     {
         return (m_end - m_begin + m_capacity) % m_capacity;
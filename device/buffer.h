@@ -14,6 +14,8 @@
 namespace Device {
 
     // LinearStruct's element is in a contiguous memory layout, quite like C structure type.
+    // An element may hold several lanes of the same layout back to back, e.g. a 2x2 pixel quad,
+    // field offsets are relative to lane 0.
     class LinearStruct
     {
     protected:
@@ -21,7 +23,9 @@ namespace Device {
         std::vector<U32> m_fieldOffsets;
         std::vector<Semantic> m_fieldSemantics;
         std::vector<Type> m_fieldTypes;
-        U32 m_size;
+        SemanticMap m_fieldLookup;
+        U32 m_size;     // size of one lane.
+        U32 m_numLanes;
 
     protected:
         void updateOffsets();
@@ -43,8 +47,18 @@ namespace Device {
 
         Semantic getFieldSemantic(U32 fieldIndex) const;
 
+        Type getFieldType(U32 fieldIndex) const;
+
         U32 numFields() const;
 
+        void setNumLanes(U32 numLanes);
+
+        U32 getNumLanes() const;
+
+        // Returns the size of one lane, also the distance between two lanes.
+        U32 getLaneSize() const;
+
+        // Returns the size of the whole element.
         U32 getSize() const;
 
         void reset();
@@ -66,6 +80,11 @@ namespace Device {
         {
             return m_pAddr + m_pStructure->getFieldOffset(fieldIndex);
         }
+
+        inline U8* getAddr() const
+        {
+            return m_pAddr;
+        }
     };
 
     // A stream used for inter component communication
@@ -98,8 +117,18 @@ namespace Device {
 
         void resetChannels();
 
+        // Replace all channels with a prebuilt layout, capacity must be set again afterwards.
+        void setStructure(LinearStruct const& structure);
+
+        LinearStruct const& getStructure() const;
+
         void setCapacity(U32 maxNumElements);
 
+        U32 getCapacity() const;
+
+        // Drop all elements, keep channels and storage.
+        void clear();
+
         U32 getNumElements() const;
 
         bool isEmpty() const;
@@ -19,6 +19,12 @@ namespace Device {
                 return TypeTrait<Type::FLOAT4X4>::Width;
             case Type::HALF:
                 return TypeTrait<Type::HALF>::Width;
+            case Type::HALF2:
+                return TypeTrait<Type::HALF2>::Width;
+            case Type::HALF3:
+                return TypeTrait<Type::HALF3>::Width;
+            case Type::HALF4:
+                return TypeTrait<Type::HALF4>::Width;
             case Type::DOUBLE:
                 return TypeTrait<Type::DOUBLE>::Width;
             case Type::INT:
@@ -36,6 +42,90 @@ namespace Device {
         return 0u;
     }
 
+    U32 AlignOf(Type const& type)
+    {
+        switch (type)
+        {
+            case Type::FLOAT:
+                return TypeTrait<Type::FLOAT>::Align;
+            case Type::FLOAT2:
+                return TypeTrait<Type::FLOAT2>::Align;
+            case Type::FLOAT3:
+                return TypeTrait<Type::FLOAT3>::Align;
+            case Type::FLOAT4:
+                return TypeTrait<Type::FLOAT4>::Align;
+            case Type::FLOAT4X4:
+                return TypeTrait<Type::FLOAT4X4>::Align;
+            case Type::HALF:
+                return TypeTrait<Type::HALF>::Align;
+            case Type::HALF2:
+                return TypeTrait<Type::HALF2>::Align;
+            case Type::HALF3:
+                return TypeTrait<Type::HALF3>::Align;
+            case Type::HALF4:
+                return TypeTrait<Type::HALF4>::Align;
+            case Type::DOUBLE:
+                return TypeTrait<Type::DOUBLE>::Align;
+            case Type::INT:
+                return TypeTrait<Type::INT>::Align;
+            case Type::UINT:
+                return TypeTrait<Type::UINT>::Align;
+            case Type::Sampler2D:
+                return TypeTrait<Type::Sampler2D>::Align;
+            case Type::Texture2D:
+                return TypeTrait<Type::Texture2D>::Align;
+            default:
+                assert(0);
+        }
+
+        return 1u;
+    }
+
+    U32 NumHalfChannels(Type const& type)
+    {
+        switch (type)
+        {
+            case Type::HALF:
+                return 1;
+            case Type::HALF2:
+                return 2;
+            case Type::HALF3:
+                return 3;
+            case Type::HALF4:
+                return 4;
+            default:
+                return 0;
+        }
+    }
+
+    // Half values are interpolated in float.
+    template <U32 N>
+    static void interpolateHalf(Value* out, Value const* a, float u, Value const* b, float v)
+    {
+        float _a[N], _b[N], _o[N];
+        halfToFloat(_a, reinterpret_cast<Half const*>(a->read()), N);
+        halfToFloat(_b, reinterpret_cast<Half const*>(b->read()), N);
+        for (U32 index = 0; index < N; ++index)
+        {
+            _o[index] = _a[index] * u + _b[index] * v;
+        }
+        floatToHalf(reinterpret_cast<Half*>(out->read()), _o, N);
+    }
+
+    template <U32 N>
+    static void interpolateHalf(Value* out, Value const* a, float u, Value const* b, float v, Value const* c, float w)
+    {
+        float _a[N], _b[N], _c[N], _o[N];
+        halfToFloat(_a, reinterpret_cast<Half const*>(a->read()), N);
+        halfToFloat(_b, reinterpret_cast<Half const*>(b->read()), N);
+        halfToFloat(_c, reinterpret_cast<Half const*>(c->read()), N);
+        for (U32 index = 0; index < N; ++index)
+        {
+            _o[index] = _a[index] * u + _b[index] * v + _c[index] * w;
+        }
+        floatToHalf(reinterpret_cast<Half*>(out->read()), _o, N);
+    }
+
     template <typename T>
     static void interpolateAs(Value* out, Value const* a, float u, Value const* b, float v)
     {
@@ -81,8 +171,22 @@ namespace Device {
             }
             case Type::HALF:
             {
-                // TODO:
-                assert(0);
+                interpolateHalf<1>(this, a, u, b, v);
+                break;
+            }
+            case Type::HALF2:
+            {
+                interpolateHalf<2>(this, a, u, b, v);
+                break;
+            }
+            case Type::HALF3:
+            {
+                interpolateHalf<3>(this, a, u, b, v);
+                break;
+            }
+            case Type::HALF4:
+            {
+                interpolateHalf<4>(this, a, u, b, v);
                 break;
             }
             case Type::DOUBLE:
@@ -133,8 +237,22 @@ namespace Device {
             }
             case Type::HALF:
             {
-                // TODO:
-                assert(0);
+                interpolateHalf<1>(this, a, u, b, v, c, w);
+                break;
+            }
+            case Type::HALF2:
+            {
+                interpolateHalf<2>(this, a, u, b, v, c, w);
+                break;
+            }
+            case Type::HALF3:
+            {
+                interpolateHalf<3>(this, a, u, b, v, c, w);
+                break;
+            }
+            case Type::HALF4:
+            {
+                interpolateHalf<4>(this, a, u, b, v, c, w);
                 break;
             }
             case Type::DOUBLE:
@@ -195,7 +313,26 @@ namespace Device {
             }
             case Type::HALF:
             {
-                assert(0);
+                Half cppValue = value.readAs<Half>();
+                stream << cppValue;
+                break;
+            }
+            case Type::HALF2:
+            {
+                Vec2h cppValue = value.readAs<Vec2h>();
+                stream << cppValue;
+                break;
+            }
+            case Type::HALF3:
+            {
+                Vec3h cppValue = value.readAs<Vec3h>();
+                stream << cppValue;
+                break;
+            }
+            case Type::HALF4:
+            {
+                Vec4h cppValue = value.readAs<Vec4h>();
+                stream << cppValue;
                 break;
             }
             case Type::DOUBLE:
@@ -242,6 +379,8 @@ namespace Device {
         , m_values{}
         , m_symbols{}
         , m_semantics{}
+        , m_semanticLookup{}
+        , m_symbolLookup{}
         , ctr_totalConsumed{0}
         , ctr_totalProduced{0}
     {
@@ -254,12 +393,30 @@ namespace Device {
         Symbols& symbols = m_symbols[io];
         Semantics& semantics = m_semantics[io];
 
+        U32 location = symbols.size();
+
+        // use semantic as binding idertifier, do not permit override.
+        assert(!m_semanticLookup[io].has(semantic));
+
         symbols.push_back(name);
         types.push_back(type);
         semantics.push_back(semantic);
         values.push_back(Value{type});
 
-        return symbols.size() - 1;
+        m_semanticLookup[io].set(semantic, location);
+        m_symbolLookup[io][name] = location;
+
+        return location;
+    }
+
+    void Comp::resetPorts(IOType io)
+    {
+        m_types[io].clear();
+        m_values[io].clear();
+        m_symbols[io].clear();
+        m_semantics[io].clear();
+        m_semanticLookup[io].clear();
+        m_symbolLookup[io].clear();
     }
 
     U32 Comp::getNumPorts(IOType io) const
@@ -298,28 +455,30 @@ namespace Device {
         return isRequired(io, semantic);
     }
 
-    template <typename Container>
-    static U32 findLocation(Container const& container, typename Container::value_type const& value)
+    U32 Comp::getLocation(Comp::IOType io, std::string const& name) const
     {
-        typename Container::const_iterator itr = std::find(container.begin(), container.end(), value);
+        std::unordered_map<std::string, U32>::const_iterator itr = m_symbolLookup[io].find(name);
 
-        if (itr == container.end())
+        if (itr == m_symbolLookup[io].end())
         {
             // TODO: handle this
             assert(0);
         }
 
-        return std::distance(container.begin(), itr);
-    }
-
-    U32 Comp::getLocation(Comp::IOType io, std::string const& name) const
-    {
-        return findLocation(m_symbols[io], name);
+        return itr->second;
     }
 
     U32 Comp::getLocation(Comp::IOType io, Semantic const& semantic) const
     {
-        return findLocation(m_semantics[io], semantic);
+        U32 location = m_semanticLookup[io].get(semantic, UINT_MAX);
+
+        if (location == UINT_MAX)
+        {
+            // TODO: handle this
+            assert(0);
+        }
+
+        return location;
     }
 
     Type Comp::getType(Comp::IOType io, U32 location) const
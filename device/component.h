@@ -2,12 +2,14 @@
 #define _COMPONENT_H_
 #include <string>
 #include <vector>
+#include <unordered_map>
 #include <cstring>
 #include <cassert>
 #include <climits>
 #include <iostream>
 
 #include "vmath.h"
+#include "half.h"
 #include "semantic.h"
 #include "texture.h"
 
@@ -25,7 +27,11 @@ namespace Device {
 
         FLOAT4X4,
 
+        // Half types are storage types, shaders see them as the float type of the same width.
         HALF,
+        HALF2,
+        HALF3,
+        HALF4,
 
         DOUBLE,
 
@@ -40,11 +46,17 @@ namespace Device {
 
     U32 SizeOf(Type const& type);
 
+    U32 AlignOf(Type const& type);
+
+    // Returns the number of half channels, 0 if type is not a half type.
+    U32 NumHalfChannels(Type const& type);
+
     template <Type type>
     struct TypeTrait {
         // TODO: make default unknown
         using CppType = void*;
         static constexpr U32 Width = sizeof(void*);
+        static constexpr U32 Align = alignof(void*);
     };
 
 #define def_type_trait(elementType, cppType) \
@@ -52,6 +64,7 @@ namespace Device {
     struct TypeTrait<elementType> { \
         using CppType = cppType; \
         static constexpr U32 Width = sizeof(cppType); \
+        static constexpr U32 Align = alignof(cppType); \
     };
 
     def_type_trait(Type::FLOAT,  float)
@@ -61,7 +74,10 @@ namespace Device {
     def_type_trait(Type::FLOAT4X4, Mat44f)
     def_type_trait(Type::UINT,  unsigned int)
     def_type_trait(Type::INT, int)
-    def_type_trait(Type::HALF, short)
+    def_type_trait(Type::HALF, Half)
+    def_type_trait(Type::HALF2, Vec2h)
+    def_type_trait(Type::HALF3, Vec3h)
+    def_type_trait(Type::HALF4, Vec4h)
     def_type_trait(Type::Sampler2D, Texture::Sampler2D)
     def_type_trait(Type::Texture2D, Texture::Texture2D)
 
@@ -118,6 +134,14 @@ namespace Device {
         Symbols m_symbols[IOEnd];
         Semantics m_semantics[IOEnd];
 
+        // port lookup tables
+        SemanticMap m_semanticLookup[IOEnd];
+        std::unordered_map<std::string, U32> m_symbolLookup[IOEnd];
+
+    protected:
+        // Remove all io ports of one direction.
+        void resetPorts(IOType io);
+
     public:
         // counters
         U32 ctr_totalConsumed;
@@ -191,6 +215,12 @@ namespace Device {
         ///////////////////////////////////////////////////////////
     };
 
+    // Precomputed mapping from a component's io ports to the channels of its in/out streams.
+    struct PortLinkage
+    {
+        std::vector<U32> portToChannel[Comp::IOEnd];
+    };
+
     template <typename Component, typename IOStream>
     std::vector<U32> mapCompPortToStreamChannel(Component const& comp, IOStream const& stream, Comp::IOType io)
     {
@@ -252,12 +282,12 @@ namespace Device {
         }
     }
 
+    // Run the component with a linkage precomputed by the pipeline state.
     template <typename Component, typename InStream, typename OutStream>
-    void runComp(Component& comp, InStream& inStream, OutStream& outStream)
+    void runComp(Component& comp, InStream& inStream, OutStream& outStream, PortLinkage const& linkage)
     {
-        // setup input, bind inStream to inputs
-        std::vector<U32> inLocationToStreamChannel = mapCompPortToStreamChannel(comp, inStream, Comp::Input);
-        std::vector<U32> outLocationToStreamChannel = mapCompPortToStreamChannel(comp, outStream, Comp::Output);
+        std::vector<U32> const& inLocationToStreamChannel = linkage.portToChannel[Comp::Input];
+        std::vector<U32> const& outLocationToStreamChannel = linkage.portToChannel[Comp::Output];
 
         if (comp.isOneInOneOut())
         {
@@ -303,5 +333,16 @@ namespace Device {
             }
         }
     }
+
+    template <typename Component, typename InStream, typename OutStream>
+    void runComp(Component& comp, InStream& inStream, OutStream& outStream)
+    {
+        // setup input, bind inStream to inputs
+        PortLinkage linkage;
+        linkage.portToChannel[Comp::Input] = mapCompPortToStreamChannel(comp, inStream, Comp::Input);
+        linkage.portToChannel[Comp::Output] = mapCompPortToStreamChannel(comp, outStream, Comp::Output);
+
+        runComp(comp, inStream, outStream, linkage);
+    }
 } // namespace Device
 #endif // _COMPONENT_H_
@@ -0,0 +1,173 @@
+#ifndef _HALF_H_
+#define _HALF_H_
+
+#include <cstring>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+#include "vmath.h"
+
+// IEEE 754 binary16, storage only, all arithmetic is done in float.
+// [ref](https://en.wikipedia.org/wiki/Half-precision_floating-point_format)
+struct Half
+{
+    U16 bits;
+};
+
+typedef Vec2<Half> Vec2h;
+typedef Vec3<Half> Vec3h;
+typedef Vec4<Half> Vec4h;
+
+// Software conversion, round to nearest even, handles denormal, inf and nan.
+inline U16 floatToHalfBits(float value)
+{
+    U32 f;
+    std::memcpy(&f, &value, sizeof(f));
+
+    U32 const sign = (f >> 16) & 0x8000u;
+    U32 const absf = f & 0x7fffffffu;
+
+    if (absf >= 0x7f800000u)
+    {
+        // inf or nan, keep nan quiet.
+        return sign | 0x7c00u | (absf > 0x7f800000u ? 0x0200u : 0u);
+    }
+
+    if (absf >= 0x477ff000u)
+    {
+        // overflow after rounding.
+        return sign | 0x7c00u;
+    }
+
+    if (absf < 0x38800000u)
+    {
+        // denormal half or zero.
+        if (absf < 0x33000000u)
+        {
+            return sign;
+        }
+
+        U32 const exponent = absf >> 23;
+        U32 const mantissa = (absf & 0x007fffffu) | 0x00800000u;
+        U32 const shift = 126u - exponent;
+        U32 half = mantissa >> shift;
+        U32 const rest = mantissa & ((1u << shift) - 1u);
+        U32 const halfway = 1u << (shift - 1u);
+        if (rest > halfway || (rest == halfway && (half & 1u)))
+        {
+            half ++;
+        }
+        return sign | half;
+    }
+
+    // normal, rebias exponent and round the mantissa.
+    U32 half = ((absf - 0x38000000u) >> 13);
+    U32 const rest = absf & 0x1fffu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+    {
+        half ++;
+    }
+    return sign | half;
+}
+
+inline float halfBitsToFloat(U16 bits)
+{
+    U32 const sign = (U32)(bits & 0x8000u) << 16;
+    U32 const exponent = (bits >> 10) & 0x1fu;
+    U32 mantissa = bits & 0x03ffu;
+    U32 f;
+
+    if (exponent == 0)
+    {
+        if (mantissa == 0)
+        {
+            f = sign;
+        }
+        else
+        {
+            // denormal, normalize it.
+            U32 e = 113;
+            while ((mantissa & 0x0400u) == 0)
+            {
+                mantissa <<= 1;
+                e --;
+            }
+            f = sign | (e << 23) | ((mantissa & 0x03ffu) << 13);
+        }
+    }
+    else if (exponent == 0x1f)
+    {
+        f = sign | 0x7f800000u | (mantissa << 13);
+    }
+    else
+    {
+        f = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+    }
+
+    float value;
+    std::memcpy(&value, &f, sizeof(value));
+    return value;
+}
+
+inline Half toHalf(float value)
+{
+#if defined(__F16C__)
+    return Half{(U16)_cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT)};
+#else
+    return Half{floatToHalfBits(value)};
+#endif
+}
+
+inline float toFloat(Half value)
+{
+#if defined(__F16C__)
+    return _cvtsh_ss(value.bits);
+#else
+    return halfBitsToFloat(value.bits);
+#endif
+}
+
+// Convert up to 4 consecutive channels.
+inline void halfToFloat(float* dst, Half const* src, U32 count)
+{
+    assert(count <= 4);
+#if defined(__F16C__)
+    U16 bits[8] = {};
+    std::memcpy(bits, src, count * sizeof(Half));
+    float values[4];
+    _mm_storeu_ps(values, _mm_cvtph_ps(_mm_loadl_epi64((__m128i const*)bits)));
+    std::memcpy(dst, values, count * sizeof(float));
+#else
+    for (U32 index = 0; index < count; ++index)
+    {
+        dst[index] = halfBitsToFloat(src[index].bits);
+    }
+#endif
+}
+
+// Convert up to 4 consecutive channels.
+inline void floatToHalf(Half* dst, float const* src, U32 count)
+{
+    assert(count <= 4);
+#if defined(__F16C__)
+    float values[4] = {};
+    std::memcpy(values, src, count * sizeof(float));
+    U16 bits[8];
+    _mm_storel_epi64((__m128i*)bits, _mm_cvtps_ph(_mm_loadu_ps(values), _MM_FROUND_TO_NEAREST_INT));
+    std::memcpy(dst, bits, count * sizeof(Half));
+#else
+    for (U32 index = 0; index < count; ++index)
+    {
+        dst[index].bits = floatToHalfBits(src[index]);
+    }
+#endif
+}
+
+inline std::ostream & operator<<(std::ostream& stream, Half const& value) {
+    stream << toFloat(value);
+    return stream;
+}
+
+#endif // _HALF_H_
@@ -11,13 +11,7 @@ namespace Device {
 
     U32 InputAssembler::VertexStream::getChannelIndex(Semantic const& semantic) const
     {
-        BufferEntryList::const_iterator itr = std::find_if(m_vtxBufEntries.begin(), m_vtxBufEntries.end(),
-            [&](BufferChannelEntry const& entry) -> bool {
-                return entry.semantic == semantic;
-            }
-        );
-
-        return itr - m_vtxBufEntries.begin();
+        return m_vtxBufLookup.get(semantic, m_vtxBufEntries.size());
     }
 
     U32 InputAssembler::VertexStream::getNumElements() const
@@ -93,19 +87,16 @@ namespace Device {
 
     void InputAssembler::setVertexBufferChannel(Semantic const& semantic, U8* base, U32 offset, U32 stride)
     {
-        BufferEntryList::iterator itr = std::find_if(m_vtxBufEntries.begin(), m_vtxBufEntries.end(),
-            [&](BufferChannelEntry const& entry) -> bool {
-                return entry.semantic == semantic;
-            }
-        );
+        U32 channel = m_vtxBufLookup.get(semantic, m_vtxBufEntries.size());
 
-        if (itr == m_vtxBufEntries.end())
+        if (channel == m_vtxBufEntries.size())
         {
+            m_vtxBufLookup.set(semantic, channel);
             m_vtxBufEntries.push_back(BufferChannelEntry{semantic, base + offset, stride});
         }
         else
         {
-            BufferChannelEntry& entry = *itr;
+            BufferChannelEntry& entry = m_vtxBufEntries[channel];
             entry.base = base + offset;
             entry.stride = stride;
         }
@@ -118,23 +109,29 @@ namespace Device {
 
     bool InputAssembler::getVertexBufferChannel(Semantic const& semantic, U8** pBase, U32* pStride)
     {
-        BufferEntryList::iterator itr = std::find_if(m_vtxBufEntries.begin(), m_vtxBufEntries.end(),
-            [&](BufferChannelEntry const& entry) -> bool {
-                return entry.semantic == semantic;
-            }
-        );
+        U32 channel = m_vtxBufLookup.get(semantic, m_vtxBufEntries.size());
 
-        if (itr == m_vtxBufEntries.end())
+        if (channel == m_vtxBufEntries.size())
         {
             return false;
         }
 
-        *pBase = itr->base;
-        *pStride = itr->stride;
+        *pBase = m_vtxBufEntries[channel].base;
+        *pStride = m_vtxBufEntries[channel].stride;
 
         return true;
     }
 
+    std::vector<Semantic> InputAssembler::getVertexLayout() const
+    {
+        std::vector<Semantic> layout;
+        for (BufferChannelEntry const& entry : m_vtxBufEntries)
+        {
+            layout.push_back(entry.semantic);
+        }
+        return layout;
+    }
+
     void InputAssembler::setIndexBuffer(U8* base, U32 offset, U32 stride, U32 length)
     {
         m_idxBufEntry.base = base + offset;
@@ -145,6 +142,7 @@ namespace Device {
     void InputAssembler::setupVertexStream(VertexStream& vertexStream)
     {
         vertexStream.m_vtxBufEntries = this->m_vtxBufEntries;
+        vertexStream.m_vtxBufLookup = this->m_vtxBufLookup;
         vertexStream.m_vtxBufLength = this->m_vtxBufLength;
         vertexStream.m_vtxBufProcessed = 0;
     }
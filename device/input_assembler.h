@@ -48,6 +48,7 @@ namespace Device {
             friend class InputAssembler;
         protected:
             BufferEntryList m_vtxBufEntries;
+            SemanticMap m_vtxBufLookup;
             U32 m_vtxBufLength;
             U32 m_vtxBufProcessed; // <$ are processed
 
@@ -113,6 +114,7 @@ namespace Device {
 
     protected:
         BufferEntryList m_vtxBufEntries;
+        SemanticMap m_vtxBufLookup;
         U32 m_vtxBufLength;
 
         BufferChannelEntry m_idxBufEntry;
@@ -127,6 +129,9 @@ namespace Device {
 
         bool getVertexBufferChannel(Semantic const& semantic, U8** pBase, U32* pStride);
 
+        // Returns the semantics of all vertex buffer channels, in channel order.
+        std::vector<Semantic> getVertexLayout() const;
+
         void setIndexBuffer(U8* base, U32 offset, U32 stride, U32 length);
 
         void setupVertexStream(VertexStream& vertexStream);
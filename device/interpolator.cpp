@@ -0,0 +1,94 @@
+#include "interpolator.h"
+
+namespace Device {
+
+    VaryingFunc selectVaryingFunc(Type const& type)
+    {
+        switch (type)
+        {
+            case Type::FLOAT:
+                return &interpolateVarying<TypeTrait<Type::FLOAT>::CppType>;
+            case Type::FLOAT2:
+                return &interpolateVarying<TypeTrait<Type::FLOAT2>::CppType>;
+            case Type::FLOAT3:
+                return &interpolateVarying<TypeTrait<Type::FLOAT3>::CppType>;
+            case Type::FLOAT4:
+                return &interpolateVarying<TypeTrait<Type::FLOAT4>::CppType>;
+            case Type::HALF:
+                return &interpolateVarying<TypeTrait<Type::HALF>::CppType>;
+            case Type::HALF2:
+                return &interpolateVarying<TypeTrait<Type::HALF2>::CppType>;
+            case Type::HALF3:
+                return &interpolateVarying<TypeTrait<Type::HALF3>::CppType>;
+            case Type::HALF4:
+                return &interpolateVarying<TypeTrait<Type::HALF4>::CppType>;
+            case Type::INT:
+                return &interpolateVarying<TypeTrait<Type::INT>::CppType>;
+            case Type::UINT:
+                return &interpolateVarying<TypeTrait<Type::UINT>::CppType>;
+            default:
+                // type can not be interpolated.
+                assert(0);
+                return nullptr;
+        }
+    }
+
+    // Fallback for type sequences without a specialized kernel, one indirect call per varying.
+    static void interpolateGeneric(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff, Varying const* varyings, U32 numVaryings)
+    {
+        for (U32 index = 0; index < numVaryings; ++index)
+        {
+            Varying const& varying = varyings[index];
+            U32 const src = varying.srcOffset;
+            varying.func(dst + varying.dstOffset, a + src, b + src, c + src, coff);
+        }
+    }
+
+    struct KernelEntry
+    {
+        std::vector<Type> signature;
+        InterpolateKernel kernel;
+    };
+
+#define def_varying_kernel(...) \
+    KernelEntry{ {__VA_ARGS__}, &VaryingKernel<__VA_ARGS__>::run }
+
+    // Varying type sequences of the shaders we ship, extend when adding shaders.
+    static KernelEntry const s_kernels[] =
+    {
+        def_varying_kernel(Type::FLOAT4),
+        def_varying_kernel(Type::FLOAT4, Type::FLOAT3),
+        def_varying_kernel(Type::FLOAT4, Type::FLOAT2),
+        def_varying_kernel(Type::FLOAT4, Type::FLOAT3, Type::FLOAT2),
+        def_varying_kernel(Type::FLOAT4, Type::FLOAT3, Type::FLOAT3, Type::FLOAT2),
+        def_varying_kernel(Type::FLOAT4, Type::FLOAT3, Type::FLOAT3, Type::FLOAT3, Type::FLOAT2),
+        def_varying_kernel(Type::FLOAT4, Type::FLOAT3, Type::HALF3, Type::HALF3, Type::HALF2), // PSSimple
+    };
+
+#undef def_varying_kernel
+
+    InterpolateKernel selectInterpolateKernel(std::vector<Varying> const& varyings)
+    {
+        for (KernelEntry const& entry : s_kernels)
+        {
+            if (entry.signature.size() != varyings.size())
+            {
+                continue;
+            }
+
+            bool match = true;
+            for (U32 index = 0; index < varyings.size() && match; ++index)
+            {
+                match = entry.signature[index] == varyings[index].type;
+            }
+
+            if (match)
+            {
+                return entry.kernel;
+            }
+        }
+
+        return &interpolateGeneric;
+    }
+
+} // namespace Device
@@ -0,0 +1,120 @@
+#ifndef _INTERPOLATOR_H_
+#define _INTERPOLATOR_H_
+
+#include <vector>
+
+#include "vmath.h"
+#include "geometry.h"
+#include "component.h"
+
+namespace Device {
+
+    // Interpolates one varying of type T at dst from the three triangle vertices.
+    template <typename T>
+    inline void interpolateVarying(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff)
+    {
+        T const& _a = *reinterpret_cast<T const*>(a);
+        T const& _b = *reinterpret_cast<T const*>(b);
+        T const& _c = *reinterpret_cast<T const*>(c);
+        *reinterpret_cast<T*>(dst) = _a * coff.u + _b * coff.v + _c * coff.w;
+    }
+
+    // Half varyings are interpolated in float and stored back as half.
+    template <U32 N>
+    inline void interpolateHalfVarying(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff)
+    {
+        float _a[N], _b[N], _c[N], _o[N];
+        halfToFloat(_a, reinterpret_cast<Half const*>(a), N);
+        halfToFloat(_b, reinterpret_cast<Half const*>(b), N);
+        halfToFloat(_c, reinterpret_cast<Half const*>(c), N);
+        for (U32 index = 0; index < N; ++index)
+        {
+            _o[index] = _a[index] * coff.u + _b[index] * coff.v + _c[index] * coff.w;
+        }
+        floatToHalf(reinterpret_cast<Half*>(dst), _o, N);
+    }
+
+    template <>
+    inline void interpolateVarying<Half>(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff)
+    {
+        interpolateHalfVarying<1>(dst, a, b, c, coff);
+    }
+
+    template <>
+    inline void interpolateVarying<Vec2h>(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff)
+    {
+        interpolateHalfVarying<2>(dst, a, b, c, coff);
+    }
+
+    template <>
+    inline void interpolateVarying<Vec3h>(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff)
+    {
+        interpolateHalfVarying<3>(dst, a, b, c, coff);
+    }
+
+    template <>
+    inline void interpolateVarying<Vec4h>(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff)
+    {
+        interpolateHalfVarying<4>(dst, a, b, c, coff);
+    }
+
+    typedef void (*VaryingFunc)(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff);
+
+    // Describes how one pixel shader input is interpolated from vertex shader output.
+    struct Varying
+    {
+        U32 srcOffset;   // offset in vertex shader output element.
+        U32 dstOffset;   // offset in pixel shader input element.
+        Type type;
+        VaryingFunc func; // type specialized interpolation, used by the generic kernel.
+    };
+
+    // Interpolates the whole varying block of one pixel.
+    typedef void (*InterpolateKernel)(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff, Varying const* varyings, U32 numVaryings);
+
+    // A kernel unrolled at compile time over the varying type sequence, no type dispatch at all.
+    template <Type... types>
+    struct VaryingKernel;
+
+    template <>
+    struct VaryingKernel<>
+    {
+        static inline void interpolate(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff, Varying const* varyings)
+        {
+            (void)dst; (void)a; (void)b; (void)c; (void)coff; (void)varyings;
+        }
+    };
+
+    template <Type first, Type... rest>
+    struct VaryingKernel<first, rest...>
+    {
+        static inline void interpolate(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff, Varying const* varyings)
+        {
+            U32 const src = varyings->srcOffset;
+            interpolateVarying<typename TypeTrait<first>::CppType>(dst + varyings->dstOffset, a + src, b + src, c + src, coff);
+            VaryingKernel<rest...>::interpolate(dst, a, b, c, coff, varyings + 1);
+        }
+
+        static void run(U8* dst, U8 const* a, U8 const* b, U8 const* c, BaryCentricCoff const& coff, Varying const* varyings, U32 numVaryings)
+        {
+            (void)numVaryings;
+            interpolate(dst, a, b, c, coff, varyings);
+        }
+    };
+
+    // The per draw interpolation plan, built once per pipeline state.
+    struct InterpolationPlan
+    {
+        std::vector<Varying> varyings; // only varyings provided by vertex shader.
+        InterpolateKernel kernel;
+    };
+
+    // Returns the type specialized interpolation of a single varying.
+    VaryingFunc selectVaryingFunc(Type const& type);
+
+    // Returns a kernel specialized on the varying type sequence, or the generic one if none matches.
+    InterpolateKernel selectInterpolateKernel(std::vector<Varying> const& varyings);
+
+} // namespace Device
+
+#endif // _INTERPOLATOR_H_
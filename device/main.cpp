@@ -1,6 +1,9 @@
 #include <cmath>
 #include <string>
 #include <vector>
+#include <memory>
+#include <random>
+#include <chrono>
 #include <algorithm>
 #include <stddef.h>     /* offsetof */
 
@@ -68,14 +71,19 @@ void test_rasterizer()
         Vec3f b_color = psInArray[i+1].color;
         Vec3f c_color = psInArray[i+2].color;
 
-        std::vector<BaryCentricCoff> rasterOut = rasterizer.rasterizeTriangle(
+        std::vector<PixelQuad> rasterOut = rasterizer.rasterizeTriangle(
             Vec4f{a_pos.x, a_pos.y, a_pos.z, 1.0f},
             Vec4f{b_pos.x, b_pos.y, b_pos.z, 1.0f},
             Vec4f{c_pos.x, c_pos.y, c_pos.z, 1.0f});
 
-        for (U32 j = 0; j < rasterOut.size(); j ++)
+        for (U32 j = 0; j < rasterOut.size() * QUAD_LANES; j ++)
         {
-            BaryCentricCoff const& coff = rasterOut[j];
+            PixelQuad const& quad = rasterOut[j / QUAD_LANES];
+            if (!isLaneCovered(quad.coverage, j % QUAD_LANES))
+            {
+                continue;
+            }
+            BaryCentricCoff const& coff = quad.coffs[j % QUAD_LANES];
 
             Vec3f pixelPos = interpolate(a_pos, coff.u, b_pos, coff.v, c_pos, coff.w);
             Vec3f pixelColor = interpolate(a_color, coff.u, b_color, coff.v, c_color, coff.w);
@@ -219,14 +227,27 @@ Mat44f projPerspective(
 }
 
 
-void test_fixed_pipeline()
+// How the demo scene is shaded.
+enum class RenderPath
 {
-    Pipeline device{};
-    device.setTargetSize(WIDTH, HEIGHT);
+    FORWARD,
+    DEFERRED,   // draws write the G-buffer, each visible pixel is lit once afterwards.
+    VISIBILITY, // draws write triangle ids, each visible pixel is shaded once afterwards.
+};
+
+// The demo scene, a cube textured with cubeImage and a sphere textured with sphereImage, drawn to color target 0.
+void drawScene(Pipeline& device, RenderPath path, bitmap_image const& cubeImage, bitmap_image const& sphereImage)
+{
+    device.clear(Vec3f{0.0f, 0.0f, 0.0f}, 0.0f);
 
     Shader vsShader = loadVS_Simple();
     Shader psShader = loadPS_Simple();
 
+    bool const deferred = path == RenderPath::DEFERRED;
+    Shader gBufferShader = loadPS_GBuffer();
+    Shader lightingShader = loadPS_SimpleLighting();
+    float* pMaterialId = (float*)gBufferShader.getConstantAddr("cMaterialId");
+
     // setup camera
     Mat44f matView;
     Mat44f matProj;
@@ -260,8 +281,12 @@ void test_fixed_pipeline()
     float* pLightShininess  = (float*)psShader.getConstantAddr("cLightShininess");
     Texture::Texture2D* pTexture = (Texture::Texture2D*)psShader.getConstantAddr("cTexture0");
     Texture::Sampler2D* pSampler = (Texture::Sampler2D*)psShader.getConstantAddr("cSampler0");
-    bitmap_image earthImage("resources/earth2048.bmp");
-    bitmap_image lenaImage("resources/lena.bmp");
+    if (deferred)
+    {
+        // one material per model, the light constants are shared with psShader.
+        pTexture = (Texture::Texture2D*)lightingShader.getConstantAddr("cTexture0");
+        pSampler = (Texture::Sampler2D*)lightingShader.getConstantAddr("cSampler0");
+    }
     {
         Vec4f lightPosWorld = Vec4f{8.0, 8.0, 5.0, 1.0};
         Vec4f lightPos = matView * lightPosWorld;
@@ -275,7 +300,21 @@ void test_fixed_pipeline()
     }
 
     device.setVSProgram(vsShader);
-    device.setPSProgram(psShader);
+    device.setPSProgram(deferred ? gBufferShader : psShader);
+    if (deferred)
+    {
+        device.setDeferred(true);
+        device.setLightingProgram(lightingShader);
+    }
+    if (path == RenderPath::VISIBILITY)
+    {
+        // the texture of the cube is replaced by the one of the sphere before the resolve.
+        device.setVisibilityBuffer(true);
+    }
+
+    // bound as views, the visibility buffer samples them when it is resolved.
+    Texture::Texture2D cubeTexture;
+    Texture::Texture2D sphereTexture;
 
     // if (false)
     {
@@ -285,6 +324,7 @@ void test_fixed_pipeline()
         std::vector<U32> indices;
 
         Model::genCuoid(vertices, normals, texCoords, indices);
+        *pMaterialId = 0.0f;
 
         // adjust world position
         {
@@ -308,8 +348,9 @@ void test_fixed_pipeline()
 
         // setup texture
         {
-            *pTexture = {Texture::TexelFormat::B8G8R8_UINT, lenaImage.width(), lenaImage.height(), lenaImage.data()};
-            *pSampler = {Texture::FilterMode::LINEAR, Texture::AddressMode::WRAP, Texture::AddressMode::WRAP};
+            cubeTexture.upload(Texture::TexelFormat::B8G8R8_SRGB, cubeImage.width(), cubeImage.height(), cubeImage.data(), Texture::TexelLayout::TILED_4X4);
+            *pTexture = Texture::Texture2D::view(cubeTexture);
+            *pSampler = {Texture::FilterMode::LINEAR_MIPMAP_LINEAR, Texture::AddressMode::WRAP, Texture::AddressMode::WRAP, Vec4f{0.0f, 0.0f, 0.0f, 0.0f}};
         }
 
         device.setVertexBufferChannel(Semantic::Position0, (U8*)vertices.data(), 0, sizeof(Vec3f));
@@ -333,6 +374,13 @@ void test_fixed_pipeline()
 
         Model::genSphere(vertices, normals, texCoords, indices);
 
+        if (deferred)
+        {
+            pTexture = (Texture::Texture2D*)lightingShader.getConstantAddr("cTexture1");
+            pSampler = (Texture::Sampler2D*)lightingShader.getConstantAddr("cSampler1");
+            *pMaterialId = 1.0f;
+        }
+
         // adjust world position
         {
             Mat44f matWorld;
@@ -350,8 +398,9 @@ void test_fixed_pipeline()
         }
         // setup texture
         {
-            *pTexture = {Texture::TexelFormat::B8G8R8_UINT, earthImage.width(), earthImage.height(), earthImage.data()};
-            *pSampler = {Texture::FilterMode::LINEAR, Texture::AddressMode::WRAP, Texture::AddressMode::WRAP};
+            sphereTexture.upload(Texture::TexelFormat::B8G8R8_SRGB, sphereImage.width(), sphereImage.height(), sphereImage.data(), Texture::TexelLayout::TILED_4X4);
+            *pTexture = Texture::Texture2D::view(sphereTexture);
+            *pSampler = {Texture::FilterMode::LINEAR_MIPMAP_LINEAR, Texture::AddressMode::WRAP, Texture::AddressMode::WRAP, Vec4f{0.0f, 0.0f, 0.0f, 0.0f}};
         }
 
         device.setVertexBufferChannel(Semantic::Position0, (U8*)vertices.data(), 0, sizeof(Vec3f));
@@ -365,14 +414,834 @@ void test_fixed_pipeline()
 
         device.drawIndexed();
     }
+
+    if (deferred)
+    {
+        device.drawDeferredLighting();
+    }
+    if (path == RenderPath::VISIBILITY)
+    {
+        device.resolveVisibility();
+    }
+}
+
+void test_fixed_pipeline(RenderPath path)
+{
+    Pipeline device{};
+    device.setTargetSize(WIDTH, HEIGHT);
+
+    bitmap_image earthImage("resources/earth2048.bmp");
+    bitmap_image lenaImage("resources/lena.bmp");
+    drawScene(device, path, lenaImage, earthImage);
+
     device.present();
 }
 
-int main()
+// Behaviour tests report failures and make main return non-zero.
+static U32 s_failures = 0;
+
+static void check(bool condition, char const* what)
+{
+    if (!condition)
+    {
+        std::cout << "FAILED: " << what << std::endl;
+        ++s_failures;
+    }
+}
+
+static bool nearlyEqual(Vec4f const& a, Vec4f const& b, float tolerance)
+{
+    return std::abs(a.x - b.x) <= tolerance && std::abs(a.y - b.y) <= tolerance && std::abs(a.z - b.z) <= tolerance && std::abs(a.w - b.w) <= tolerance;
+}
+
+static Vec4f readPixel(Texture2D const& target, U32 x, U32 y)
+{
+    return decodeTexel(target.getFormat(), target.readTexel(x, y));
+}
+
+// Small targets for the behaviour tests.
+static const U32 TEST_SIZE = 64;
+
+// Pixels [x0, x1) x [y0, y1) at NDC depth z, two triangles for loadVS_Flat with an identity mWorldViewProj.
+// The outer edges are between pixel centers. The rasterizer has no fill rule, pixel centers on the shared
+// diagonal are covered by neither triangle. A predicated draw if predicate is set.
+static void drawRect(Pipeline& device, U32 x0, U32 y0, U32 x1, U32 y1, float z, OcclusionQuery const* predicate = nullptr)
+{
+    auto toNDC = [&](U32 px, U32 py) { return Vec3f{px * 2.0f / TEST_SIZE - 1.0f, py * 2.0f / TEST_SIZE - 1.0f, z}; };
+    std::vector<Vec3f> vertices = {toNDC(x0, y0), toNDC(x1, y0), toNDC(x0, y1), toNDC(x1, y1)};
+    std::vector<U32> indices = {0, 1, 2, 1, 3, 2};
+
+    device.setVertexBufferChannel(Semantic::Position0, (U8*)vertices.data(), 0, sizeof(Vec3f));
+    device.setVertexBufferLength(vertices.size());
+    device.setIndexBuffer((U8*)indices.data(), 0, sizeof(U32), indices.size());
+    if (predicate != nullptr)
+    {
+        device.drawIndexed(*predicate);
+    }
+    else
+    {
+        device.drawIndexed();
+    }
+}
+
+// A TEST_SIZE device drawing with vs in NDC and ps, cleared to blue and a depth of 0.
+// Changing a target format drops the clear. Devices are not copied, their components point to their streams.
+static std::unique_ptr<Pipeline> makeTestDevice(Shader& vs, Shader& ps)
+{
+    ((Mat44f*)vs.getConstantAddr("mWorldViewProj"))->make_identity();
+
+    std::unique_ptr<Pipeline> device{new Pipeline{}};
+    device->setTargetSize(TEST_SIZE, TEST_SIZE);
+    device->clear(Vec3f{0.0f, 0.0f, 1.0f}, 0.0f);
+    device->setVSProgram(vs);
+    device->setPSProgram(ps);
+    return device;
+}
+
+// No color channel is written, draws only test and write the depth and the stencil.
+static BlendState noColorState()
+{
+    BlendState state = BlendState::opaque();
+    state.writeMask = 0;
+    return state;
+}
+
+// Colors and depths read back from each target format match what was drawn within the format precision.
+void test_target_formats()
+{
+    Shader vsShader = loadVS_Flat();
+    Shader psShader = loadPS_Flat();
+    *(Vec3f*)psShader.getConstantAddr("cColor") = Vec3f{0.25f, 0.5f, 0.75f};
+
+    struct FormatCase
+    {
+        TexelFormat color;
+        TexelFormat depth;
+        float tolerance;
+    };
+    FormatCase const cases[] =
+    {
+        {TexelFormat::R32G32B32_FLOAT, TexelFormat::D32_FLOAT, 0.0f},
+        {TexelFormat::R8G8B8A8_UNORM, TexelFormat::D24_UNORM_S8_UINT, 1.0f / 255},
+        {TexelFormat::R8G8B8A8_SRGB, TexelFormat::D16_UNORM, 0.01f},
+        {TexelFormat::R10G10B10A2_UNORM, TexelFormat::D32_FLOAT, 1.0f / 1023},
+    };
+
+    for (FormatCase const& formatCase : cases)
+    {
+        std::unique_ptr<Pipeline> const pDevice = makeTestDevice(vsShader, psShader);
+        Pipeline& device = *pDevice;
+        device.setTargetFormats(formatCase.color, formatCase.depth);
+        device.clear(Vec3f{0.0f, 0.0f, 0.0f}, 0.0f);
+
+        // NDC depth 0 is 0.5 in the target.
+        drawRect(device, 8, 8, 24, 24, 0.0f);
+
+        Texture2D const& color = device.getColorTarget(0);
+        Texture2D const& depth = device.getDepthTarget();
+        check(color.getFormat() == formatCase.color && depth.getFormat() == formatCase.depth, "target formats are set");
+        check(nearlyEqual(readPixel(color, 16, 16), Vec4f{0.25f, 0.5f, 0.75f, 1.0f}, formatCase.tolerance), "drawn color is stored in the target format");
+        check(nearlyEqual(readPixel(color, 40, 40), Vec4f{0.0f, 0.0f, 0.0f, 1.0f}, 0.0f), "undrawn pixels keep the clear color");
+        check(std::abs(readPixel(depth, 16, 16).x - 0.5f) <= 1.0f / 65535, "drawn depth is stored in the target format");
+        check(readPixel(depth, 40, 40).x == 0.0f, "undrawn pixels keep the clear depth");
+    }
+}
+
+// Source alpha blending and channel write masks.
+void test_blend()
+{
+    Shader vsShader = loadVS_Flat();
+    Shader psShader = loadPS_FlatMRT();
+    Vec4f* pColor = (Vec4f*)psShader.getConstantAddr("cColor");
+
+    std::unique_ptr<Pipeline> const pDevice = makeTestDevice(vsShader, psShader);
+    Pipeline& device = *pDevice;
+    device.setTargetFormats(TexelFormat::R8G8B8A8_UNORM, TexelFormat::D32_FLOAT);
+
+    // half of the source over the clear color.
+    device.clear(Vec3f{0.0f, 0.0f, 1.0f}, 0.0f);
+    device.setBlendState(BlendState::alphaBlend());
+    *pColor = Vec4f{1.0f, 0.0f, 0.0f, 0.5f};
+    drawRect(device, 8, 8, 24, 24, 0.0f);
+    check(nearlyEqual(readPixel(device.getColorTarget(0), 16, 16), Vec4f{0.5f, 0.0f, 0.5f, 1.0f}, 1.0f / 255), "alpha blend of 0.5 mixes source and target");
+    check(nearlyEqual(readPixel(device.getColorTarget(0), 40, 40), Vec4f{0.0f, 0.0f, 1.0f, 1.0f}, 0.0f), "alpha blend keeps undrawn pixels");
+
+    // masked channels keep the target.
+    device.clear(Vec3f{0.0f, 0.0f, 1.0f}, 0.0f);
+    BlendState masked = BlendState::opaque();
+    masked.writeMask = COLOR_WRITE_RED | COLOR_WRITE_ALPHA;
+    device.setBlendState(masked);
+    *pColor = Vec4f{1.0f, 1.0f, 0.0f, 0.5f};
+    drawRect(device, 8, 8, 24, 24, 0.0f);
+    check(nearlyEqual(readPixel(device.getColorTarget(0), 16, 16), Vec4f{1.0f, 0.0f, 1.0f, 0.5f}, 1.0f / 255), "write mask writes red and alpha only");
+
+    // color and alpha use different ops.
+    device.clear(Vec3f{0.5f, 0.5f, 1.0f}, 0.0f);
+    BlendState reverse = BlendState::alphaBlend();
+    reverse.dstColor = BlendFactor::ONE;
+    reverse.colorOp = BlendOp::REV_SUBTRACT;
+    reverse.alphaOp = BlendOp::MIN;
+    device.setBlendState(reverse);
+    *pColor = Vec4f{0.25f, 0.0f, 0.5f, 0.25f};
+    drawRect(device, 8, 8, 24, 24, 0.0f);
+    check(nearlyEqual(readPixel(device.getColorTarget(0), 16, 16), Vec4f{0.4375f, 0.5f, 0.875f, 0.25f}, 1.0f / 255), "reverse subtract of color and min of alpha");
+}
+
+// SV_Target0 and SV_Target2 go to color targets 0 and 2 in one pass, unbound targets are skipped.
+void test_multiple_render_targets()
+{
+    Shader vsShader = loadVS_Flat();
+    Shader psShader = loadPS_FlatMRT();
+    *(Vec4f*)psShader.getConstantAddr("cColor") = Vec4f{1.0f, 0.0f, 0.0f, 1.0f};
+    *(Vec4f*)psShader.getConstantAddr("cColor2") = Vec4f{0.0f, 1.0f, 0.0f, 0.5f};
+
+    std::unique_ptr<Pipeline> const pDevice = makeTestDevice(vsShader, psShader);
+    Pipeline& device = *pDevice;
+    device.setColorTargetFormat(1, TexelFormat::R8G8B8A8_UNORM);
+    device.setColorTargetFormat(2, TexelFormat::R8G8B8A8_UNORM);
+    device.clear(Vec3f{0.0f, 0.0f, 1.0f}, 0.0f);
+    drawRect(device, 8, 8, 24, 24, 0.0f);
+
+    check(nearlyEqual(readPixel(device.getColorTarget(0), 16, 16), Vec4f{1.0f, 0.0f, 0.0f, 1.0f}, 0.0f), "SV_Target0 is written to color target 0");
+    check(nearlyEqual(readPixel(device.getColorTarget(2), 16, 16), Vec4f{0.0f, 1.0f, 0.0f, 0.5f}, 1.0f / 255), "SV_Target2 is written to color target 2");
+    check(nearlyEqual(readPixel(device.getColorTarget(1), 16, 16), Vec4f{0.0f, 0.0f, 1.0f, 1.0f}, 0.0f), "a target without a shader output keeps the clear color");
+    check(nearlyEqual(readPixel(device.getColorTarget(2), 40, 40), Vec4f{0.0f, 0.0f, 1.0f, 1.0f}, 0.0f), "undrawn pixels of target 2 keep the clear color");
+}
+
+// A pixel shader rebuilt at the address of the previous one gets its own pipeline state.
+void test_shader_rebuild()
+{
+    Shader vsShader = loadVS_Flat();
+    ((Mat44f*)vsShader.getConstantAddr("mWorldViewProj"))->make_identity();
+
+    Pipeline device{};
+    device.setTargetSize(TEST_SIZE, TEST_SIZE);
+    device.setColorTargetFormat(2, TexelFormat::R8G8B8A8_UNORM);
+    device.setVSProgram(vsShader);
+
+    for (U32 iteration = 0; iteration < 2; ++iteration)
+    {
+        // FLOAT4 colors to two targets first, then a FLOAT3 color to target 0.
+        Shader psShader = iteration == 0 ? loadPS_FlatMRT() : loadPS_Flat();
+        if (iteration == 0)
+        {
+            *(Vec4f*)psShader.getConstantAddr("cColor") = Vec4f{1.0f, 0.0f, 0.0f, 1.0f};
+            *(Vec4f*)psShader.getConstantAddr("cColor2") = Vec4f{1.0f, 0.0f, 0.0f, 1.0f};
+        }
+        else
+        {
+            *(Vec3f*)psShader.getConstantAddr("cColor") = Vec3f{0.0f, 1.0f, 0.0f};
+        }
+
+        device.clear(Vec3f{0.0f, 0.0f, 1.0f}, 0.0f);
+        device.setPSProgram(psShader);
+        drawRect(device, 8, 8, 24, 24, 0.0f);
+
+        Vec4f const expected = iteration == 0 ? Vec4f{1.0f, 0.0f, 0.0f, 1.0f} : Vec4f{0.0f, 1.0f, 0.0f, 1.0f};
+        check(nearlyEqual(readPixel(device.getColorTarget(0), 16, 16), expected, 0.0f), "rebuilt pixel shader writes its own output");
+    }
+    check(nearlyEqual(readPixel(device.getColorTarget(2), 16, 16), Vec4f{0.0f, 0.0f, 1.0f, 1.0f}, 0.0f), "rebuilt pixel shader only writes its own targets");
+}
+
+// A portal marked in the stencil masks a later draw, the stencil is ignored without a stencil format.
+void test_stencil_portal()
+{
+    Shader vsShader = loadVS_Flat();
+    Shader psShader = loadPS_Flat();
+    Vec3f* pColor = (Vec3f*)psShader.getConstantAddr("cColor");
+
+    TexelLayout const layouts[] = {TexelLayout::LINEAR, TexelLayout::TILED_8X8_MORTON};
+    for (TexelLayout layout : layouts)
+    {
+        std::unique_ptr<Pipeline> const pDevice = makeTestDevice(vsShader, psShader);
+        Pipeline& device = *pDevice;
+        device.setTargetLayout(layout);
+        device.setTargetFormats(TexelFormat::R32G32B32_FLOAT, TexelFormat::D24_UNORM_S8_UINT);
+        device.clear(Vec3f{0.0f, 0.0f, 1.0f}, 0.0f);
+
+        // the portal only writes the stencil.
+        device.setBlendState(noColorState());
+        device.setDepthWrite(false);
+        device.setStencilState(StencilState::replace(1));
+        drawRect(device, 8, 8, 24, 24, 0.0f);
+
+        // a full screen draw seen through the portal.
+        device.setBlendState(BlendState::opaque());
+        device.setDepthWrite(true);
+        device.setStencilState(StencilState::equal(1));
+        *pColor = Vec3f{1.0f, 0.0f, 0.0f};
+        drawRect(device, 0, 0, TEST_SIZE, TEST_SIZE, 0.0f);
+
+        Texture2D const& color = device.getColorTarget(0);
+        check(nearlyEqual(readPixel(color, 16, 16), Vec4f{1.0f, 0.0f, 0.0f, 1.0f}, 0.0f), "draw is visible inside the portal");
+        check(nearlyEqual(readPixel(color, 40, 40), Vec4f{0.0f, 0.0f, 1.0f, 1.0f}, 0.0f), "draw is masked outside the portal");
+        check(nearlyEqual(readPixel(color, 24, 16), Vec4f{0.0f, 0.0f, 1.0f, 1.0f}, 0.0f), "portal edge is exact");
+
+        // without a stencil the same state passes everywhere.
+        device.setTargetFormats(TexelFormat::R32G32B32_FLOAT, TexelFormat::D32_FLOAT);
+        device.clear(Vec3f{0.0f, 0.0f, 1.0f}, 0.0f);
+        drawRect(device, 0, 0, TEST_SIZE, TEST_SIZE, 0.0f);
+        check(nearlyEqual(readPixel(device.getColorTarget(0), 40, 40), Vec4f{1.0f, 0.0f, 0.0f, 1.0f}, 0.0f), "stencil is ignored without D24_UNORM_S8_UINT");
+    }
+}
+
+// Bounding box proxies drawn without color and depth writes count the samples that would be visible.
+void test_occlusion_query()
+{
+    Shader vsShader = loadVS_Flat();
+    Shader psShader = loadPS_Flat();
+    *(Vec3f*)psShader.getConstantAddr("cColor") = Vec3f{1.0f, 0.0f, 0.0f};
+
+    std::unique_ptr<Pipeline> const pDevice = makeTestDevice(vsShader, psShader);
+    Pipeline& device = *pDevice;
+
+    // an occluder over the left half, nearer than the proxies.
+    drawRect(device, 0, 0, TEST_SIZE / 2, TEST_SIZE, -0.5f);
+
+    device.setBlendState(noColorState());
+    device.setDepthWrite(false);
+
+    OcclusionQuery all;
+    OcclusionQuery occluded;
+    OcclusionQuery visible;
+    check(!occluded.hasResult && occluded.samples == 0, "a query starts without a result");
+
+    // queries may overlap.
+    device.beginQuery(all);
+    device.beginQuery(occluded);
+    drawRect(device, 8, 8, 24, 24, 0.0f);
+    device.endQuery(occluded);
+    device.beginQuery(visible);
+    drawRect(device, 40, 8, 56, 24, 0.0f);
+    device.endQuery(visible);
+    device.endQuery(all);
+
+    check(nearlyEqual(readPixel(device.getColorTarget(0), 48, 16), Vec4f{0.0f, 0.0f, 1.0f, 1.0f}, 0.0f), "proxy writes no color");
+    check(readPixel(device.getDepthTarget(), 48, 16).x == 0.0f, "proxy writes no depth");
+
+    // the visible proxy drawn with color writes shows the pixels it covers.
+    device.setBlendState(BlendState::opaque());
+    drawRect(device, 40, 8, 56, 24, 0.0f);
+    U32 numCovered = 0;
+    for (U32 y = 8; y < 24; ++y)
+    {
+        for (U32 x = 40; x < 56; ++x)
+        {
+            numCovered += readPixel(device.getColorTarget(0), x, y).x == 1.0f ? 1 : 0;
+        }
+    }
+
+    check(occluded.hasResult && occluded.samples == 0, "occluded proxy passes no sample");
+    check(visible.hasResult && numCovered > 0 && visible.samples == numCovered, "visible proxy passes each covered pixel");
+    check(all.samples == numCovered, "overlapping query counts both proxies");
+}
+
+// Predicated draws are skipped if the last result of the query is zero samples, and drawn otherwise.
+void test_predicated_draw()
+{
+    Shader vsShader = loadVS_Flat();
+    Shader psShader = loadPS_Flat();
+    Vec3f* pColor = (Vec3f*)psShader.getConstantAddr("cColor");
+
+    std::unique_ptr<Pipeline> const pDevice = makeTestDevice(vsShader, psShader);
+    Pipeline& device = *pDevice;
+
+    // an occluder over the left half.
+    *pColor = Vec3f{0.0f, 1.0f, 0.0f};
+    drawRect(device, 0, 0, TEST_SIZE / 2, TEST_SIZE, -0.5f);
+
+    device.setBlendState(noColorState());
+    device.setDepthWrite(false);
+
+    OcclusionQuery occluded;
+    OcclusionQuery visible;
+    OcclusionQuery neverIssued;
+    device.beginQuery(occluded);
+    drawRect(device, 8, 8, 24, 24, 0.0f);
+    device.endQuery(occluded);
+    device.beginQuery(visible);
+    drawRect(device, 40, 8, 56, 24, 0.0f);
+    device.endQuery(visible);
+
+    // the objects of the proxies, nearer than the occluder so that a draw shows.
+    device.setBlendState(BlendState::opaque());
+    device.setDepthWrite(true);
+    *pColor = Vec3f{1.0f, 0.0f, 0.0f};
+
+    // reissued for the next frame, the result of its last endQuery still applies.
+    device.beginQuery(occluded);
+    drawRect(device, 8, 40, 24, 56, -0.75f, &occluded);
+    drawRect(device, 40, 40, 56, 56, -0.75f, &visible);
+    drawRect(device, 8, 24, 24, 40, -0.75f, &neverIssued);
+    device.endQuery(occluded);
+
+    Texture2D const& color = device.getColorTarget(0);
+    check(nearlyEqual(readPixel(color, 16, 48), Vec4f{0.0f, 1.0f, 0.0f, 1.0f}, 0.0f), "draw is skipped if its query passed no sample");
+    check(nearlyEqual(readPixel(color, 48, 48), Vec4f{1.0f, 0.0f, 0.0f, 1.0f}, 0.0f), "draw runs if its query passed samples");
+    check(nearlyEqual(readPixel(color, 16, 28), Vec4f{1.0f, 0.0f, 0.0f, 1.0f}, 0.0f), "draw runs if its query never ended");
+}
+
+// Texel coordinate of mode for coord, -1 for a BORDER texel outside of the level.
+static int addressTexel(AddressMode mode, int coord, int size)
+{
+    int const period = mode == AddressMode::MIRROR ? size * 2 : size;
+    int const rest = (coord % period + period) % period;
+    switch (mode)
+    {
+        case AddressMode::WRAP:   return rest;
+        case AddressMode::MIRROR: return rest < size ? rest : period - 1 - rest;
+        case AddressMode::CLAMP:  return std::min(std::max(coord, 0), size - 1);
+        default:                  return coord >= 0 && coord < size ? coord : -1;
+    }
+}
+
+// Texcoords outside of [0, 1] address the right texels with every address mode, in power of two and other sizes.
+// The specialized kernels match the generic path.
+void test_address_modes()
+{
+    struct SizeCase
+    {
+        U32 width;
+        U32 height;
+    };
+    SizeCase const sizes[] = {{4, 4}, {5, 3}};
+    TexelLayout const layouts[] = {TexelLayout::LINEAR, TexelLayout::MORTON};
+    AddressMode const modes[] = {AddressMode::WRAP, AddressMode::MIRROR, AddressMode::CLAMP, AddressMode::BORDER};
+    Vec4f const border{9.0f, 9.0f, 9.0f, 9.0f};
+
+    for (SizeCase const& size : sizes)
+    {
+        // each texel holds its coordinates.
+        std::vector<Vec4f> texels;
+        for (U32 y = 0; y < size.height; ++y)
+        {
+            for (U32 x = 0; x < size.width; ++x)
+            {
+                texels.push_back(Vec4f{(float)x, (float)y, 0.5f, 1.0f});
+            }
+        }
+
+        for (TexelLayout layout : layouts)
+        {
+            Texture2D texture{TexelFormat::R32G32B32A32_FLOAT, size.width, size.height, (U8*)texels.data()};
+            texture.swizzle(layout);
+
+            for (AddressMode mode : modes)
+            {
+                Sampler2D const nearest{FilterMode::NEAREST, mode, mode, border};
+                Sampler2D const linear{FilterMode::LINEAR, mode, mode, border};
+                bool nearestMatches = true;
+                bool kernelMatches = true;
+
+                // two levels to each side.
+                int const width = size.width;
+                int const height = size.height;
+                for (int y = -2 * height; y < 3 * height; ++y)
+                {
+                    for (int x = -2 * width; x < 3 * width; ++x)
+                    {
+                        Vec2f const center{(x + 0.5f) / width, (y + 0.5f) / height};
+                        int const addressX = addressTexel(mode, x, width);
+                        int const addressY = addressTexel(mode, y, height);
+                        Vec4f const expected = addressX < 0 || addressY < 0 ? border : Vec4f{(float)addressX, (float)addressY, 0.5f, 1.0f};
+                        nearestMatches = nearestMatches && nearlyEqual(SampleLevel(texture, nearest, center, 0.0f), expected, 0.0f);
+
+                        // between texel centers, all four taps of the bilinear filter are addressed.
+                        Vec2f uv[SAMPLE_BATCH];
+                        for (U32 index = 0; index < SAMPLE_BATCH; ++index)
+                        {
+                            uv[index] = Vec2f{(x + 0.25f * index) / width, (y + 0.3f) / height};
+                        }
+                        Vec4f batch[SAMPLE_BATCH];
+                        SampleLevelBatch(texture, linear, uv, 0.0f, batch);
+                        for (U32 index = 0; index < SAMPLE_BATCH; ++index)
+                        {
+                            Vec4f const reference = SampleLevelGeneric(texture, linear, uv[index], 0.0f);
+                            kernelMatches = kernelMatches &&
+                                nearlyEqual(SampleLevel(texture, linear, uv[index], 0.0f), reference, 1e-5f) &&
+                                nearlyEqual(batch[index], reference, 1e-5f);
+                        }
+                    }
+                }
+                check(nearestMatches, "texcoords outside of the level address the expected texels");
+                check(kernelMatches, "specialized kernel matches the generic path outside of the level");
+            }
+        }
+    }
+}
+
+// Round trip of one 4x4 block: 16 RGBA8 texels of format compressed to blockFormat, decoded texels within tolerance.
+static bool roundTripBlock(TexelFormat format, TexelFormat blockFormat, std::vector<Vec4<U8>> texels, float tolerance)
 {
+    Texture2D texture{format, 4, 4, (U8*)texels.data()};
+    std::vector<Vec4f> expected;
+    for (U32 y = 0; y < 4; ++y)
+    {
+        for (U32 x = 0; x < 4; ++x)
+        {
+            expected.push_back(texture.getTexelAsVec4f(x, y));
+        }
+    }
+
+    texture.compress(blockFormat);
+    Sampler2D const nearest{FilterMode::NEAREST, AddressMode::CLAMP, AddressMode::CLAMP, Vec4f{}};
+    bool matches = texture.getFormat() == blockFormat;
+    for (U32 y = 0; y < 4; ++y)
+    {
+        for (U32 x = 0; x < 4; ++x)
+        {
+            Vec4f const decoded = texture.getTexelAsVec4f(x, y);
+            Vec4f const sampled = SampleLevel(texture, nearest, Vec2f{(x + 0.5f) / 4, (y + 0.5f) / 4}, 0.0f);
+            matches = matches && nearlyEqual(decoded, expected[x + y * 4], tolerance) && nearlyEqual(sampled, decoded, 1e-6f);
+        }
+    }
+    return matches;
+}
+
+// BC1 and BC3 keep a solid color, a two color gradient and the alpha steps of a block, sRGB blocks keep dark steps.
+void test_block_compression()
+{
+    // 565 endpoints are within 4/255 of a color, the interpolated palette entries round once more.
+    float const colorTolerance = 6.0f / 255;
+
+    std::vector<Vec4<U8>> solid(16, Vec4<U8>{200, 100, 50, 255});
+    check(roundTripBlock(TexelFormat::R8G8B8A8_UINT, TexelFormat::BC1_UNORM, solid, colorTolerance), "BC1 keeps a solid color");
+    check(roundTripBlock(TexelFormat::R8G8B8A8_UINT, TexelFormat::BC3_UNORM, solid, colorTolerance), "BC3 keeps a solid color");
+
+    // columns at the four palette entries between two colors.
+    std::vector<Vec4<U8>> gradient;
+    for (U32 texel = 0; texel < 16; ++texel)
+    {
+        U32 const step = texel % 4;
+        gradient.push_back(Vec4<U8>{(U8)(255 - step * 85), (U8)(step * 85), 64, 255});
+    }
+    check(roundTripBlock(TexelFormat::R8G8B8A8_UINT, TexelFormat::BC1_UNORM, gradient, colorTolerance), "BC1 keeps a two color gradient");
+
+    // the eight alpha steps between 0 and 255, white is exact in 565.
+    std::vector<Vec4<U8>> alpha;
+    for (U32 texel = 0; texel < 16; ++texel)
+    {
+        alpha.push_back(Vec4<U8>{255, 255, 255, (U8)((texel % 8) * 255 / 7)});
+    }
+    check(roundTripBlock(TexelFormat::R8G8B8A8_UINT, TexelFormat::BC3_UNORM, alpha, 1.0f / 255), "BC3 keeps the alpha steps");
+
+    // dark sRGB values are closer than a linear 8 bit step, they stay apart in BC1_SRGB.
+    std::vector<Vec4<U8>> dark;
+    for (U32 texel = 0; texel < 16; ++texel)
+    {
+        U8 const value = (U8)(8 + (texel % 4) * 8);
+        dark.push_back(Vec4<U8>{value, value, value, 255});
+    }
+    check(roundTripBlock(TexelFormat::R8G8B8A8_SRGB, TexelFormat::BC1_SRGB, dark, 0.5f / 255), "BC1_SRGB keeps dark sRGB steps");
+    check(roundTripBlock(TexelFormat::R8G8B8A8_SRGB, TexelFormat::BC3_SRGB, dark, 0.5f / 255), "BC3_SRGB keeps dark sRGB steps");
+}
+
+// The sRGB lookup tables follow the transfer functions, and every 8 bit value survives a round trip.
+void test_srgb_tables()
+{
+    bool roundTrips = true;
+    bool decodeMatches = true;
+    for (U32 value = 0; value < 256; ++value)
+    {
+        float const encoded = value / 255.0f;
+        float const linear = encoded <= 0.04045f ? encoded / 12.92f : std::pow((encoded + 0.055f) / 1.055f, 2.4f);
+        decodeMatches = decodeMatches && std::abs(srgbToLinear((U8)value) - linear) <= 1e-6f;
+        roundTrips = roundTrips && linearToSrgb(srgbToLinear((U8)value)) == value;
+    }
+    check(decodeMatches, "sRGB decode table matches the transfer function");
+    check(roundTrips, "linearToSrgb(srgbToLinear(v)) == v for every 8 bit value");
+
+    // the encode table is quantized, it is within one 8 bit step of the curve.
+    bool encodeMatches = true;
+    for (U32 step = 0; step <= 65536; ++step)
+    {
+        float const linear = step / 65536.0f;
+        float const encoded = linear <= 0.0031308f ? linear * 12.92f : 1.055f * std::pow(linear, 1.0f / 2.4f) - 0.055f;
+        encodeMatches = encodeMatches && std::abs((float)linearToSrgb(linear) - encoded * 255.0f) <= 1.0f;
+    }
+    check(encodeMatches, "sRGB encode table is within one step of the transfer function");
+}
+
+// A checker texture, bright and dark squares of size pixels.
+static bitmap_image makeChecker(U32 width, U32 height, U32 size)
+{
+    bitmap_image image(width, height);
+    for (U32 y = 0; y < height; ++y)
+    {
+        for (U32 x = 0; x < width; ++x)
+        {
+            bool const bright = ((x / size) + (y / size)) % 2 == 0;
+            image.set_pixel(x, y, bright ? 230 : 40, bright ? 200 : 60, bright ? 120 : 160);
+        }
+    }
+    return image;
+}
+
+// Largest channel difference between color target 0 of two devices, and the number of pixels differing by more than tolerance.
+static float compareTargets(Pipeline& a, Pipeline& b, float tolerance, U32& numDiffering)
+{
+    Texture2D const& targetA = a.getColorTarget(0);
+    Texture2D const& targetB = b.getColorTarget(0);
+    float maxDiff = 0.0f;
+    numDiffering = 0;
+    for (U32 y = 0; y < targetA.getHeight(); ++y)
+    {
+        for (U32 x = 0; x < targetA.getWidth(); ++x)
+        {
+            Vec4f const colorA = readPixel(targetA, x, y);
+            Vec4f const colorB = readPixel(targetB, x, y);
+            float const diff = std::max({std::abs(colorA.x - colorB.x), std::abs(colorA.y - colorB.y), std::abs(colorA.z - colorB.z)});
+            maxDiff = std::max(maxDiff, diff);
+            numDiffering += diff > tolerance ? 1 : 0;
+        }
+    }
+    return maxDiff;
+}
+
+// The demo scene drawn through path matches the forward path within 1/255, silhouettes included.
+// The visibility buffer path shades each draw with the constants and textures it was drawn with.
+static void checkMatchesForward(RenderPath path, char const* name)
+{
+    bitmap_image lenaImage("resources/lena.bmp");
+    bitmap_image checkerImage = makeChecker(256, 256, 16);
+
+    Pipeline forward{};
+    forward.setTargetSize(WIDTH, HEIGHT);
+    drawScene(forward, RenderPath::FORWARD, lenaImage, checkerImage);
+
+    Pipeline device{};
+    device.setTargetSize(WIDTH, HEIGHT);
+    drawScene(device, path, lenaImage, checkerImage);
+
+    U32 numDiffering = 0;
+    float const maxDiff = compareTargets(forward, device, 1.0f / 255, numDiffering);
+    std::cout << name << ": " << numDiffering << " pixels differ by more than 1/255 from forward, at most " << maxDiff << std::endl;
+    std::string const what = std::string(name) + " output matches forward output";
+    check(numDiffering == 0, what.c_str());
+}
+
+// Draws past the ids of the visibility buffer resolve the earlier ones, each draw keeps its constants.
+void test_visibility_draw_limit()
+{
+    Shader vsShader = loadVS_Flat();
+    Shader psShader = loadPS_Flat();
+    Vec3f* pColor = (Vec3f*)psShader.getConstantAddr("cColor");
+
+    std::unique_ptr<Pipeline> const pDevice = makeTestDevice(vsShader, psShader);
+    Pipeline& device = *pDevice;
+    device.setVisibilityBuffer(true);
+
+    // one 4x4 cell per draw, the draws past the first VISIBILITY_MAX_DRAWS cover the first cells again in front.
+    U32 const cells = (TEST_SIZE / 4) * (TEST_SIZE / 4);
+    U32 const draws = VISIBILITY_MAX_DRAWS + 44;
+    for (U32 draw = 0; draw < draws; ++draw)
+    {
+        U32 const cell = draw % cells;
+        *pColor = Vec3f{cell / 255.0f, draw < cells ? 0.25f : 1.0f, 0.5f};
+        U32 const x = (cell % (TEST_SIZE / 4)) * 4;
+        U32 const y = (cell / (TEST_SIZE / 4)) * 4;
+        drawRect(device, x, y, x + 4, y + 4, draw < cells ? 0.0f : -0.5f);
+    }
+    device.resolveVisibility();
+
+    U32 numWrong = 0;
+    for (U32 cell = 0; cell < cells; ++cell)
+    {
+        Vec4f const expected{cell / 255.0f, cell + cells < draws ? 1.0f : 0.25f, 0.5f, 1.0f};
+        Vec4f const color = readPixel(device.getColorTarget(0), (cell % (TEST_SIZE / 4)) * 4 + 1, (cell / (TEST_SIZE / 4)) * 4 + 1);
+        numWrong += nearlyEqual(color, expected, 0.0f) ? 0 : 1;
+    }
+    check(numWrong == 0, "visibility buffer draws past the draw ids are shaded with their own constants");
+}
+
+// Sampling throughput of each texel layout, texcoords walk lines of random orientation
+// about 1.5 texels apart, like a rotated and slightly minified surface.
+void benchmark_texture_layout()
+{
+    bitmap_image image("resources/lena.bmp");
+
+    U32 const NUM_LINES = 4096;
+    U32 const SAMPLES_PER_LINE = 256;
+    float const step = 1.5f / image.width();
+
+    std::mt19937 rng{1234};
+    std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+    std::vector<Vec2f> origins(NUM_LINES);
+    std::vector<Vec2f> steps(NUM_LINES);
+    for (U32 line = 0; line < NUM_LINES; ++line)
+    {
+        float const angle = unit(rng) * 2.0f * (float)M_PI;
+        origins[line] = Vec2f{unit(rng), unit(rng)};
+        steps[line] = Vec2f{std::cos(angle) * step, std::sin(angle) * step};
+    }
+
+    struct LayoutCase
+    {
+        char const* name;
+        TexelLayout layout;
+    };
+    LayoutCase const cases[] =
+    {
+        {"LINEAR", TexelLayout::LINEAR},
+        {"TILED_4X4", TexelLayout::TILED_4X4},
+        {"MORTON", TexelLayout::MORTON},
+    };
+
+    for (LayoutCase const& layoutCase : cases)
+    {
+        Texture2D texture{TexelFormat::B8G8R8_UINT, image.width(), image.height(), image.data()};
+        texture.swizzle(layoutCase.layout);
+        Sampler2D sampler{FilterMode::LINEAR, AddressMode::WRAP, AddressMode::WRAP, Vec4f{0.0f, 0.0f, 0.0f, 0.0f}};
+
+        Vec4f checksum{};
+        auto start = std::chrono::steady_clock::now();
+        for (U32 line = 0; line < NUM_LINES; ++line)
+        {
+            Vec2f uv = origins[line];
+            for (U32 sample = 0; sample < SAMPLES_PER_LINE; ++sample)
+            {
+                // keep texcoords in [0, 1).
+                Vec2f wrapped{uv.x - std::floor(uv.x), uv.y - std::floor(uv.y)};
+                checksum = checksum + Sample(texture, sampler, wrapped);
+                uv = uv + steps[line];
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        double samples = (double)NUM_LINES * SAMPLES_PER_LINE;
+        std::cout << layoutCase.name << ": " << samples / seconds / 1e6 << " Msamples/s"
+            << " (checksum " << checksum.x + checksum.y + checksum.z << ")" << std::endl;
+    }
+}
+
+// Fragment throughput of each render target layout, flat shaded right triangles of a fixed size
+// are scattered over the target, each one nearer than the previous so every fragment is written.
+void benchmark_target_layout()
+{
+    U32 const NUM_FRAGMENTS = 1 << 22;
+    U32 const legSizes[] = {4, 32, 256};
+
+    struct LayoutCase
+    {
+        char const* name;
+        TexelLayout layout;
+    };
+    LayoutCase const cases[] =
+    {
+        {"LINEAR", TexelLayout::LINEAR},
+        {"TILED_8X8_MORTON", TexelLayout::TILED_8X8_MORTON},
+    };
+
+    Shader vsShader = loadVS_Flat();
+    Shader psShader = loadPS_Flat();
+    ((Mat44f*)vsShader.getConstantAddr("mWorldViewProj"))->make_identity();
+    *(Vec3f*)psShader.getConstantAddr("cColor") = Vec3f{1.0f, 0.5f, 0.25f};
+
+    for (U32 legSize : legSizes)
+    {
+        U32 const numTriangles = NUM_FRAGMENTS / (legSize * legSize / 2);
+
+        std::mt19937 rng{1234};
+        std::uniform_real_distribution<float> unit{0.0f, 1.0f};
+        std::vector<Vec3f> vertices;
+        std::vector<U32> indices;
+        for (U32 triangle = 0; triangle < numTriangles; ++triangle)
+        {
+            // pixels to NDC, the triangle stays on the target.
+            float const x = unit(rng) * (WIDTH - legSize);
+            float const y = unit(rng) * (HEIGHT - legSize);
+            float const z = 0.9f - 1.8f * triangle / numTriangles;
+            auto toNDC = [&](float px, float py) { return Vec3f{px * 2.0f / WIDTH - 1.0f, py * 2.0f / HEIGHT - 1.0f, z}; };
+
+            indices.push_back(vertices.size());
+            indices.push_back(vertices.size() + 1);
+            indices.push_back(vertices.size() + 2);
+            vertices.push_back(toNDC(x, y));
+            vertices.push_back(toNDC(x + legSize, y));
+            vertices.push_back(toNDC(x, y + legSize));
+        }
+
+        for (LayoutCase const& layoutCase : cases)
+        {
+            Pipeline device{};
+            device.setTargetSize(WIDTH, HEIGHT);
+            device.setTargetLayout(layoutCase.layout);
+            device.clear(Vec3f{0.0f, 0.0f, 0.0f}, 0.0f);
+            device.setVSProgram(vsShader);
+            device.setPSProgram(psShader);
+            device.setVertexBufferChannel(Semantic::Position0, (U8*)vertices.data(), 0, sizeof(Vec3f));
+            device.setVertexBufferLength(vertices.size());
+            device.setIndexBuffer((U8*)indices.data(), 0, sizeof(U32), indices.size());
+
+            auto start = std::chrono::steady_clock::now();
+            device.drawIndexed();
+            auto end = std::chrono::steady_clock::now();
+
+            double seconds = std::chrono::duration<double>(end - start).count();
+            std::cout << layoutCase.name << ", " << legSize << " pixel legs: "
+                << (double)numTriangles * legSize * legSize / 2 / seconds / 1e6 << " Mfragments/s" << std::endl;
+        }
+    }
+}
+
+// renderer [forward|deferred|visibility], the demo scene is saved with the given path after the tests.
+// renderer benchmark_texture_layout|benchmark_target_layout only runs the benchmark.
+int main(int argc, char** argv)
+{
+    std::string const arg = argc > 1 ? argv[1] : "";
+    if (arg == "benchmark_texture_layout")
+    {
+        benchmark_texture_layout();
+        return 0;
+    }
+    if (arg == "benchmark_target_layout")
+    {
+        benchmark_target_layout();
+        return 0;
+    }
+
+    RenderPath path = RenderPath::FORWARD;
+    if (arg == "deferred")
+    {
+        path = RenderPath::DEFERRED;
+    }
+    else if (arg == "visibility")
+    {
+        path = RenderPath::VISIBILITY;
+    }
+
     // test_rasterizer();
 
-    test_fixed_pipeline();
+    test_address_modes();
+
+    test_srgb_tables();
+
+    test_block_compression();
+
+    test_target_formats();
+
+    test_blend();
+
+    test_multiple_render_targets();
+
+    test_shader_rebuild();
+
+    test_stencil_portal();
+
+    test_occlusion_query();
+
+    test_predicated_draw();
+
+    checkMatchesForward(RenderPath::DEFERRED, "deferred");
+
+    checkMatchesForward(RenderPath::VISIBILITY, "visibility buffer");
+
+    test_visibility_draw_limit();
+
+    test_fixed_pipeline(path);
+
+    return s_failures == 0 ? 0 : 1;
 }
 
 // TODO: move to driver layer or something?
@@ -1,19 +1,547 @@
+#include <cstring>
+#include <string>
 #include <iostream>
+#include <algorithm>
+#include "utils.h"
+#include "texel_layout.h"
 #include "output_merger.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace Device {
+    using Texture::TexelFormat;
+    using Texture::TexelLayout;
+    using Texture::packUnorm;
+
+    constexpr U32 OutputMerger::CLEAR_DEPTH;
+    constexpr U32 OutputMerger::CLEAR_ALL;
+
+    BlendState BlendState::opaque()
+    {
+        return BlendState{false,
+            BlendFactor::ONE, BlendFactor::ZERO, BlendOp::ADD,
+            BlendFactor::ONE, BlendFactor::ZERO, BlendOp::ADD,
+            COLOR_WRITE_ALL};
+    }
+
+    BlendState BlendState::alphaBlend()
+    {
+        return BlendState{true,
+            BlendFactor::SRC_ALPHA, BlendFactor::INV_SRC_ALPHA, BlendOp::ADD,
+            BlendFactor::ONE, BlendFactor::INV_SRC_ALPHA, BlendOp::ADD,
+            COLOR_WRITE_ALL};
+    }
+
+    StencilState StencilState::disabled()
+    {
+        return StencilState{false, CompareFunc::ALWAYS, StencilOp::KEEP, StencilOp::KEEP, StencilOp::KEEP, 0xff, 0xff, 0};
+    }
+
+    StencilState StencilState::replace(U8 ref)
+    {
+        return StencilState{true, CompareFunc::ALWAYS, StencilOp::KEEP, StencilOp::KEEP, StencilOp::REPLACE, 0xff, 0xff, ref};
+    }
+
+    StencilState StencilState::equal(U8 ref)
+    {
+        return StencilState{true, CompareFunc::EQUAL, StencilOp::KEEP, StencilOp::KEEP, StencilOp::KEEP, 0xff, 0x00, ref};
+    }
+
+    bool StencilState::isReadOnly() const
+    {
+        return writeMask == 0 || (failOp == StencilOp::KEEP && depthFailOp == StencilOp::KEEP && passOp == StencilOp::KEEP);
+    }
+
+    static FORCE_INLINE bool testStencilValue(StencilState const& state, U8 value)
+    {
+        U32 const ref = state.ref & state.readMask;
+        U32 const masked = value & state.readMask;
+        switch (state.func)
+        {
+            case CompareFunc::NEVER:         return false;
+            case CompareFunc::LESS:          return ref < masked;
+            case CompareFunc::EQUAL:         return ref == masked;
+            case CompareFunc::LESS_EQUAL:    return ref <= masked;
+            case CompareFunc::GREATER:       return ref > masked;
+            case CompareFunc::NOT_EQUAL:     return ref != masked;
+            case CompareFunc::GREATER_EQUAL: return ref >= masked;
+            case CompareFunc::ALWAYS:        return true;
+            default:                         assert(0); return true;
+        }
+    }
+
+    static FORCE_INLINE U8 applyStencilOp(StencilState const& state, StencilOp op, U8 value)
+    {
+        U8 result = value;
+        switch (op)
+        {
+            case StencilOp::KEEP:     return value;
+            case StencilOp::ZERO:     result = 0; break;
+            case StencilOp::REPLACE:  result = state.ref; break;
+            case StencilOp::INCR_SAT: result = value == 0xff ? value : value + 1; break;
+            case StencilOp::DECR_SAT: result = value == 0 ? value : value - 1; break;
+            case StencilOp::INVERT:   result = ~value; break;
+            case StencilOp::INCR:     result = value + 1; break;
+            case StencilOp::DECR:     result = value - 1; break;
+            default:                  assert(0);
+        }
+        return (value & ~state.writeMask) | (result & state.writeMask);
+    }
+
+    // Conversion between linear RGBA and a target texel, targets without alpha read an alpha of 1.
+    template <TexelFormat format>
+    struct ColorTarget;
+
+    template <>
+    struct ColorTarget<TexelFormat::R32G32B32_FLOAT>
+    {
+        static constexpr U32 Size = 12;
+        static FORCE_INLINE Vec4f load(U8 const* texel)
+        {
+            Vec3f const& color = *reinterpret_cast<Vec3f const*>(texel);
+            return Vec4f{color.x, color.y, color.z, 1.0f};
+        }
+        static FORCE_INLINE void store(U8* texel, Vec4f const& color)
+        {
+            *reinterpret_cast<Vec3f*>(texel) = Vec3f{color.x, color.y, color.z};
+        }
+    };
+
+    template <>
+    struct ColorTarget<TexelFormat::R8G8B8A8_UNORM>
+    {
+        static constexpr U32 Size = 4;
+        static FORCE_INLINE Vec4f load(U8 const* texel)
+        {
+            return Vec4f{texel[0] / 255.0f, texel[1] / 255.0f, texel[2] / 255.0f, texel[3] / 255.0f};
+        }
+        static FORCE_INLINE void store(U8* texel, Vec4f const& color)
+        {
+            *reinterpret_cast<U32*>(texel) = packUnorm(color.x, 255) | (packUnorm(color.y, 255) << 8) | (packUnorm(color.z, 255) << 16) | (packUnorm(color.w, 255) << 24);
+        }
+    };
+
+    template <>
+    struct ColorTarget<TexelFormat::R8G8B8A8_SRGB>
+    {
+        static constexpr U32 Size = 4;
+        static FORCE_INLINE Vec4f load(U8 const* texel)
+        {
+            return Vec4f{Texture::srgbToLinear(texel[0]), Texture::srgbToLinear(texel[1]), Texture::srgbToLinear(texel[2]), texel[3] / 255.0f};
+        }
+        static FORCE_INLINE void store(U8* texel, Vec4f const& color)
+        {
+            *reinterpret_cast<U32*>(texel) = Texture::linearToSrgb(color.x) | (Texture::linearToSrgb(color.y) << 8) | (Texture::linearToSrgb(color.z) << 16) | (packUnorm(color.w, 255) << 24);
+        }
+    };
+
+    template <>
+    struct ColorTarget<TexelFormat::R10G10B10A2_UNORM>
+    {
+        static constexpr U32 Size = 4;
+        static FORCE_INLINE Vec4f load(U8 const* texel)
+        {
+            U32 const bits = *reinterpret_cast<U32 const*>(texel);
+            return Vec4f{(bits & 0x3ff) / 1023.0f, ((bits >> 10) & 0x3ff) / 1023.0f, ((bits >> 20) & 0x3ff) / 1023.0f, (bits >> 30) / 3.0f};
+        }
+        static FORCE_INLINE void store(U8* texel, Vec4f const& color)
+        {
+            *reinterpret_cast<U32*>(texel) = packUnorm(color.x, 1023) | (packUnorm(color.y, 1023) << 10) | (packUnorm(color.z, 1023) << 20) | (packUnorm(color.w, 3) << 30);
+        }
+    };
+
+    template <>
+    struct ColorTarget<TexelFormat::R32_UINT>
+    {
+        static constexpr U32 Size = 4;
+        static FORCE_INLINE Vec4f load(U8 const* texel)
+        {
+            return Vec4f{*reinterpret_cast<U32 const*>(texel) / 255.0f, 0.0f, 0.0f, 1.0f};
+        }
+        static FORCE_INLINE void store(U8* texel, Vec4f const& color)
+        {
+            *reinterpret_cast<U32*>(texel) = (U32)std::max(color.x * 255.0f + 0.5f, 0.0f);
+        }
+    };
+
+    // Lane n of a channel mask is all ones if bit n of the index is set, channel order is RGBA.
+    alignas(16) static U32 const s_channelMasks[16][4] =
+    {
+        {0u, 0u, 0u, 0u}, {~0u, 0u, 0u, 0u}, {0u, ~0u, 0u, 0u}, {~0u, ~0u, 0u, 0u},
+        {0u, 0u, ~0u, 0u}, {~0u, 0u, ~0u, 0u}, {0u, ~0u, ~0u, 0u}, {~0u, ~0u, ~0u, 0u},
+        {0u, 0u, 0u, ~0u}, {~0u, 0u, 0u, ~0u}, {0u, ~0u, 0u, ~0u}, {~0u, ~0u, 0u, ~0u},
+        {0u, 0u, ~0u, ~0u}, {~0u, 0u, ~0u, ~0u}, {0u, ~0u, ~0u, ~0u}, {~0u, ~0u, ~0u, ~0u},
+    };
+
+    BlendEquation BlendEquation::resolve(BlendState const& state)
+    {
+        BlendEquation equation{};
+        for (U32 channel = 0; channel < 4; ++channel)
+        {
+            bool const isAlpha = channel == 3;
+            BlendOp const op = !state.enable ? BlendOp::ADD : isAlpha ? state.alphaOp : state.colorOp;
+            BlendFactor const srcFactor = !state.enable ? BlendFactor::ONE : isAlpha ? state.srcAlpha : state.srcColor;
+            BlendFactor const dstFactor = !state.enable ? BlendFactor::ZERO : isAlpha ? state.dstAlpha : state.dstColor;
+
+            // the alpha of a *_COLOR factor is the alpha of the color.
+            Term const src = isAlpha ? TERM_SRC_ALPHA : TERM_SRC;
+            Term const dst = isAlpha ? TERM_DST_ALPHA : TERM_DST;
+            float const srcSign = op == BlendOp::REV_SUBTRACT ? -1.0f : 1.0f;
+            float const dstSign = op == BlendOp::SUBTRACT ? -1.0f : 1.0f;
+            float (*factors[2])[4] = {equation.srcFactor, equation.dstFactor};
+            BlendFactor const kinds[2] = {srcFactor, dstFactor};
+            float const signs[2] = {srcSign, dstSign};
+            for (U32 side = 0; side < 2; ++side)
+            {
+                float (*terms)[4] = factors[side];
+                float const sign = signs[side];
+                switch (kinds[side])
+                {
+                    case BlendFactor::ZERO:          break;
+                    case BlendFactor::ONE:           terms[TERM_ONE][channel] = sign; break;
+                    case BlendFactor::SRC_COLOR:     terms[src][channel] = sign; break;
+                    case BlendFactor::INV_SRC_COLOR: terms[TERM_ONE][channel] = sign; terms[src][channel] = -sign; break;
+                    case BlendFactor::SRC_ALPHA:     terms[TERM_SRC_ALPHA][channel] = sign; break;
+                    case BlendFactor::INV_SRC_ALPHA: terms[TERM_ONE][channel] = sign; terms[TERM_SRC_ALPHA][channel] = -sign; break;
+                    case BlendFactor::DST_COLOR:     terms[dst][channel] = sign; break;
+                    case BlendFactor::INV_DST_COLOR: terms[TERM_ONE][channel] = sign; terms[dst][channel] = -sign; break;
+                    case BlendFactor::DST_ALPHA:     terms[TERM_DST_ALPHA][channel] = sign; break;
+                    case BlendFactor::INV_DST_ALPHA: terms[TERM_ONE][channel] = sign; terms[TERM_DST_ALPHA][channel] = -sign; break;
+                    default:                         assert(0);
+                }
+            }
+
+            equation.minMask[channel] = op == BlendOp::MIN ? ~0u : 0u;
+            equation.maxMask[channel] = op == BlendOp::MAX ? ~0u : 0u;
+            equation.writeMask[channel] = s_channelMasks[state.writeMask][channel];
+        }
+        return equation;
+    }
+
+#if defined(__SSE2__)
+    static FORCE_INLINE __m128 selectSSE(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    static FORCE_INLINE __m128 loadMaskSSE(U32 const* mask)
+    {
+        return _mm_load_ps(reinterpret_cast<float const*>(mask));
+    }
+
+    // A BlendEquation in registers, loaded once per quad.
+    struct BlendSSE
+    {
+        __m128 srcFactor[BlendEquation::TERM_COUNT];
+        __m128 dstFactor[BlendEquation::TERM_COUNT];
+        __m128 minMask;
+        __m128 maxMask;
+        __m128 writeMask;
+
+        explicit FORCE_INLINE BlendSSE(BlendEquation const& equation)
+        {
+            for (U32 term = 0; term < BlendEquation::TERM_COUNT; ++term)
+            {
+                srcFactor[term] = _mm_load_ps(equation.srcFactor[term]);
+                dstFactor[term] = _mm_load_ps(equation.dstFactor[term]);
+            }
+            minMask = loadMaskSSE(equation.minMask);
+            maxMask = loadMaskSSE(equation.maxMask);
+            writeMask = loadMaskSSE(equation.writeMask);
+        }
+
+        static FORCE_INLINE __m128 factor(__m128 const* terms, __m128 src, __m128 srcAlpha, __m128 dst, __m128 dstAlpha)
+        {
+            __m128 result = terms[BlendEquation::TERM_ONE];
+            result = _mm_add_ps(result, _mm_mul_ps(terms[BlendEquation::TERM_SRC], src));
+            result = _mm_add_ps(result, _mm_mul_ps(terms[BlendEquation::TERM_SRC_ALPHA], srcAlpha));
+            result = _mm_add_ps(result, _mm_mul_ps(terms[BlendEquation::TERM_DST], dst));
+            return _mm_add_ps(result, _mm_mul_ps(terms[BlendEquation::TERM_DST_ALPHA], dstAlpha));
+        }
+
+        // All four channels of a pixel are blended at once, channels outside of the write mask keep dst.
+        FORCE_INLINE Vec4f blend(Vec4f const& srcColor, Vec4f const& dstColor) const
+        {
+            __m128 const src = _mm_loadu_ps(&srcColor.x);
+            __m128 const dst = _mm_loadu_ps(&dstColor.x);
+            __m128 const srcAlpha = _mm_shuffle_ps(src, src, _MM_SHUFFLE(3, 3, 3, 3));
+            __m128 const dstAlpha = _mm_shuffle_ps(dst, dst, _MM_SHUFFLE(3, 3, 3, 3));
+
+            __m128 blended = _mm_add_ps(
+                _mm_mul_ps(src, factor(srcFactor, src, srcAlpha, dst, dstAlpha)),
+                _mm_mul_ps(dst, factor(dstFactor, src, srcAlpha, dst, dstAlpha)));
+            blended = selectSSE(minMask, _mm_min_ps(src, dst), blended);
+            blended = selectSSE(maxMask, _mm_max_ps(src, dst), blended);
+
+            Vec4f result;
+            _mm_storeu_ps(&result.x, selectSSE(writeMask, blended, dst));
+            return result;
+        }
+    };
+
+    typedef BlendSSE BlendBatch;
+#else
+    // Scalar fallback of BlendSSE.
+    struct BlendScalar
+    {
+        BlendEquation const& equation;
+
+        explicit BlendScalar(BlendEquation const& resolved)
+            : equation(resolved)
+        {
+        }
+
+        static float factor(float const (*terms)[4], U32 channel, float const* src, float const* dst)
+        {
+            return terms[BlendEquation::TERM_ONE][channel]
+                + terms[BlendEquation::TERM_SRC][channel] * src[channel]
+                + terms[BlendEquation::TERM_SRC_ALPHA][channel] * src[3]
+                + terms[BlendEquation::TERM_DST][channel] * dst[channel]
+                + terms[BlendEquation::TERM_DST_ALPHA][channel] * dst[3];
+        }
+
+        Vec4f blend(Vec4f const& srcColor, Vec4f const& dstColor) const
+        {
+            float const* src = &srcColor.x;
+            float const* dst = &dstColor.x;
+
+            Vec4f result;
+            float* out = &result.x;
+            for (U32 channel = 0; channel < 4; ++channel)
+            {
+                if (equation.writeMask[channel] == 0)
+                {
+                    out[channel] = dst[channel];
+                }
+                else if (equation.minMask[channel] != 0)
+                {
+                    out[channel] = std::min(src[channel], dst[channel]);
+                }
+                else if (equation.maxMask[channel] != 0)
+                {
+                    out[channel] = std::max(src[channel], dst[channel]);
+                }
+                else
+                {
+                    out[channel] = src[channel] * factor(equation.srcFactor, channel, src, dst)
+                        + dst[channel] * factor(equation.dstFactor, channel, src, dst);
+                }
+            }
+            return result;
+        }
+    };
+
+    typedef BlendScalar BlendBatch;
+#endif
+
+    // Depth is quantized once per pixel, the test compares values in the target precision.
+    template <TexelFormat format>
+    struct DepthTarget;
+
+    template <>
+    struct DepthTarget<TexelFormat::D32_FLOAT>
+    {
+        typedef float Value;
+        static constexpr U32 Size = 4;
+        static FORCE_INLINE Value quantize(float depth) { return depth; }
+        static FORCE_INLINE Value load(U8 const* texel) { return *reinterpret_cast<float const*>(texel); }
+        static FORCE_INLINE void store(U8* texel, Value depth) { *reinterpret_cast<float*>(texel) = depth; }
+    };
+
+    template <>
+    struct DepthTarget<TexelFormat::D24_UNORM_S8_UINT>
+    {
+        typedef U32 Value;
+        static constexpr U32 Size = 4;
+        static FORCE_INLINE Value quantize(float depth) { return packUnorm(depth, 0xffffff); }
+        static FORCE_INLINE Value load(U8 const* texel) { return *reinterpret_cast<U32 const*>(texel) & 0xffffff; }
+
+        // stencil bits are kept.
+        static FORCE_INLINE void store(U8* texel, Value depth)
+        {
+            U32& bits = *reinterpret_cast<U32*>(texel);
+            bits = (bits & 0xff000000u) | depth;
+        }
+    };
+
+    template <>
+    struct DepthTarget<TexelFormat::D16_UNORM>
+    {
+        typedef U16 Value;
+        static constexpr U32 Size = 2;
+        static FORCE_INLINE Value quantize(float depth) { return (U16)packUnorm(depth, 0xffff); }
+        static FORCE_INLINE Value load(U8 const* texel) { return *reinterpret_cast<U16 const*>(texel); }
+        static FORCE_INLINE void store(U8* texel, Value depth) { *reinterpret_cast<U16*>(texel) = depth; }
+    };
+
+    // Blend and write of the passing lanes of a quad, the target is only read back to blend or to keep masked channels.
+    template <TexelFormat format, bool readColor>
+    static void writeColor(U8* const* texels, Vec4f const* colors, U32 count, BlendEquation const& equation)
+    {
+        typedef ColorTarget<format> Color;
+        if (!readColor)
+        {
+            for (U32 lane = 0; lane < count; ++lane)
+            {
+                Color::store(texels[lane], colors[lane]);
+            }
+            return;
+        }
+
+        BlendBatch const blend{equation};
+        for (U32 lane = 0; lane < count; ++lane)
+        {
+            Color::store(texels[lane], blend.blend(colors[lane], Color::load(texels[lane])));
+        }
+    }
+
+    template <bool readColor>
+    static ColorWriteFunc selectColorWrite(TexelFormat format)
+    {
+        switch (format)
+        {
+            case TexelFormat::R32G32B32_FLOAT:   return &writeColor<TexelFormat::R32G32B32_FLOAT, readColor>;
+            case TexelFormat::R8G8B8A8_UNORM:    return &writeColor<TexelFormat::R8G8B8A8_UNORM, readColor>;
+            case TexelFormat::R8G8B8A8_SRGB:     return &writeColor<TexelFormat::R8G8B8A8_SRGB, readColor>;
+            case TexelFormat::R10G10B10A2_UNORM: return &writeColor<TexelFormat::R10G10B10A2_UNORM, readColor>;
+            case TexelFormat::R32_UINT:          return &writeColor<TexelFormat::R32_UINT, readColor>;
+            default:                             return nullptr;
+        }
+    }
+
     OutputMerger::OutputMerger()
         : m_width(0)
         , m_height(0)
-        , m_colorStorage{}
+        , m_layout(TexelLayout::TILED_8X8_MORTON)
+        , m_colorTargets{}
         , m_depthStorage{}
-        , m_colorTarget{Texture::TexelFormat::R32G32B32_FLOAT, m_width, m_height, nullptr}
-        , m_depthTarget{Texture::TexelFormat::D32_FLOAT, m_width, m_height, nullptr}
+        , m_depthTarget{TexelFormat::D32_FLOAT, m_width, m_height, nullptr}
+        , m_stencil{StencilState::disabled()}
+        , m_depthWrite{true}
+        , m_samplesPassed{0}
+        , m_tilesWide(0)
+        , m_clearPending{}
+        , m_clearColor{0.0f, 0.0f, 0.0f}
+        , m_clearDepth{0.0f}
+        , m_clearStencil{0}
+        , m_clearDepthTexel{}
+        , m_clearDepthValue{0.0f}
+        , m_inPosition(nullptr)
+        , m_inCoverage(nullptr)
+        , m_inLaneStride(0)
+        , m_numActiveTargets(0)
+        , m_activeTargets{}
+        , m_activeInputs{}
+        , m_mergeClearMask{CLEAR_DEPTH}
+        , m_mergeQuadFunc(nullptr)
+    {
+        for (ColorTargetSlot& slot : m_colorTargets)
+        {
+            slot.texelSize = 0;
+            slot.blend = BlendState::opaque();
+            slot.write = nullptr;
+            slot.input = nullptr;
+            slot.inputHasAlpha = false;
+            slot.inputIsId = false;
+        }
+        m_colorTargets[0].target = Texture::Texture2D{TexelFormat::R32G32B32_FLOAT, m_width, m_height, nullptr};
+        m_colorTargets[0].texelSize = Texture::getTexelSize(TexelFormat::R32G32B32_FLOAT);
+
+        addInputPorts(nullptr);
+        selectMergeFunc();
+    }
+
+    void OutputMerger::addInputPorts(Comp const* prevComp)
     {
         addIOPort(Input, std::string("position"), Type::FLOAT3, Semantic::SV_Position);
-        addIOPort(Input, std::string("color"), Type::FLOAT3, Semantic::SV_Target);
-        m_inPosition = getValuePtr(Input, "position");
-        m_inColor = getValuePtr(Input, "color");
+        addIOPort(Input, std::string("coverage"), Type::UINT, Semantic::SV_Coverage);
+
+        bool hasInput[MAX_COLOR_TARGETS] = {};
+        for (U32 index = 0; index < MAX_COLOR_TARGETS; ++index)
+        {
+            m_colorTargets[index].inputHasAlpha = false;
+            m_colorTargets[index].inputIsId = false;
+        }
+
+        if (prevComp == nullptr)
+        {
+            addIOPort(Input, std::string("color0"), Type::FLOAT3, Semantic::SV_Target0);
+            hasInput[0] = true;
+        }
+        else
+        {
+            // ports are added in target order, the port layout only depends on prevComp.
+            for (U32 index = 0; index < MAX_COLOR_TARGETS; ++index)
+            {
+                Semantic const semantic = Semantic::svTarget(index);
+                for (U32 port = 0; port < prevComp->getNumPorts(Output); ++port)
+                {
+                    if (prevComp->getSemantic(Output, port) != semantic)
+                    {
+                        continue;
+                    }
+
+                    Type const colorType = prevComp->getType(Output, port);
+                    assert(colorType == Type::FLOAT3 || colorType == Type::FLOAT4 || colorType == Type::UINT);
+
+                    addIOPort(Input, std::string("color") + std::to_string(index), colorType, semantic);
+                    hasInput[index] = true;
+                    m_colorTargets[index].inputHasAlpha = colorType == Type::FLOAT4;
+                    m_colorTargets[index].inputIsId = colorType == Type::UINT;
+                    break;
+                }
+            }
+        }
+
+        // adding ports may move the values, take the pointers last.
+        m_inPosition = getValuePtr(Input, Semantic::SV_Position);
+        m_inCoverage = getValuePtr(Input, Semantic::SV_Coverage);
+        for (U32 index = 0; index < MAX_COLOR_TARGETS; ++index)
+        {
+            m_colorTargets[index].input = hasInput[index] ? getValuePtr(Input, Semantic::svTarget(index)) : nullptr;
+        }
+    }
+
+    void OutputMerger::adjustInputPorts(Comp const& prevComp)
+    {
+        resetPorts(Comp::Input);
+        addInputPorts(&prevComp);
+        selectMergeFunc();
+    }
+
+    void OutputMerger::setBlendState(U32 index, BlendState const& state)
+    {
+        assert(index < MAX_COLOR_TARGETS);
+        m_colorTargets[index].blend = state;
+        selectMergeFunc();
+    }
+
+    void OutputMerger::setStencilState(StencilState const& state)
+    {
+        m_stencil = state;
+        selectMergeFunc();
+    }
+
+    StencilState const& OutputMerger::getStencilState() const
+    {
+        return m_stencil;
+    }
+
+    bool OutputMerger::isStencilActive() const
+    {
+        return m_stencil.enable && m_depthTarget.getFormat() == TexelFormat::D24_UNORM_S8_UINT;
+    }
+
+    void OutputMerger::setDepthWrite(bool enable)
+    {
+        m_depthWrite = enable;
+    }
+
+    U32 OutputMerger::getSamplesPassed() const
+    {
+        return m_samplesPassed;
     }
 
     void OutputMerger::resize(U32 width, U32 height)
@@ -26,14 +554,210 @@ namespace Device {
         m_width = width;
         m_height = height;
 
-        m_colorStorage.resize(width * height);
-        m_depthStorage.resize(width * height);
+        allocateTargets();
+    }
+
+    void OutputMerger::setColorFormat(U32 index, TexelFormat format)
+    {
+        assert(index < MAX_COLOR_TARGETS);
+        ColorTargetSlot& slot = m_colorTargets[index];
+        if (slot.target.getFormat() == format)
+        {
+            return;
+        }
+
+        slot.target.setFormat(format);
+        slot.texelSize = format == TexelFormat::UNKNOWN ? 0 : Texture::getTexelSize(format);
+        allocateTargets();
+        selectMergeFunc();
+    }
+
+    void OutputMerger::setDepthFormat(TexelFormat format)
+    {
+        if (m_depthTarget.getFormat() == format)
+        {
+            return;
+        }
+
+        m_depthTarget.setFormat(format);
+        allocateTargets();
+        selectMergeFunc();
+    }
+
+    void OutputMerger::setLayout(TexelLayout layout)
+    {
+        assert(layout == TexelLayout::LINEAR || layout == TexelLayout::TILED_8X8_MORTON);
+        if (m_layout == layout)
+        {
+            return;
+        }
+
+        m_layout = layout;
+        allocateTargets();
+        selectMergeFunc();
+    }
+
+    void OutputMerger::allocateTargets()
+    {
+        U32 const numTexels = Texture::getLevelNumTexels(m_layout, m_width, m_height);
+        for (ColorTargetSlot& slot : m_colorTargets)
+        {
+            // unbound targets release their storage.
+            slot.storage.resize(numTexels * slot.texelSize);
+            slot.storage.shrink_to_fit();
+            slot.target.setSize(m_width, m_height);
+            slot.target.setStorage(slot.storage.data(), m_layout);
+        }
+
+        m_depthStorage.resize(numTexels * Texture::getTexelSize(m_depthTarget.getFormat()));
+        m_depthTarget.setSize(m_width, m_height);
+        m_depthTarget.setStorage(m_depthStorage.data(), m_layout);
+
+        m_tilesWide = (m_width + CLEAR_TILE_DIM - 1) / CLEAR_TILE_DIM;
+        m_clearPending.resize(m_tilesWide * ((m_height + CLEAR_TILE_DIM - 1) / CLEAR_TILE_DIM));
+        clear(m_clearColor, m_clearDepth, m_clearStencil);
+    }
+
+    void OutputMerger::clear(Vec3f const& color, float depth, U8 stencil)
+    {
+        m_clearColor = color;
+        m_clearDepth = depth;
+        m_clearStencil = stencil;
+
+        for (ColorTargetSlot& slot : m_colorTargets)
+        {
+            std::memset(slot.clearTexel, 0, MAX_TEXEL_SIZE);
+            if (slot.target.getFormat() != TexelFormat::UNKNOWN)
+            {
+                Texture::encodeTexel(slot.target.getFormat(), Vec4f{color.x, color.y, color.z, 1.0f}, slot.clearTexel);
+            }
+        }
+
+        std::memset(m_clearDepthTexel, 0, MAX_TEXEL_SIZE);
+        if (m_depthTarget.getFormat() == TexelFormat::D24_UNORM_S8_UINT)
+        {
+            // encoding keeps the stencil bits.
+            *reinterpret_cast<U32*>(m_clearDepthTexel) = (U32)stencil << 24;
+        }
+        Texture::encodeTexel(m_depthTarget.getFormat(), Vec4f{depth, depth, depth, depth}, m_clearDepthTexel);
+        m_clearDepthValue = Texture::decodeTexel(m_depthTarget.getFormat(), m_clearDepthTexel).x;
+
+        std::fill(m_clearPending.begin(), m_clearPending.end(), CLEAR_ALL);
+    }
+
+    static void fillRow(U8* dst, U8 const* texel, U32 texelSize, U32 count)
+    {
+        for (U32 index = 0; index < count; ++index)
+        {
+            std::memcpy(dst + index * texelSize, texel, texelSize);
+        }
+    }
+
+    void OutputMerger::fillTile(U32 tile, U32 mask)
+    {
+        U32 const pending = m_clearPending[tile] & mask;
+
+        U32 const x0 = (tile % m_tilesWide) * CLEAR_TILE_DIM;
+        U32 const y0 = (tile / m_tilesWide) * CLEAR_TILE_DIM;
+        U32 const x1 = std::min(x0 + CLEAR_TILE_DIM, m_width);
+        U32 const y1 = std::min(y0 + CLEAR_TILE_DIM, m_height);
+
+        // fill count texels from index in every pending target, unbound targets have a texel size of 0.
+        U32 const depthSize = (pending & CLEAR_DEPTH) != 0 ? Texture::getTexelSize(m_depthTarget.getFormat()) : 0;
+        auto fillTargets = [&](U32 index, U32 count)
+        {
+            for (U32 target = 0; target < MAX_COLOR_TARGETS; ++target)
+            {
+                ColorTargetSlot& slot = m_colorTargets[target];
+                if ((pending & (1u << target)) != 0)
+                {
+                    fillRow(slot.storage.data() + index * slot.texelSize, slot.clearTexel, slot.texelSize, count);
+                }
+            }
+            fillRow(m_depthStorage.data() + index * depthSize, m_clearDepthTexel, depthSize, count);
+        };
+
+        if (m_layout == TexelLayout::LINEAR)
+        {
+            for (U32 y = y0; y < y1; ++y)
+            {
+                fillTargets(x0 + y * m_width, x1 - x0);
+            }
+        }
+        else
+        {
+            // 8x8 tiles are contiguous, the padding of edge tiles is filled as well.
+            Texture::TexelIndexer<TexelLayout::TILED_8X8_MORTON> const indexer{m_width, m_height};
+            for (U32 y = y0; y < y1; y += 8)
+            {
+                for (U32 x = x0; x < x1; x += 8)
+                {
+                    fillTargets(indexer.index(x, y), 64);
+                }
+            }
+        }
+
+        m_clearPending[tile] &= ~pending;
+    }
+
+    template <TexelLayout layout>
+    OutputMerger::MergeQuadFunc OutputMerger::selectMergeQuad(TexelFormat depthFormat, bool stencil)
+    {
+        if (stencil)
+        {
+            return depthFormat == TexelFormat::D24_UNORM_S8_UINT ? &OutputMerger::mergeQuad<layout, TexelFormat::D24_UNORM_S8_UINT, true> : nullptr;
+        }
+
+        switch (depthFormat)
+        {
+            case TexelFormat::D32_FLOAT:         return &OutputMerger::mergeQuad<layout, TexelFormat::D32_FLOAT, false>;
+            case TexelFormat::D24_UNORM_S8_UINT: return &OutputMerger::mergeQuad<layout, TexelFormat::D24_UNORM_S8_UINT, false>;
+            case TexelFormat::D16_UNORM:         return &OutputMerger::mergeQuad<layout, TexelFormat::D16_UNORM, false>;
+            default:                             return nullptr;
+        }
+    }
+
+    void OutputMerger::selectMergeFunc()
+    {
+        // a target is written if it is bound and the pixel shader writes it.
+        m_numActiveTargets = 0;
+        m_mergeClearMask = CLEAR_DEPTH;
+        for (U32 index = 0; index < MAX_COLOR_TARGETS; ++index)
+        {
+            ColorTargetSlot& slot = m_colorTargets[index];
+            TexelFormat const format = slot.target.getFormat();
+            if (format == TexelFormat::UNKNOWN)
+            {
+                slot.write = nullptr;
+                continue;
+            }
+
+            slot.equation = BlendEquation::resolve(slot.blend);
+            bool const readColor = slot.blend.enable || slot.blend.writeMask != COLOR_WRITE_ALL;
+            slot.write = readColor ? selectColorWrite<true>(format) : selectColorWrite<false>(format);
+
+            // not a supported color target format.
+            assert(slot.write != nullptr);
+
+            // ids are stored unchanged, they are never blended.
+            assert(!slot.inputIsId || (format == TexelFormat::R32_UINT && !readColor));
+
+            // a target with all channels masked is not written.
+            if (slot.input != nullptr && slot.blend.writeMask != 0)
+            {
+                m_activeTargets[m_numActiveTargets++] = index;
+                m_mergeClearMask |= 1u << index;
+            }
+        }
 
-        m_colorTarget.setSize(width, height);
-        m_depthTarget.setSize(width, height);
+        TexelFormat const depthFormat = m_depthTarget.getFormat();
+        bool const stencil = isStencilActive();
+        m_mergeQuadFunc = m_layout == TexelLayout::LINEAR ?
+            selectMergeQuad<TexelLayout::LINEAR>(depthFormat, stencil) :
+            selectMergeQuad<TexelLayout::TILED_8X8_MORTON>(depthFormat, stencil);
 
-        m_colorTarget.setStorage((U8*)m_colorStorage.data());
-        m_depthTarget.setStorage((U8*)m_depthStorage.data());
+        // not a supported depth target format.
+        assert(m_mergeQuadFunc != nullptr);
     }
 
     void OutputMerger::setWidth(U32 width)
@@ -56,6 +780,22 @@ namespace Device {
         return m_height;
     }
 
+    TexelFormat OutputMerger::getColorFormat(U32 index) const
+    {
+        assert(index < MAX_COLOR_TARGETS);
+        return m_colorTargets[index].target.getFormat();
+    }
+
+    TexelFormat OutputMerger::getDepthFormat() const
+    {
+        return m_depthTarget.getFormat();
+    }
+
+    void OutputMerger::setLaneStride(U32 inLaneStride)
+    {
+        m_inLaneStride = inLaneStride;
+    }
+
     bool OutputMerger::isOneInOneOut() const
     {
         return false;
@@ -69,28 +809,115 @@ namespace Device {
 
     void OutputMerger::comsumeOneInput()
     {
-        // TODO: early Z
-        Vec4f pos = m_inPosition->readAs<Vec4f>();
+        U32 const coverage = m_inCoverage->readAs<U32>();
+        U8 const* pPosition = m_inPosition->read();
+        for (U32 active = 0; active < m_numActiveTargets; ++active)
+        {
+            m_activeInputs[active] = m_colorTargets[m_activeTargets[active]].input->read();
+        }
 
-        int screen_x = std::nearbyint(pos.x * m_width);
-        int screen_y = std::nearbyint(pos.y * m_height);
+        (this->*m_mergeQuadFunc)(coverage, pPosition);
+    }
+
+    template <TexelLayout layout, TexelFormat depthFormat, bool stencil>
+    void OutputMerger::mergeQuad(U32 coverage, U8 const* pPosition)
+    {
+        typedef DepthTarget<depthFormat> Depth;
+        Texture::TexelIndexer<layout> const indexer{m_width, m_height};
 
-        // screen_x, screen_y is around a odd number, save to divide by 2.
-        screen_x = (screen_x + m_width) / 2;
-        screen_y = (screen_y + m_height) / 2;
+        // lanes passing the depth and stencil tests, in lane order.
+        U32 passLanes[QUAD_LANES];
+        U32 passIndices[QUAD_LANES];
+        U32 passCount = 0;
 
-        // map [-1, 1] to [1, 0]
-        float depth = -(pos.z - 1.0f) / 2.0f;
-        bool zTestResult = depth > m_depthTarget.getTexel<float>(screen_x, screen_y);
-        if (zTestResult)
+        // helper lanes are not shaded, skip them.
+        for (U32 lane = 0; lane < QUAD_LANES; ++lane)
         {
-            m_depthTarget.setTexel(screen_x, screen_y, depth);
+            if (!isLaneCovered(coverage, lane))
+            {
+                continue;
+            }
+
+            // TODO: early Z
+            U32 const laneOffset = lane * m_inLaneStride;
+            Vec3f const& pos = *reinterpret_cast<Vec3f const*>(pPosition + laneOffset);
+
+            int screen_x = std::nearbyint(pos.x * m_width);
+            int screen_y = std::nearbyint(pos.y * m_height);
+
+            // screen_x, screen_y is around a odd number, save to divide by 2.
+            screen_x = (screen_x + m_width) / 2;
+            screen_y = (screen_y + m_height) / 2;
+
+            resolveClear(screen_x, screen_y, m_mergeClearMask);
+
+            U32 const index = indexer.index(screen_x, screen_y);
+
+            // map [-1, 1] to [1, 0]
+            typename Depth::Value const depth = Depth::quantize(-(pos.z - 1.0f) / 2.0f);
+            U8* pDepth = m_depthStorage.data() + index * Depth::Size;
+            bool const depthPass = depth > Depth::load(pDepth);
+            if (stencil)
+            {
+                // the stencil is updated whether the tests pass or not.
+                U32& bits = *reinterpret_cast<U32*>(pDepth);
+                U8 const value = bits >> 24;
+                bool const stencilPass = testStencilValue(m_stencil, value);
+                StencilOp const op = !stencilPass ? m_stencil.failOp : !depthPass ? m_stencil.depthFailOp : m_stencil.passOp;
+                bits = (bits & 0xffffffu) | ((U32)applyStencilOp(m_stencil, op, value) << 24);
+
+                if (!stencilPass)
+                {
+                    continue;
+                }
+            }
+
+            if (!depthPass)
+            {
+                continue;
+            }
+
+            if (m_depthWrite)
+            {
+                Depth::store(pDepth, depth);
+            }
+
+            passLanes[passCount] = lane;
+            passIndices[passCount] = index;
+            ++passCount;
+        }
+
+        if (passCount == 0)
+        {
+            return;
         }
+        m_samplesPassed += passCount;
 
-        if (zTestResult)
+        // one depth test for all targets, the passing lanes are written to a target in one batch.
+        for (U32 active = 0; active < m_numActiveTargets; ++active)
         {
-            Vec3f color = m_inColor->readAs<Vec3f>();
-            m_colorTarget.setTexel(screen_x, screen_y, color);
+            ColorTargetSlot& slot = m_colorTargets[m_activeTargets[active]];
+            U8 const* pInput = m_activeInputs[active];
+            U8* texels[QUAD_LANES];
+            Vec4f colors[QUAD_LANES];
+            for (U32 pass = 0; pass < passCount; ++pass)
+            {
+                U8 const* pLaneColor = pInput + passLanes[pass] * m_inLaneStride;
+                texels[pass] = slot.storage.data() + passIndices[pass] * slot.texelSize;
+                if (slot.inputIsId)
+                {
+                    *reinterpret_cast<U32*>(texels[pass]) = *reinterpret_cast<U32 const*>(pLaneColor);
+                    continue;
+                }
+
+                Vec3f const& rgb = *reinterpret_cast<Vec3f const*>(pLaneColor);
+                colors[pass] = slot.inputHasAlpha ? *reinterpret_cast<Vec4f const*>(pLaneColor) : Vec4f{rgb.x, rgb.y, rgb.z, 1.0f};
+            }
+
+            if (!slot.inputIsId)
+            {
+                slot.write(texels, colors, passCount, slot.equation);
+            }
         }
     }
 
@@ -104,9 +931,94 @@ namespace Device {
         assert(0);
     }
 
+    U32 OutputMerger::testStencil(U32 x, U32 y, U32 coverage) const
+    {
+        if (!isStencilActive())
+        {
+            return coverage;
+        }
+
+        for (U32 lane = 0; lane < QUAD_LANES; ++lane)
+        {
+            if (!isLaneCovered(coverage, lane))
+            {
+                continue;
+            }
+
+            // tiles with a pending clear are not filled yet.
+            U32 const laneX = x + (lane & 1u);
+            U32 const laneY = y + (lane >> 1);
+            U8 const* pTexel = isClearPending(laneX, laneY, CLEAR_DEPTH) ? m_clearDepthTexel : m_depthTarget.readTexel(laneX, laneY);
+            if (!testStencilValue(m_stencil, *reinterpret_cast<U32 const*>(pTexel) >> 24))
+            {
+                coverage &= ~(1u << lane);
+            }
+        }
+        return coverage;
+    }
+
+    void OutputMerger::resolveClears()
+    {
+        for (U32 tile = 0; tile < m_clearPending.size(); ++tile)
+        {
+            if (m_clearPending[tile])
+            {
+                fillTile(tile, CLEAR_ALL);
+            }
+        }
+    }
+
+    Texture::Texture2D const& OutputMerger::getColorTarget(U32 index) const
+    {
+        assert(index < MAX_COLOR_TARGETS);
+        return m_colorTargets[index].target;
+    }
+
+    Texture::Texture2D const& OutputMerger::getDepthTarget() const
+    {
+        return m_depthTarget;
+    }
+
+    bool OutputMerger::isDepthWritten(U32 x, U32 y) const
+    {
+        if (isClearPending(x, y, CLEAR_DEPTH))
+        {
+            return false;
+        }
+
+        return Texture::decodeTexel(m_depthTarget.getFormat(), m_depthTarget.readTexel(x, y)).x != m_clearDepthValue;
+    }
+
+    void OutputMerger::writePixel(U32 index, U32 x, U32 y, Vec4f const& color)
+    {
+        assert(index < MAX_COLOR_TARGETS && x < m_width && y < m_height);
+        ColorTargetSlot& slot = m_colorTargets[index];
+        if (slot.write == nullptr)
+        {
+            // unbound target.
+            return;
+        }
+
+        resolveClear(x, y, 1u << index);
+        U8* pTexel = slot.target.readTexel(x, y);
+        slot.write(&pTexel, &color, 1, slot.equation);
+    }
+
     void OutputMerger::presentToBmp() const
     {
-        Texture::saveAsBmp("fb_color.bmp", m_colorTarget);
-        Texture::saveAsBmp("fb_depth.bmp", m_depthTarget);
+        for (U32 index = 0; index < MAX_COLOR_TARGETS; ++index)
+        {
+            ColorTargetSlot const& slot = m_colorTargets[index];
+            if (slot.target.getFormat() == TexelFormat::UNKNOWN)
+            {
+                continue;
+            }
+
+            std::string const filename = index == 0 ? std::string("fb_color.bmp") : "fb_color" + std::to_string(index) + ".bmp";
+            auto isClear = [this, index](U32 x, U32 y) { return isClearPending(x, y, 1u << index); };
+            Texture::saveAsBmp(filename, slot.target, isClear, slot.clearTexel);
+        }
+        auto isDepthClear = [this](U32 x, U32 y) { return isClearPending(x, y, CLEAR_DEPTH); };
+        Texture::saveAsBmp("fb_depth.bmp", m_depthTarget, isDepthClear, m_clearDepthTexel);
     }
 } // namespace Device
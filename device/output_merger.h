@@ -4,30 +4,287 @@
 #include "vmath.h"
 #include "texture.h"
 #include "component.h"
+#include "quad.h"
 
 namespace Device {
+
+    // [ref](https://docs.microsoft.com/en-us/windows/desktop/api/d3d11/ns-d3d11-d3d11_render_target_blend_desc)
+    enum class BlendFactor
+    {
+        ZERO,
+        ONE,
+        SRC_COLOR,
+        INV_SRC_COLOR,
+        SRC_ALPHA,
+        INV_SRC_ALPHA,
+        DST_COLOR,
+        INV_DST_COLOR,
+        DST_ALPHA,
+        INV_DST_ALPHA,
+    };
+
+    // MIN and MAX ignore the factors.
+    enum class BlendOp
+    {
+        ADD,          // src * srcFactor + dst * dstFactor
+        SUBTRACT,     // src * srcFactor - dst * dstFactor
+        REV_SUBTRACT, // dst * dstFactor - src * srcFactor
+        MIN,
+        MAX,
+    };
+
+    // Channels of the color write mask.
+    enum ColorWrite: U8
+    {
+        COLOR_WRITE_RED = 1,
+        COLOR_WRITE_GREEN = 2,
+        COLOR_WRITE_BLUE = 4,
+        COLOR_WRITE_ALPHA = 8,
+        COLOR_WRITE_ALL = 15,
+    };
+
+    // Blending happens in linear space, the target texel is decoded, blended and encoded again.
+    // Targets without alpha read a destination alpha of 1.
+    struct BlendState
+    {
+        bool enable;
+        BlendFactor srcColor;
+        BlendFactor dstColor;
+        BlendOp colorOp;
+        BlendFactor srcAlpha;
+        BlendFactor dstAlpha;
+        BlendOp alphaOp;
+        U8 writeMask; // ColorWrite bits, applies with blending disabled as well.
+
+        // blending disabled, all channels written.
+        static BlendState opaque();
+
+        // src * srcAlpha + dst * (1 - srcAlpha).
+        static BlendState alphaBlend();
+    };
+
+    // [ref](https://docs.microsoft.com/en-us/windows/desktop/api/d3d11/ns-d3d11-d3d11_depth_stencil_desc)
+    enum class CompareFunc
+    {
+        NEVER,
+        LESS,
+        EQUAL,
+        LESS_EQUAL,
+        GREATER,
+        NOT_EQUAL,
+        GREATER_EQUAL,
+        ALWAYS,
+    };
+
+    // INCR and DECR wrap around, the _SAT ops clamp to [0, 255].
+    enum class StencilOp
+    {
+        KEEP,
+        ZERO,
+        REPLACE,
+        INCR_SAT,
+        DECR_SAT,
+        INVERT,
+        INCR,
+        DECR,
+    };
+
+    // The test passes if (ref & readMask) func (stencil & readMask), only writeMask bits of the stencil are changed.
+    // The stencil is the highest 8 bits of a D24_UNORM_S8_UINT depth target. Triangles have no facing, one set of ops.
+    struct StencilState
+    {
+        bool enable;
+        CompareFunc func;
+        StencilOp failOp;      // stencil test failed.
+        StencilOp depthFailOp; // stencil test passed, depth test failed.
+        StencilOp passOp;      // both tests passed.
+        U8 readMask;
+        U8 writeMask;
+        U8 ref;
+
+        // no test, the stencil is kept.
+        static StencilState disabled();
+
+        // ref is written wherever the depth test passes, e.g. to mark a portal.
+        static StencilState replace(U8 ref);
+
+        // passes where the stencil is ref, nothing is written.
+        static StencilState equal(U8 ref);
+
+        // No op changes the stencil, the test does not depend on the order of the fragments of a draw.
+        bool isReadOnly() const;
+    };
+
+    // Color targets written by one pixel shader, SV_Target0 to SV_Target7.
+    static constexpr U32 MAX_COLOR_TARGETS = Semantic::SV_TARGET_COUNT;
+
+    // A BlendState resolved when it is set, so that no pixel switches on its factors or ops.
+    // Channels are in RGBA order, the color and alpha equations share one vector per term.
+    // result = src * srcFactor + dst * dstFactor, the signs of SUBTRACT and REV_SUBTRACT are in the factors.
+    // A factor is the sum of its terms, each scaling one of 1, src, srcAlpha, dst and dstAlpha.
+    struct BlendEquation
+    {
+        enum Term
+        {
+            TERM_ONE,
+            TERM_SRC,
+            TERM_SRC_ALPHA,
+            TERM_DST,
+            TERM_DST_ALPHA,
+            TERM_COUNT,
+        };
+
+        alignas(16) float srcFactor[TERM_COUNT][4];
+        alignas(16) float dstFactor[TERM_COUNT][4];
+        alignas(16) U32 minMask[4];   // all ones in channels blended with MIN.
+        alignas(16) U32 maxMask[4];   // all ones in channels blended with MAX.
+        alignas(16) U32 writeMask[4]; // all ones in written channels, others keep dst.
+
+        static BlendEquation resolve(BlendState const& state);
+    };
+
+    // Blend and write of the lanes of one quad passing the depth and stencil tests to a color target,
+    // specialized on its format and on whether it is read back.
+    typedef void (*ColorWriteFunc)(U8* const* texels, Vec4f const* colors, U32 count, BlendEquation const& blend);
+
     class OutputMerger: public Comp
     {
     protected:
+        // Depth and stencil test of the covered lanes of one quad, specialized on the layout, the depth format and
+        // whether the stencil is enabled. Lanes passing the tests are written to every bound color target in the same pass.
+        typedef void (OutputMerger::*MergeQuadFunc)(U32 coverage, U8 const* pPosition);
+
+        static constexpr U32 MAX_TEXEL_SIZE = 16;
+
+        struct ColorTargetSlot
+        {
+            std::vector<U8> storage;
+            Texture::Texture2D target; // UNKNOWN format if unbound.
+            U32 texelSize;
+            BlendState blend;
+            BlendEquation equation; // blend resolved by selectMergeFunc.
+            ColorWriteFunc write;
+            U8 clearTexel[MAX_TEXEL_SIZE]; // encoded in the target format.
+            Value* input;                  // nullptr if the pixel shader does not write the target.
+            bool inputHasAlpha;            // a FLOAT3 color input has an alpha of 1.
+            bool inputIsId;                // a UINT input is stored unchanged, R32_UINT targets only.
+        };
+
         U32 m_width;
         U32 m_height;
 
-        std::vector<Vec3f> m_colorStorage;
-        std::vector<float> m_depthStorage;
+        // 8x8 tiles keep the footprint of a triangle in few cache lines and pages.
+        // Texels are converted to the target formats in the merge step.
+        Texture::TexelLayout m_layout;
+
+        ColorTargetSlot m_colorTargets[MAX_COLOR_TARGETS];
+        std::vector<U8> m_depthStorage;
+        Texture::Texture2D m_depthTarget; // the stencil shares the texels of D24_UNORM_S8_UINT.
+        StencilState m_stencil;
+        bool m_depthWrite;
+
+        // samples passing the depth and stencil tests, wraps around.
+        U32 m_samplesPassed;
 
-        // TODO: handle alpha?
-        Texture::Texture2D m_colorTarget;
-        Texture::Texture2D m_depthTarget;
-        // TODO: stencil target?
+        // Clears are lazy, a tile with a pending clear is filled with the clear texels when first merged to,
+        // tiles never merged to are presented as the clear texels. Clears are pending per target,
+        // a merge only fills the targets it writes: bit n is color target n, CLEAR_DEPTH the depth target.
+        static constexpr U32 CLEAR_TILE_DIM = 32;
+        static constexpr U32 CLEAR_DEPTH = 1u << MAX_COLOR_TARGETS;
+        static constexpr U32 CLEAR_ALL = CLEAR_DEPTH | (CLEAR_DEPTH - 1);
+
+        U32 m_tilesWide;
+        std::vector<U16> m_clearPending; // target bits per tile, row-major.
+        Vec3f m_clearColor;
+        float m_clearDepth;
+        U8 m_clearStencil;
+        U8 m_clearDepthTexel[MAX_TEXEL_SIZE]; // holds the clear stencil as well.
+        float m_clearDepthValue;               // m_clearDepthTexel decoded, in the target precision.
 
         Value* m_inPosition;
-        Value* m_inColor;
+        Value* m_inCoverage;
+
+        // the in stream element is a pixel quad, lanes are m_inLaneStride apart.
+        U32 m_inLaneStride;
+
+        // bound targets the pixel shader writes, and their inputs of the current quad.
+        U32 m_numActiveTargets;
+        U32 m_activeTargets[MAX_COLOR_TARGETS];
+        U8 const* m_activeInputs[MAX_COLOR_TARGETS];
+        U32 m_mergeClearMask; // the depth and active targets, cleared before a quad is merged.
+
+        MergeQuadFunc m_mergeQuadFunc;
+
+        template <Texture::TexelLayout layout, Texture::TexelFormat depthFormat, bool stencil>
+        void mergeQuad(U32 coverage, U8 const* pPosition);
+
+        template <Texture::TexelLayout layout>
+        static MergeQuadFunc selectMergeQuad(Texture::TexelFormat depthFormat, bool stencil);
+
+        // Only SV_Target0 as FLOAT3 without prevComp.
+        void addInputPorts(Comp const* prevComp);
+
+        // (Re)allocate the targets, all tiles get a pending clear to the last clear values.
+        void allocateTargets();
+
+        // Fill the tile of pixel (x, y) of the targets in mask with the clear texels if their clear is pending.
+        inline void resolveClear(U32 x, U32 y, U32 mask)
+        {
+            U32 const tile = x / CLEAR_TILE_DIM + (y / CLEAR_TILE_DIM) * m_tilesWide;
+            if (m_clearPending[tile] & mask)
+            {
+                fillTile(tile, mask);
+            }
+        }
+
+        void fillTile(U32 tile, U32 mask);
+
+        inline bool isClearPending(U32 x, U32 y, U32 mask) const
+        {
+            return (m_clearPending[x / CLEAR_TILE_DIM + (y / CLEAR_TILE_DIM) * m_tilesWide] & mask) != 0;
+        }
+
+        void selectMergeFunc();
 
     public:
         OutputMerger();
 
         void resize(U32 width, U32 height);
 
+        // Color targets: R32G32B32_FLOAT, R8G8B8A8_UNORM, R8G8B8A8_SRGB, R10G10B10A2_UNORM, R32_UINT, UNKNOWN unbinds the target.
+        // A UINT pixel shader output is only written to an R32_UINT target and is stored unchanged.
+        // Target 0 is bound to R32G32B32_FLOAT (HDR) by default, the others are unbound.
+        void setColorFormat(U32 index, Texture::TexelFormat format);
+
+        // Depth targets: D32_FLOAT (default), D24_UNORM_S8_UINT, D16_UNORM.
+        void setDepthFormat(Texture::TexelFormat format);
+
+        // TILED_8X8_MORTON (default) or LINEAR, presenting reads either.
+        void setLayout(Texture::TexelLayout layout);
+
+        void setBlendState(U32 index, BlendState const& state);
+
+        // The stencil test only runs with the D24_UNORM_S8_UINT depth format, other formats have no stencil
+        // and every sample passes it, the state is kept for a later format change.
+        void setStencilState(StencilState const& state);
+
+        StencilState const& getStencilState() const;
+
+        // The stencil is enabled and the depth target has one.
+        bool isStencilActive() const;
+
+        // The depth test still runs with depth writes disabled.
+        void setDepthWrite(bool enable);
+
+        // Samples passing the depth and stencil tests since construction, it wraps around,
+        // occlusion queries count the difference over their draws.
+        U32 getSamplesPassed() const;
+
+        // Only marks every tile, the targets are not written until merged to.
+        // All color targets clear to color, depth is in target space, 0 is the farthest.
+        // The targets start cleared to zero.
+        void clear(Vec3f const& color, float depth, U8 stencil);
+
         void setWidth(U32 width);
 
         void setHeight(U32 height);
@@ -36,6 +293,16 @@ namespace Device {
 
         U32 getHeight() const;
 
+        Texture::TexelFormat getColorFormat(U32 index) const;
+
+        Texture::TexelFormat getDepthFormat() const;
+
+        // Lane stride of the quad in stream element.
+        void setLaneStride(U32 inLaneStride);
+
+        // One color input per SV_Target<n> output of prevComp, FLOAT3, FLOAT4 or UINT.
+        void adjustInputPorts(Comp const& prevComp);
+
         // Component interface begin
         bool isOneInOneOut() const;
 
@@ -48,7 +315,27 @@ namespace Device {
         void produceOneOutput();
         // Component interface end
         
-        // output
+        // Lanes of the quad at (x, y) passing the stencil test, all of them if the stencil is not active, nothing is written.
+        // Used to reject pixels before shading, only exact while the stencil state is read only.
+        U32 testStencil(U32 x, U32 y, U32 coverage) const;
+
+        // Resolve passes read and write the targets per pixel after the draws.
+
+        // Fill every tile with a pending clear, the targets can be read directly afterwards.
+        void resolveClears();
+
+        Texture::Texture2D const& getColorTarget(U32 index) const;
+
+        Texture::Texture2D const& getDepthTarget() const;
+
+        // True if a fragment passed the depth test at (x, y) since the last clear.
+        // The depth test is strict, a written depth differs from the clear depth.
+        bool isDepthWritten(U32 x, U32 y) const;
+
+        // Blend color into color target index at (x, y) with the target's blend state, no depth test.
+        void writePixel(U32 index, U32 x, U32 y, Vec4f const& color);
+
+        // output, color target n is saved as fb_color<n>.bmp, target 0 as fb_color.bmp.
         void presentToBmp() const;
     };
 } // namespace Device
@@ -1,16 +1,31 @@
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
 #include "pipeline.h"
+#include "texture_stats.h"
 
 namespace Device {
     Pipeline::Pipeline()
         : m_inputAssembler{}
         , m_primitiveAssembler{}
         , m_vsProgram{}
-        , m_psProgram{}
+        , m_psProgram{ShaderProcessor::PerQuad}
         , m_rasterizer{}
         , m_outputMerger{}
+        , m_stateCache{}
+        , m_state{nullptr}
+        , m_psShader{nullptr}
+        , m_resolveProgram{ShaderProcessor::PerQuad}
+        , m_lightingShader{nullptr}
+        , m_visibility{false}
+        , m_visibilityShader{loadPS_Visibility()}
     {
         // set default target size
         setTargetSize(1024, 768);
+
+        // setup last dummy stream
+        m_dummyStream.setCapacity(1);
     }
 
     void Pipeline::setVertexBufferChannel(Semantic const& semantic, U8* base, U32 offset, U32 stride)
@@ -35,7 +50,11 @@ namespace Device {
 
     void Pipeline::setPSProgram(Shader& shader)
     {
-        m_psProgram.attach(&shader);
+        m_psShader = &shader;
+        if (!m_visibility)
+        {
+            m_psProgram.attach(&shader);
+        }
     }
 
     void Pipeline::setTargetSize(U32 width, U32 height)
@@ -44,39 +63,587 @@ namespace Device {
         m_outputMerger.resize(width, height);
     }
 
+    void Pipeline::setTargetFormats(Texture::TexelFormat colorFormat, Texture::TexelFormat depthFormat)
+    {
+        m_outputMerger.setColorFormat(0, colorFormat);
+        m_outputMerger.setDepthFormat(depthFormat);
+    }
+
+    void Pipeline::setColorTargetFormat(U32 index, Texture::TexelFormat format)
+    {
+        m_outputMerger.setColorFormat(index, format);
+    }
+
+    void Pipeline::setTargetLayout(Texture::TexelLayout layout)
+    {
+        m_outputMerger.setLayout(layout);
+    }
+
+    void Pipeline::setBlendState(BlendState const& state)
+    {
+        for (U32 index = 0; index < MAX_COLOR_TARGETS; ++index)
+        {
+            m_outputMerger.setBlendState(index, state);
+        }
+    }
+
+    void Pipeline::setBlendState(U32 index, BlendState const& state)
+    {
+        m_outputMerger.setBlendState(index, state);
+    }
+
+    void Pipeline::setDeferred(bool enable)
+    {
+        Texture::TexelFormat const format = enable ? Texture::TexelFormat::R32G32B32_FLOAT : Texture::TexelFormat::UNKNOWN;
+        m_outputMerger.setColorFormat(GBUFFER_POSITION, format);
+        m_outputMerger.setColorFormat(GBUFFER_NORMAL, format);
+        m_outputMerger.setColorFormat(GBUFFER_TEXCOORD_MATERIAL, format);
+        m_outputMerger.setColorFormat(GBUFFER_TEXCOORD_DDX, format);
+        m_outputMerger.setColorFormat(GBUFFER_TEXCOORD_DDY, format);
+    }
+
+    void Pipeline::setLightingProgram(Shader& shader)
+    {
+        m_lightingShader = &shader;
+    }
+
+    LinearStruct Pipeline::setupResolveStreams()
+    {
+        // the in stream element is a quad of the shader inputs.
+        LinearStruct inStruct;
+        LinearStruct outStruct;
+        for (U32 port = 0; port < m_resolveProgram.getNumPorts(Comp::Input); ++port)
+        {
+            inStruct.addField(m_resolveProgram.getSemantic(Comp::Input, port), m_resolveProgram.getType(Comp::Input, port));
+        }
+        for (U32 port = 0; port < m_resolveProgram.getNumPorts(Comp::Output); ++port)
+        {
+            outStruct.addField(m_resolveProgram.getSemantic(Comp::Output, port), m_resolveProgram.getType(Comp::Output, port));
+        }
+        inStruct.setNumLanes(QUAD_LANES);
+        outStruct.setNumLanes(QUAD_LANES);
+
+        m_resolveInStream.setStructure(inStruct);
+        m_resolveInStream.setCapacity(RESOLVE_BATCH);
+        m_resolveOutStream.setStructure(outStruct);
+        m_resolveOutStream.setCapacity(RESOLVE_BATCH);
+        m_resolveProgram.setLaneStrides(inStruct.getLaneSize(), outStruct.getLaneSize());
+        m_resolveQuads.clear();
+
+        return inStruct;
+    }
+
+    void Pipeline::drawDeferredLighting()
+    {
+        assert(m_lightingShader != nullptr);
+
+        // the G-buffer is read directly, fill the tiles with a pending clear first.
+        m_outputMerger.resolveClears();
+
+        Texture::Texture2D const& depthTarget = m_outputMerger.getDepthTarget();
+        struct GBufferChannel
+        {
+            Semantic semantic;
+            U32 target;
+        };
+        GBufferChannel const gBuffer[] =
+        {
+            {Semantic::Position0, GBUFFER_POSITION},
+            {Semantic::Normal0, GBUFFER_NORMAL},
+            {Semantic::Texcoord0, GBUFFER_TEXCOORD_MATERIAL},
+            {Semantic::Texcoord1, GBUFFER_TEXCOORD_DDX},
+            {Semantic::Texcoord2, GBUFFER_TEXCOORD_DDY},
+        };
+        for (GBufferChannel const& channel : gBuffer)
+        {
+            // see setDeferred.
+            assert(m_outputMerger.getColorFormat(channel.target) == Texture::TexelFormat::R32G32B32_FLOAT);
+            (void)channel;
+        }
+
+        m_resolveProgram.attach(m_lightingShader);
+        LinearStruct const inStruct = setupResolveStreams();
+
+        // G-buffer target feeding each input channel, nullptr for generated channels.
+        U32 const numChannels = inStruct.numFields();
+        std::vector<Texture::Texture2D const*> sources(numChannels, nullptr);
+        for (U32 channel = 0; channel < numChannels; ++channel)
+        {
+            Semantic const semantic = inStruct.getFieldSemantic(channel);
+            Type const type = inStruct.getFieldType(channel);
+            for (GBufferChannel const& gBufferChannel : gBuffer)
+            {
+                if (gBufferChannel.semantic == semantic)
+                {
+                    // G-buffer texels are FLOAT3, shorter inputs read the leading channels.
+                    assert(type == Type::FLOAT3 || type == Type::FLOAT2 || type == Type::FLOAT);
+                    sources[channel] = &m_outputMerger.getColorTarget(gBufferChannel.target);
+                }
+            }
+
+            // not in the G-buffer.
+            assert(sources[channel] != nullptr || semantic == Semantic::SV_Position || semantic == Semantic::SV_Coverage);
+            (void)type;
+        }
+
+        U32 const width = m_outputMerger.getWidth();
+        U32 const height = m_outputMerger.getHeight();
+        U32 const laneSize = inStruct.getLaneSize();
+        for (U32 y = 0; y < height; y += 2)
+        {
+            for (U32 x = 0; x < width; x += 2)
+            {
+                // only pixels covered by a draw are shaded.
+                U32 coverage = 0;
+                for (U32 lane = 0; lane < QUAD_LANES; ++lane)
+                {
+                    U32 const laneX = x + (lane & 1u);
+                    U32 const laneY = y + (lane >> 1);
+                    if (laneX < width && laneY < height && m_outputMerger.isDepthWritten(laneX, laneY))
+                    {
+                        coverage |= 1u << lane;
+                    }
+                }
+
+                if (coverage == 0)
+                {
+                    continue;
+                }
+
+                // lanes without a written depth take the G-buffer of a covered neighbour, so derivatives stay finite.
+                // Neighbours may belong to another surface, texture derivatives are read from the G-buffer instead.
+                FifoStream::Element element = m_resolveInStream.pushData();
+                for (U32 lane = 0; lane < QUAD_LANES; ++lane)
+                {
+                    U32 sourceLane = lane;
+                    if (!isLaneCovered(coverage, lane))
+                    {
+                        sourceLane = isLaneCovered(coverage, lane ^ 1u) ? lane ^ 1u : isLaneCovered(coverage, lane ^ 2u) ? lane ^ 2u : lane ^ 3u;
+                    }
+                    U32 const laneX = x + (sourceLane & 1u);
+                    U32 const laneY = y + (sourceLane >> 1);
+                    for (U32 channel = 0; channel < numChannels; ++channel)
+                    {
+                        U8* pLane = element.getData(channel) + lane * laneSize;
+                        Semantic const semantic = inStruct.getFieldSemantic(channel);
+                        if (sources[channel] != nullptr)
+                        {
+                            std::memcpy(pLane, sources[channel]->readTexel(laneX, laneY), SizeOf(inStruct.getFieldType(channel)));
+                        }
+                        else if (semantic == Semantic::SV_Position)
+                        {
+                            // pixel center in NDC, depth mapped back from [1, 0] to [-1, 1].
+                            float const depth = Texture::decodeTexel(depthTarget.getFormat(), depthTarget.readTexel(laneX, laneY)).x;
+                            *reinterpret_cast<Vec4f*>(pLane) = Vec4f{(2.0f * laneX + 1.0f) / width - 1.0f, (2.0f * laneY + 1.0f) / height - 1.0f, 1.0f - 2.0f * depth, 1.0f};
+                        }
+                        else
+                        {
+                            *reinterpret_cast<U32*>(pLane) = coverage;
+                        }
+                    }
+                }
+                m_resolveQuads.push_back(x | (y << 16));
+
+                if (m_resolveInStream.isFull())
+                {
+                    runResolveBatch();
+                }
+            }
+        }
+        runResolveBatch();
+    }
+
+    void Pipeline::runResolveBatch()
+    {
+        runComp(m_resolveProgram, m_resolveInStream, m_resolveOutStream);
+        assert(m_resolveInStream.isEmpty());
+
+        U32 const colorChannel = m_resolveOutStream.getChannelIndex(Semantic::SV_Target0);
+        U32 const coverageChannel = m_resolveOutStream.getChannelIndex(Semantic::SV_Coverage);
+        LinearStruct const& outStruct = m_resolveOutStream.getStructure();
+        U32 const laneSize = outStruct.getLaneSize();
+
+        // the shader writes SV_Target0, FLOAT3 or FLOAT4.
+        assert(colorChannel != m_resolveOutStream.numChannels());
+        bool const hasAlpha = outStruct.getFieldType(colorChannel) == Type::FLOAT4;
+
+        for (U32 quad = 0; !m_resolveOutStream.isEmpty(); ++quad)
+        {
+            FifoStream::Element element = m_resolveOutStream.front();
+            U32 const coverage = *reinterpret_cast<U32 const*>(element.getData(coverageChannel));
+            U32 const x = m_resolveQuads[quad] & 0xffff;
+            U32 const y = m_resolveQuads[quad] >> 16;
+            for (U32 lane = 0; lane < QUAD_LANES; ++lane)
+            {
+                if (!isLaneCovered(coverage, lane))
+                {
+                    continue;
+                }
+
+                U8 const* pColor = element.getData(colorChannel) + lane * laneSize;
+                Vec3f const& rgb = *reinterpret_cast<Vec3f const*>(pColor);
+                Vec4f const color = hasAlpha ? *reinterpret_cast<Vec4f const*>(pColor) : Vec4f{rgb.x, rgb.y, rgb.z, 1.0f};
+                m_outputMerger.writePixel(0, x + (lane & 1u), y + (lane >> 1), color);
+            }
+            m_resolveOutStream.popData();
+        }
+        m_resolveQuads.clear();
+    }
+
+    void Pipeline::setVisibilityBuffer(bool enable)
+    {
+        m_visibility = enable;
+        m_outputMerger.setColorFormat(VISIBILITY_TARGET, enable ? Texture::TexelFormat::R32_UINT : Texture::TexelFormat::UNKNOWN);
+
+        if (enable)
+        {
+            m_psProgram.attach(&m_visibilityShader);
+        }
+        else if (m_psShader != nullptr)
+        {
+            m_psProgram.attach(m_psShader);
+        }
+    }
+
+    void Pipeline::recordVisibilityDraw()
+    {
+        assert(m_psShader != nullptr);
+
+        // the draw index is in the high bits of the ids, start over once they are all used.
+        if (m_visibilityDraws.size() == VISIBILITY_MAX_DRAWS)
+        {
+            resolveVisibility();
+        }
+        U32 const drawId = m_visibilityDraws.size();
+        *reinterpret_cast<U32*>(m_visibilityShader.getConstantAddr("cDrawId")) = drawId;
+
+        m_visibilityDraws.push_back(VisibilityDraw{});
+        VisibilityDraw& draw = m_visibilityDraws.back();
+        draw.psShader = m_psShader;
+        draw.vsOutStruct = m_vsOutStream.getStructure();
+
+        // vertex outputs are contiguous, the stream is cleared before each draw.
+        U32 const vertexSize = draw.vsOutStruct.getSize();
+        U32 const numVertices = m_vsOutStream.getNumElements();
+        if (numVertices != 0)
+        {
+            U8 const* vertices = StreamBuffer{m_vsOutStream}.getElement(0).getAddr();
+            draw.vertices.assign(vertices, vertices + numVertices * vertexSize);
+        }
+
+        // read the indices through a copy, the draw consumes m_paInStream.
+        InputAssembler::IndexStream indices = m_paInStream;
+        while (!indices.isEmpty())
+        {
+            draw.indices.push_back(*reinterpret_cast<U32 const*>(indices.front().getData(0)));
+            indices.popData();
+        }
+
+        // the triangle index is in the low bits of the ids, a larger draw would be shaded with wrong triangles.
+        if (draw.indices.size() / 3 > VISIBILITY_MAX_PRIMITIVES)
+        {
+            std::cerr << "Pipeline: a visibility buffer draw has " << draw.indices.size() / 3
+                << " triangles, at most " << VISIBILITY_MAX_PRIMITIVES << " are supported." << std::endl;
+            std::abort();
+        }
+
+        // constants may change before the resolve, e.g. the texture of the next draw. The texels are not copied.
+        for (Shader::Symbol const& symbol : m_psShader->getSymbols(Shader::Constant))
+        {
+            if (symbol.type == Type::Texture2D)
+            {
+                draw.psTextures.push_back(Texture::Texture2D::view(*reinterpret_cast<Texture::Texture2D const*>(symbol.addr)));
+            }
+            else
+            {
+                draw.psConstants.insert(draw.psConstants.end(), symbol.addr, symbol.addr + SizeOf(symbol.type));
+            }
+        }
+    }
+
+    void Pipeline::swapVisibilityConstants(VisibilityDraw& draw)
+    {
+        U32 textureIndex = 0;
+        U32 offset = 0;
+        for (Shader::Symbol const& symbol : draw.psShader->getSymbols(Shader::Constant))
+        {
+            if (symbol.type == Type::Texture2D)
+            {
+                // textures are moved, not copied.
+                std::swap(draw.psTextures[textureIndex++], *reinterpret_cast<Texture::Texture2D*>(symbol.addr));
+            }
+            else
+            {
+                U32 const size = SizeOf(symbol.type);
+                std::swap_ranges(symbol.addr, symbol.addr + size, draw.psConstants.begin() + offset);
+                offset += size;
+            }
+        }
+    }
+
+    void Pipeline::resolveVisibility()
+    {
+        // the ids are read directly, fill the tiles with a pending clear first.
+        m_outputMerger.resolveClears();
+
+        Texture::Texture2D const& idTarget = m_outputMerger.getColorTarget(VISIBILITY_TARGET);
+        // see setVisibilityBuffer.
+        assert(idTarget.getFormat() == Texture::TexelFormat::R32_UINT);
+
+        // quads are split by the triangle of each pixel and sorted by draw, a draw binds its pixel shader once.
+        std::vector<std::vector<VisibleQuad>> drawQuads(m_visibilityDraws.size());
+        U32 const width = m_outputMerger.getWidth();
+        U32 const height = m_outputMerger.getHeight();
+        U32 const primitiveMask = (1u << VISIBILITY_PRIMITIVE_BITS) - 1;
+        for (U32 y = 0; y < height; y += 2)
+        {
+            for (U32 x = 0; x < width; x += 2)
+            {
+                U32 ids[QUAD_LANES];
+                U32 written = 0;
+                for (U32 lane = 0; lane < QUAD_LANES; ++lane)
+                {
+                    U32 const laneX = x + (lane & 1u);
+                    U32 const laneY = y + (lane >> 1);
+                    if (laneX < width && laneY < height && m_outputMerger.isDepthWritten(laneX, laneY))
+                    {
+                        // a later resolve skips the pixels shaded now, unless a draw covers them again.
+                        U32& id = *reinterpret_cast<U32*>(idTarget.readTexel(laneX, laneY));
+                        if (id != VISIBILITY_RESOLVED_ID)
+                        {
+                            ids[lane] = id;
+                            written |= 1u << lane;
+                            id = VISIBILITY_RESOLVED_ID;
+                        }
+                    }
+                }
+
+                while (written != 0)
+                {
+                    U32 const id = ids[__builtin_ctz(written)];
+                    U32 coverage = 0;
+                    for (U32 lane = 0; lane < QUAD_LANES; ++lane)
+                    {
+                        if (isLaneCovered(written, lane) && ids[lane] == id)
+                        {
+                            coverage |= 1u << lane;
+                        }
+                    }
+                    written &= ~coverage;
+
+                    assert((id >> VISIBILITY_PRIMITIVE_BITS) < drawQuads.size());
+                    drawQuads[id >> VISIBILITY_PRIMITIVE_BITS].push_back(VisibleQuad{x | (y << 16), coverage, id & primitiveMask});
+                }
+            }
+        }
+
+        for (U32 drawId = 0; drawId < m_visibilityDraws.size(); ++drawId)
+        {
+            resolveVisibilityDraw(m_visibilityDraws[drawId], drawQuads[drawId]);
+        }
+        m_visibilityDraws.clear();
+    }
+
+    void Pipeline::resolveVisibilityDraw(VisibilityDraw& draw, std::vector<VisibleQuad> const& quads)
+    {
+        if (quads.empty())
+        {
+            return;
+        }
+
+        swapVisibilityConstants(draw);
+        m_resolveProgram.attach(draw.psShader);
+        LinearStruct const inStruct = setupResolveStreams();
+
+        // varyings are interpolated like the rasterizer does, the inputs it generates are filled here.
+        InterpolationPlan const plan = makeInterpolationPlan(draw.vsOutStruct, m_resolveProgram, inStruct);
+        U32 const coverageChannel = inStruct.getFieldIndex(Semantic::SV_Coverage);
+        U32 const primitiveChannel = inStruct.getFieldIndex(Semantic::SV_PrimitiveID);
+        U32 const positionOffset = draw.vsOutStruct.getFieldOffset(Semantic::SV_Position);
+        U32 const vertexSize = draw.vsOutStruct.getSize();
+        U32 const laneSize = inStruct.getLaneSize();
+
+        int const width = m_outputMerger.getWidth();
+        int const height = m_outputMerger.getHeight();
+        for (VisibleQuad const& quad : quads)
+        {
+            U8 const* a = draw.vertices.data() + draw.indices[quad.primitive * 3 + 0] * vertexSize;
+            U8 const* b = draw.vertices.data() + draw.indices[quad.primitive * 3 + 1] * vertexSize;
+            U8 const* c = draw.vertices.data() + draw.indices[quad.primitive * 3 + 2] * vertexSize;
+            Triangle2D const triangle = setupTriangle(
+                *reinterpret_cast<Vec2f const*>(a + positionOffset),
+                *reinterpret_cast<Vec2f const*>(b + positionOffset),
+                *reinterpret_cast<Vec2f const*>(c + positionOffset));
+
+            // all lanes are interpolated, lanes of other triangles are helpers as in the rasterizer.
+            int const qx = quad.position & 0xffff;
+            int const qy = quad.position >> 16;
+            FifoStream::Element element = m_resolveInStream.pushData();
+            U8* dst = element.getData(0);
+            for (U32 lane = 0; lane < QUAD_LANES; ++lane)
+            {
+                int const x = qx + (lane & 1);
+                int const y = qy + (lane >> 1);
+                Vec2f const pixel{float(2 * x + 1 - width)/width, float(2 * y + 1 - height)/height};
+                BaryCentricCoff const coff = calcBaryCentricCoordinates(triangle, pixel);
+
+                U32 const laneOffset = lane * laneSize;
+                plan.kernel(dst + laneOffset, a, b, c, coff, plan.varyings.data(), plan.varyings.size());
+                *reinterpret_cast<U32*>(element.getData(coverageChannel) + laneOffset) = quad.coverage;
+                if (primitiveChannel != inStruct.numFields())
+                {
+                    *reinterpret_cast<U32*>(element.getData(primitiveChannel) + laneOffset) = quad.primitive;
+                }
+            }
+            m_resolveQuads.push_back(quad.position);
+
+            if (m_resolveInStream.isFull())
+            {
+                runResolveBatch();
+            }
+        }
+        runResolveBatch();
+
+        // the constants set since the draw are restored.
+        swapVisibilityConstants(draw);
+    }
+
+    void Pipeline::setStencilState(StencilState const& state)
+    {
+        m_outputMerger.setStencilState(state);
+
+        // the stencil does not change during a read only draw, testing it early gives the same result.
+        m_rasterizer.setEarlyStencil(state.enable && state.isReadOnly() ? &m_outputMerger : nullptr);
+    }
+
+    void Pipeline::setDepthWrite(bool enable)
+    {
+        m_outputMerger.setDepthWrite(enable);
+    }
+
+    void Pipeline::beginQuery(OcclusionQuery& query)
+    {
+        // the result of the last endQuery stays valid for predicated draws.
+        query.startSamples = m_outputMerger.getSamplesPassed();
+    }
+
+    void Pipeline::endQuery(OcclusionQuery& query)
+    {
+        // draws are drained when submitted, every sample of the query is merged already.
+        query.samples = m_outputMerger.getSamplesPassed() - query.startSamples;
+        query.hasResult = true;
+    }
+
+    void Pipeline::clear(Vec3f const& color, float depth)
+    {
+        clear(color, depth, 0);
+    }
+
+    void Pipeline::clear(Vec3f const& color, float depth, U8 stencil)
+    {
+        m_outputMerger.clear(color, depth, stencil);
+
+        // draws of the previous frame are dropped if they are not resolved.
+        m_visibilityDraws.clear();
+    }
+
     void Pipeline::present() const
     {
         m_outputMerger.presentToBmp();
+
+#if defined(TEXTURE_STATS)
+        Texture::reportTextureStats(std::cout, "tex_heat_");
+#endif
     }
 
-    void Pipeline::setupComponents()
+    Texture::Texture2D const& Pipeline::getColorTarget(U32 index)
+    {
+        m_outputMerger.resolveClears();
+        return m_outputMerger.getColorTarget(index);
+    }
+
+    Texture::Texture2D const& Pipeline::getDepthTarget()
+    {
+        m_outputMerger.resolveClears();
+        return m_outputMerger.getDepthTarget();
+    }
+
+    void Pipeline::bindPipelineState(PipelineState const* state)
     {
         U32 const FIFO_SIZE = 1024 * 1024;
 
+        m_state = state;
+
+        // setup VS out stream, capacity depends on vertex count and is adjusted per draw.
+        m_vsOutStream.setStructure(state->getStreamStruct(PipelineState::VSOutStream));
+        m_vsOutStream.setCapacity(m_vsInStream.getNumElements());
+
+        // setup PA out stream.
+        m_paOutStream.setStructure(state->getStreamStruct(PipelineState::PAOutStream));
+        m_paOutStream.setCapacity(FIFO_SIZE);
+
+        // setup PS in/out stream, elements are pixel quads.
+        LinearStruct const& psInStruct = state->getStreamStruct(PipelineState::PSInStream);
+        LinearStruct const& psOutStruct = state->getStreamStruct(PipelineState::PSOutStream);
+
+        m_psInStream.setStructure(psInStruct);
+        m_psInStream.setCapacity(FIFO_SIZE / QUAD_LANES);
+
+        m_psOutStream.setStructure(psOutStruct);
+        m_psOutStream.setCapacity(FIFO_SIZE / QUAD_LANES);
+
+        // setup the rasterizer output ports, keep the same as psProgram.
+        m_rasterizer.adjustOutputPorts(m_psProgram);
+        m_rasterizer.setInterpolationPlan(state->getInterpolationPlan());
+
+        m_rasterizer.setLaneStride(psInStruct.getLaneSize());
+        m_psProgram.setLaneStrides(psInStruct.getLaneSize(), psOutStruct.getLaneSize());
+        m_outputMerger.setLaneStride(psOutStruct.getLaneSize());
+    }
+
+    void Pipeline::setupComponents()
+    {
         // setup input buffers.
         // [inputAssember] -> vsInStream -> [vsProgram] -> vsOutStream
         // [inputAssember] -> paInStream -> [primitiveAssembler] -> paOutStream
         m_inputAssembler.setupVertexStream(m_vsInStream);
         m_inputAssembler.setupIndexStream(m_paInStream);
 
-        // setup VS out stream.
-        initStream(m_vsOutStream, m_vsProgram, Comp::Output);
-        m_vsOutStream.setCapacity(m_vsInStream.getNumElements());
-
-        // setup PA out stream.
-        initStream(m_paOutStream, m_primitiveAssembler, Comp::Output);
-        m_paOutStream.setCapacity(FIFO_SIZE);
+        // the output merger has a color input per target the pixel shader writes,
+        // the state linkage is built from its ports.
+        if (m_state == nullptr || m_state->getDesc().psShaderId != m_psProgram.getShader()->getId())
+        {
+            m_outputMerger.adjustInputPorts(m_psProgram);
+        }
 
-        // setup PS in/out stream.
-        initStream(m_psInStream, m_psProgram, Comp::Input);
-        m_psInStream.setCapacity(FIFO_SIZE);
+        PipelineStateDesc desc{
+            m_vsProgram.getShader()->getId(),
+            m_psProgram.getShader()->getId(),
+            m_inputAssembler.getVertexLayout(),
+            {},
+            m_outputMerger.getDepthFormat(),
+        };
+        for (U32 index = 0; index < MAX_COLOR_TARGETS; ++index)
+        {
+            desc.colorFormats[index] = m_outputMerger.getColorFormat(index);
+        }
 
-        // TODO: should adjust to output merger?
-        initStream(m_psOutStream, m_psProgram, Comp::Output);
-        m_psOutStream.setCapacity(FIFO_SIZE);
+        PipelineState const* state = m_stateCache.acquire(desc,
+            m_vsProgram, m_primitiveAssembler, m_rasterizer, m_psProgram, m_outputMerger);
 
-        // setup last dummy stream
-        m_dummyStream.setCapacity(1);
+        if (state != m_state)
+        {
+            bindPipelineState(state);
+        }
+        else if (m_vsOutStream.getCapacity() < m_vsInStream.getNumElements())
+        {
+            m_vsOutStream.setCapacity(m_vsInStream.getNumElements());
+        }
+        else
+        {
+            // all streams are drained by the previous draw, only vs output is kept.
+            m_vsOutStream.clear();
+        }
     }
 
     // this function draws everything in the vertex and index buffer.
@@ -85,7 +652,7 @@ namespace Device {
         setupComponents();
 
         // run vertex shader
-        runComp(m_vsProgram, m_vsInStream, m_vsOutStream);
+        runComp(m_vsProgram, m_vsInStream, m_vsOutStream, m_state->getLinkage(PipelineState::VSStage));
 
         // Assume all vertices are processed.
         assert(m_vsInStream.isEmpty());
@@ -93,8 +660,10 @@ namespace Device {
         // set the vertex output into rasterizer as a buffer, mark all as processed.
         m_rasterizer.bindVSOutput(m_vsOutStream);
 
-        // setup the rasterizer output ports, keep the same as psProgram.
-        m_rasterizer.adjustOutputPorts(m_psProgram);
+        if (m_visibility)
+        {
+            recordVisibilityDraw();
+        }
 
         while (
             // drain out all component pendings
@@ -110,16 +679,16 @@ namespace Device {
             )
         {
             // run primitive assembler, fill into a 'primitive list' stream.
-            runComp(m_primitiveAssembler, m_paInStream, m_paOutStream);
+            runComp(m_primitiveAssembler, m_paInStream, m_paOutStream, m_state->getLinkage(PipelineState::PAStage));
 
             // run rasterizer, fill into pixel in stream.
-            runComp(m_rasterizer, m_paOutStream, m_psInStream);
+            runComp(m_rasterizer, m_paOutStream, m_psInStream, m_state->getLinkage(PipelineState::RasterStage));
 
             // run per-pixel shader, fill into pixel out stream
-            runComp(m_psProgram, m_psInStream, m_psOutStream);
+            runComp(m_psProgram, m_psInStream, m_psOutStream, m_state->getLinkage(PipelineState::PSStage));
 
             // fill the framebuffer
-            runComp(m_outputMerger, m_psOutStream, m_dummyStream);
+            runComp(m_outputMerger, m_psOutStream, m_dummyStream, m_state->getLinkage(PipelineState::OMStage));
 
             // debug
             //static U32 counter = 0;
@@ -127,6 +696,17 @@ namespace Device {
         }
     }
 
+    void Pipeline::drawIndexed(OcclusionQuery const& predicate)
+    {
+        if (predicate.hasResult && predicate.samples == 0)
+        {
+            // occluded, no state is set up either.
+            return;
+        }
+
+        drawIndexed();
+    }
+
     void Pipeline::drawIndexed(U32 ibStart, U32 count)
     {
         (void)ibStart;
@@ -9,23 +9,37 @@
 #include "primitive_assembler.h"
 #include "shader_processor.h"
 #include "output_merger.h"
+#include "pipeline_state.h"
 
 namespace Device {
 
-    // Initialize stream channels according to component io port.
-    template <typename IOStream, typename Component>
-    void initStream(IOStream& stream, Component const& comp, Comp::IOType io)
-    {
-        stream.resetChannels();
+    // G-buffer color targets of the deferred path, written by loadPS_GBuffer.
+    static constexpr U32 GBUFFER_POSITION = 1;          // view space position
+    static constexpr U32 GBUFFER_NORMAL = 2;            // view space normal
+    static constexpr U32 GBUFFER_TEXCOORD_MATERIAL = 3; // texcoord u, v and material id
+    static constexpr U32 GBUFFER_TEXCOORD_DDX = 4;      // ddx of texcoord u, v, taken in the geometry pass
+    static constexpr U32 GBUFFER_TEXCOORD_DDY = 5;      // ddy of texcoord u, v
 
-        U32 numPorts = comp.getNumPorts(io);
-        for (U32 portIndex = 0; portIndex < numPorts; ++ portIndex)
-        {
-            Semantic const& semantic = comp.getSemantic(io, portIndex);
-            Type const& type = comp.getType(io, portIndex);
-            stream.addChannel(semantic, type);
-        }
-    }
+    // Color target of the visibility buffer ids, written by loadPS_Visibility.
+    static constexpr U32 VISIBILITY_TARGET = 1;
+
+    // Draws and triangles per draw the visibility ids hold, see VISIBILITY_PRIMITIVE_BITS.
+    // The last triangle index is kept for VISIBILITY_RESOLVED_ID.
+    static constexpr U32 VISIBILITY_MAX_DRAWS = 1u << (32 - VISIBILITY_PRIMITIVE_BITS);
+    static constexpr U32 VISIBILITY_MAX_PRIMITIVES = (1u << VISIBILITY_PRIMITIVE_BITS) - 1;
+
+    // Id of the pixels shaded by resolveVisibility, they are skipped until a draw covers them again.
+    static constexpr U32 VISIBILITY_RESOLVED_ID = ~0u;
+
+    // Samples passing the depth and stencil tests between Pipeline::beginQuery and endQuery.
+    // Draws run when they are submitted, the result is available after endQuery and kept until the next one.
+    // Queries only read the sample counter, they may overlap.
+    struct OcclusionQuery
+    {
+        U32 samples{0};
+        bool hasResult{false};
+        U32 startSamples{0}; // sample counter of the output merger at beginQuery.
+    };
 
     class Pipeline
     {
@@ -48,6 +62,64 @@ namespace Device {
         FifoStream m_psOutStream;
         FifoStream m_dummyStream;
 
+        // linkage states
+        PipelineStateCache m_stateCache;
+        PipelineState const* m_state;
+
+        // bound pixel shader, replaced by m_visibilityShader while the visibility buffer is on.
+        Shader* m_psShader;
+
+        // screen passes, quads are built from the targets instead of rasterized.
+        static constexpr U32 RESOLVE_BATCH = 4096;
+
+        ShaderProcessor m_resolveProgram;
+        FifoStream m_resolveInStream;
+        FifoStream m_resolveOutStream;
+        std::vector<U32> m_resolveQuads; // x | y << 16 of the quads in m_resolveInStream.
+
+        Shader* m_lightingShader;
+
+        // visibility buffer, the vertex shader output and the pixel shader constants of every draw are kept until it is resolved.
+        struct VisibilityDraw
+        {
+            Shader* psShader;
+            LinearStruct vsOutStruct;
+            std::vector<U8> vertices; // after the perspective divide.
+            std::vector<U32> indices;
+            std::vector<U8> psConstants;                // constants other than textures, in symbol order.
+            std::vector<Texture::Texture2D> psTextures; // views of the Texture2D constants, see Texture2D::view.
+        };
+
+        struct VisibleQuad
+        {
+            U32 position;  // x | y << 16
+            U32 coverage;  // lanes showing the triangle.
+            U32 primitive;
+        };
+
+        bool m_visibility;
+        Shader m_visibilityShader;
+        std::vector<VisibilityDraw> m_visibilityDraws;
+
+    protected:
+        // Rebuild stream layouts and component ports when the pipeline state changes.
+        void bindPipelineState(PipelineState const* state);
+
+        // Streams of m_resolveProgram, returns the in stream element structure.
+        LinearStruct setupResolveStreams();
+
+        // Shade the quads in m_resolveInStream and write them to color target 0.
+        void runResolveBatch();
+
+        // Keep the vertex shader output, indices and pixel shader constants of the current draw.
+        // The recorded draws are resolved first if they use all draw ids.
+        void recordVisibilityDraw();
+
+        // Exchange the constants kept by draw with the ones of its pixel shader, before and after it is resolved.
+        static void swapVisibilityConstants(VisibilityDraw& draw);
+
+        void resolveVisibilityDraw(VisibilityDraw& draw, std::vector<VisibleQuad> const& quads);
+
     public:
         Pipeline();
 
@@ -63,13 +135,80 @@ namespace Device {
 
         void setTargetSize(U32 width, U32 height);
 
+        // Target contents are dropped when a format changes, see OutputMerger for the supported formats.
+        // Sets color target 0 and the depth target.
+        void setTargetFormats(Texture::TexelFormat colorFormat, Texture::TexelFormat depthFormat);
+
+        // Target contents are dropped when the layout changes.
+        void setTargetLayout(Texture::TexelLayout layout);
+
+        // Color target index, UNKNOWN unbinds it. Target 0 is bound by default.
+        void setColorTargetFormat(U32 index, Texture::TexelFormat format);
+
+        // Same blend state for all color targets.
+        void setBlendState(BlendState const& state);
+
+        void setBlendState(U32 index, BlendState const& state);
+
+        // Deferred shading, draws write the G-buffer to color targets 1 to 5 through loadPS_GBuffer,
+        // drawDeferredLighting then shades every pixel with a written depth once into color target 0.
+        // Binds the G-buffer targets, or unbinds them if enable is false.
+        void setDeferred(bool enable);
+
+        // Inputs are read from the G-buffer by semantic: SV_Position, Position0, Normal0, Texcoord0 and the texcoord
+        // derivatives Texcoord1 and Texcoord2, see loadPS_SimpleLighting.
+        void setLightingProgram(Shader& shader);
+
+        // Full screen lighting pass, the cost is bound by the target size instead of the overdraw.
+        void drawDeferredLighting();
+
+        // Visibility buffer, draws only write the depth and the draw and triangle id of every pixel to color target 1
+        // (R32_UINT) through loadPS_Visibility, their pixel shaders run in resolveVisibility once per visible pixel.
+        // Binds the id target, or unbinds it if enable is false. Not combined with setDeferred, both use target 1.
+        void setVisibilityBuffer(bool enable);
+
+        // Shades the pixels of the draws since the last clear or resolve into color target 0.
+        // Each draw is shaded with the pixel shader constants and textures it was drawn with. Textures are not copied,
+        // the textures bound to a draw must stay alive and keep their texels until it is resolved: bind a view of a
+        // texture, see Texture2D::view, instead of uploading the next one into the same constant.
+        // Draws past VISIBILITY_MAX_DRAWS resolve the earlier ones, pixels they cover again are shaded twice,
+        // which only differs with blending on color target 0. A draw of more than VISIBILITY_MAX_PRIMITIVES
+        // triangles aborts.
+        void resolveVisibility();
+
+        // Ignored without the D24_UNORM_S8_UINT depth format. A read only state is tested before the pixel shader as well,
+        // rejected pixels are never shaded, see StencilState::isReadOnly.
+        void setStencilState(StencilState const& state);
+
+        // Occlusion tests draw cheap proxies with depth writes off and a blend state with writeMask 0.
+        void setDepthWrite(bool enable);
+
+        void beginQuery(OcclusionQuery& query);
+
+        void endQuery(OcclusionQuery& query);
+
+        // Lazy, see OutputMerger::clear. The stencil clears to 0.
+        void clear(Vec3f const& color, float depth);
+
+        void clear(Vec3f const& color, float depth, U8 stencil);
+
         void present() const;
 
+        // Read back, tiles with a pending clear are filled first.
+        Texture::Texture2D const& getColorTarget(U32 index);
+
+        Texture::Texture2D const& getDepthTarget();
+
         void setupComponents();
 
         // this function draws everything in the vertex and index buffer.
         void drawIndexed();
 
+        // Predicated draw, skipped before the vertex shader if predicate has a result of zero samples.
+        // The result is the one of the last endQuery of predicate, a query never ended draws. beginQuery keeps
+        // the result, so a query of the previous frame can be reissued for the next one before this draw.
+        void drawIndexed(OcclusionQuery const& predicate);
+
         void drawIndexed(U32 ibStart, U32 count);
     };
 }
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include "utils.h"
+#include "pipeline_state.h"
+
+namespace Device {
+
+    bool PipelineStateDesc::operator== (PipelineStateDesc const& other) const
+    {
+        return vsShaderId == other.vsShaderId &&
+            psShaderId == other.psShaderId &&
+            vertexLayout == other.vertexLayout &&
+            std::equal(colorFormats, colorFormats + MAX_COLOR_TARGETS, other.colorFormats) &&
+            depthFormat == other.depthFormat;
+    }
+
+    std::size_t PipelineStateDesc::hash() const
+    {
+        std::size_t seed = 0;
+        hashCombine(seed, vsShaderId);
+        hashCombine(seed, psShaderId);
+        for (Semantic const& semantic : vertexLayout)
+        {
+            hashCombine(seed, (U32)semantic.name);
+            hashCombine(seed, semantic.index);
+        }
+        for (Texture::TexelFormat format : colorFormats)
+        {
+            hashCombine(seed, (U32)format);
+        }
+        hashCombine(seed, (U32)depthFormat);
+        return seed;
+    }
+
+    // Adapts a list of channel semantics to the stream interface used by mapCompPortToStreamChannel.
+    class SemanticChannels
+    {
+    protected:
+        SemanticMap m_lookup;
+        U32 m_numChannels;
+
+    public:
+        SemanticChannels(std::vector<Semantic> const& semantics)
+            : m_lookup{}
+            , m_numChannels{(U32)semantics.size()}
+        {
+            for (U32 channel = 0; channel < m_numChannels; ++channel)
+            {
+                m_lookup.set(semantics[channel], channel);
+            }
+        }
+
+        U32 getChannelIndex(Semantic const& semantic) const
+        {
+            return m_lookup.get(semantic, m_numChannels);
+        }
+
+        U32 numChannels() const
+        {
+            return m_numChannels;
+        }
+    };
+
+    // Channels of a stream are the io ports of the component feeding or draining it.
+    template <typename Component>
+    static LinearStruct makeStreamStruct(Component const& comp, Comp::IOType io)
+    {
+        LinearStruct structure;
+
+        U32 numPorts = comp.getNumPorts(io);
+        for (U32 portIndex = 0; portIndex < numPorts; ++ portIndex)
+        {
+            structure.addField(comp.getSemantic(io, portIndex), comp.getType(io, portIndex));
+        }
+        return structure;
+    }
+
+    static SemanticChannels toChannels(LinearStruct const& structure)
+    {
+        std::vector<Semantic> semantics;
+        for (U32 fieldIndex = 0; fieldIndex < structure.numFields(); ++fieldIndex)
+        {
+            semantics.push_back(structure.getFieldSemantic(fieldIndex));
+        }
+        return SemanticChannels{semantics};
+    }
+
+    InterpolationPlan makeInterpolationPlan(LinearStruct const& vsOutStruct, ShaderProcessor const& psProgram, LinearStruct const& psInStruct)
+    {
+        InterpolationPlan plan;
+
+        SemanticChannels vsOutChannels = toChannels(vsOutStruct);
+        U32 numVaryings = psProgram.getNumPorts(Comp::Input);
+        for (U32 port = 0; port < numVaryings; ++port)
+        {
+            Semantic const& semantic = psProgram.getSemantic(Comp::Input, port);
+            U32 channel = vsOutChannels.getChannelIndex(semantic);
+
+            if (semantic == Semantic::SV_Coverage || semantic == Semantic::SV_PrimitiveID)
+            {
+                // generated by the rasterizer.
+                continue;
+            }
+
+            if (channel == vsOutChannels.numChannels())
+            {
+                // pixel shader input is required but not provided by vertex shader.
+                assert(!psProgram.isRequired(Comp::Input, port));
+                continue;
+            }
+
+            Type const& type = psProgram.getType(Comp::Input, port);
+
+            // varyings are interpolated in their storage type, vs and ps must agree on it.
+            assert(vsOutStruct.getFieldType(channel) == type);
+
+            plan.varyings.push_back(Varying{
+                vsOutStruct.getFieldOffset(channel),
+                psInStruct.getFieldOffset(port),
+                type,
+                selectVaryingFunc(type)});
+        }
+        plan.kernel = selectInterpolateKernel(plan.varyings);
+        return plan;
+    }
+
+    PipelineState::PipelineState(
+        PipelineStateDesc const& desc,
+        ShaderProcessor const& vsProgram,
+        PrimitiveAssembler const& primitiveAssembler,
+        Rasterizer const& rasterizer,
+        ShaderProcessor const& psProgram,
+        OutputMerger const& outputMerger)
+        : m_desc(desc)
+    {
+        // stream layouts
+        m_streamStructs[VSOutStream] = makeStreamStruct(vsProgram, Comp::Output);
+        m_streamStructs[PAOutStream] = makeStreamStruct(primitiveAssembler, Comp::Output);
+        m_streamStructs[PSInStream] = makeStreamStruct(psProgram, Comp::Input);
+        // TODO: should adjust to output merger?
+        m_streamStructs[PSOutStream] = makeStreamStruct(psProgram, Comp::Output);
+
+        // pixels travel in 2x2 quads from the rasterizer to the output merger.
+        m_streamStructs[PSInStream].setNumLanes(QUAD_LANES);
+        m_streamStructs[PSOutStream].setNumLanes(QUAD_LANES);
+
+        SemanticChannels vsInChannels{desc.vertexLayout};
+        SemanticChannels vsOutChannels = toChannels(m_streamStructs[VSOutStream]);
+        SemanticChannels paOutChannels = toChannels(m_streamStructs[PAOutStream]);
+        SemanticChannels psInChannels = toChannels(m_streamStructs[PSInStream]);
+        SemanticChannels psOutChannels = toChannels(m_streamStructs[PSOutStream]);
+
+        // [inputAssember] -> vsInStream -> [vsProgram] -> vsOutStream
+        m_linkages[VSStage].portToChannel[Comp::Input] = mapCompPortToStreamChannel(vsProgram, vsInChannels, Comp::Input);
+        m_linkages[VSStage].portToChannel[Comp::Output] = mapCompPortToStreamChannel(vsProgram, vsOutChannels, Comp::Output);
+
+        // [inputAssember] -> paInStream -> [primitiveAssembler] -> paOutStream
+        // Note: index stream has exactly one channel.
+        m_linkages[PAStage].portToChannel[Comp::Input].assign(primitiveAssembler.getNumPorts(Comp::Input), 0u);
+        m_linkages[PAStage].portToChannel[Comp::Output] = mapCompPortToStreamChannel(primitiveAssembler, paOutChannels, Comp::Output);
+
+        // paOutStream -> [rasterizer] -> psInStream
+        // Note: rasterizer output ports are adjusted to psProgram input ports.
+        m_linkages[RasterStage].portToChannel[Comp::Input] = mapCompPortToStreamChannel(rasterizer, paOutChannels, Comp::Input);
+        m_linkages[RasterStage].portToChannel[Comp::Output] = mapCompPortToStreamChannel(psProgram, psInChannels, Comp::Input);
+
+        // psInStream -> [psProgram] -> psOutStream
+        m_linkages[PSStage].portToChannel[Comp::Input] = mapCompPortToStreamChannel(psProgram, psInChannels, Comp::Input);
+        m_linkages[PSStage].portToChannel[Comp::Output] = mapCompPortToStreamChannel(psProgram, psOutChannels, Comp::Output);
+
+        // psOutStream -> [outputMerger]
+        m_linkages[OMStage].portToChannel[Comp::Input] = mapCompPortToStreamChannel(outputMerger, psOutChannels, Comp::Input);
+        m_linkages[OMStage].portToChannel[Comp::Output].assign(outputMerger.getNumPorts(Comp::Output), UINT_MAX);
+
+        // interpolation plan, psProgram inputs are fetched from vertex shader output.
+        m_interpPlan = makeInterpolationPlan(m_streamStructs[VSOutStream], psProgram, m_streamStructs[PSInStream]);
+    }
+
+    PipelineState const* PipelineStateCache::acquire(
+        PipelineStateDesc const& desc,
+        ShaderProcessor const& vsProgram,
+        PrimitiveAssembler const& primitiveAssembler,
+        Rasterizer const& rasterizer,
+        ShaderProcessor const& psProgram,
+        OutputMerger const& outputMerger)
+    {
+        StateMap::iterator itr = m_states.find(desc);
+        if (itr != m_states.end())
+        {
+            return itr->second.get();
+        }
+
+        PipelineState* state = new PipelineState{desc, vsProgram, primitiveAssembler, rasterizer, psProgram, outputMerger};
+        m_states[desc] = std::unique_ptr<PipelineState>(state);
+        return state;
+    }
+
+    U32 PipelineStateCache::size() const
+    {
+        return m_states.size();
+    }
+
+} // namespace Device
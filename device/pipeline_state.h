@@ -0,0 +1,116 @@
+#ifndef _PIPELINE_STATE_H_
+#define _PIPELINE_STATE_H_
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "semantic.h"
+#include "buffer.h"
+#include "shader.h"
+#include "texture.h"
+#include "component.h"
+#include "rasterizer.h"
+#include "primitive_assembler.h"
+#include "shader_processor.h"
+#include "output_merger.h"
+
+namespace Device {
+
+    // The tuple a pipeline state is built from, also used as the cache key.
+    struct PipelineStateDesc
+    {
+        U32 vsShaderId; // Shader::getId, not the address, a shader may be rebuilt at the same address.
+        U32 psShaderId;
+        std::vector<Semantic> vertexLayout; // vertex buffer channel semantics, in channel order.
+        Texture::TexelFormat colorFormats[MAX_COLOR_TARGETS]; // UNKNOWN if unbound.
+        Texture::TexelFormat depthFormat;
+
+        bool operator== (PipelineStateDesc const& other) const;
+
+        std::size_t hash() const;
+    };
+
+    struct PipelineStateDescHasher
+    {
+        std::size_t operator()(PipelineStateDesc const& desc) const
+        {
+            return desc.hash();
+        }
+    };
+
+    // Immutable linkage information of a pipeline, everything that only depends on
+    // the shaders, the vertex layout and the target formats is computed once here.
+    class PipelineState
+    {
+    public:
+        enum Stage
+        {
+            VSStage,
+            PAStage,
+            RasterStage,
+            PSStage,
+            OMStage,
+            StageCnt,
+        };
+
+        enum Stream
+        {
+            VSOutStream,
+            PAOutStream,
+            PSInStream,
+            PSOutStream,
+            StreamCnt,
+        };
+
+    protected:
+        PipelineStateDesc m_desc;
+
+        LinearStruct m_streamStructs[StreamCnt];
+        PortLinkage m_linkages[StageCnt];
+        InterpolationPlan m_interpPlan;
+
+    public:
+        PipelineState(
+            PipelineStateDesc const& desc,
+            ShaderProcessor const& vsProgram,
+            PrimitiveAssembler const& primitiveAssembler,
+            Rasterizer const& rasterizer,
+            ShaderProcessor const& psProgram,
+            OutputMerger const& outputMerger);
+
+        inline PipelineStateDesc const& getDesc() const { return m_desc; }
+
+        inline LinearStruct const& getStreamStruct(Stream stream) const { return m_streamStructs[stream]; }
+
+        inline PortLinkage const& getLinkage(Stage stage) const { return m_linkages[stage]; }
+
+        inline InterpolationPlan const& getInterpolationPlan() const { return m_interpPlan; }
+    };
+
+    // psProgram inputs fetched from the vertex shader outputs, inputs generated by the rasterizer are skipped.
+    InterpolationPlan makeInterpolationPlan(LinearStruct const& vsOutStruct, ShaderProcessor const& psProgram, LinearStruct const& psInStruct);
+
+    // Owns all pipeline states ever built, states are never evicted so pointers stay valid.
+    class PipelineStateCache
+    {
+    protected:
+        typedef std::unordered_map<PipelineStateDesc, std::unique_ptr<PipelineState>, PipelineStateDescHasher> StateMap;
+        StateMap m_states;
+
+    public:
+        // Returns the cached state matching desc, build a new one on miss.
+        PipelineState const* acquire(
+            PipelineStateDesc const& desc,
+            ShaderProcessor const& vsProgram,
+            PrimitiveAssembler const& primitiveAssembler,
+            Rasterizer const& rasterizer,
+            ShaderProcessor const& psProgram,
+            OutputMerger const& outputMerger);
+
+        U32 size() const;
+    };
+
+} // namespace Device
+
+#endif // _PIPELINE_STATE_H_
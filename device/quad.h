@@ -0,0 +1,78 @@
+#ifndef _QUAD_H_
+#define _QUAD_H_
+
+#include <cassert>
+
+#include "vmath.h"
+
+namespace Device {
+
+    // Pixels are rasterized and shaded in 2x2 quads, lane = x + 2 * y, x grows right and y grows up.
+    // Uncovered lanes of a quad are helper lanes, their inputs are interpolated so derivatives
+    // are defined, but they are never shaded nor written to the targets.
+    static constexpr U32 QUAD_LANES = 4;
+
+    // Coverage mask of a quad, bit n is set if lane n is covered.
+    inline bool isLaneCovered(U32 coverage, U32 lane)
+    {
+        return (coverage & (1u << lane)) != 0;
+    }
+
+    // Pixel shader input with derivatives, bound by the shader processor like a plain input pointer,
+    // it also points to the same input of every lane of the quad, see ddx and ddy.
+    struct QuadInputSlot
+    {
+        U8 const* value;           // input of the current invocation, first so it binds as a plain input.
+        U8 const* const* laneData; // QUAD_LANES entries, null outside quad dispatch.
+        U32 lane;                  // lane of the current invocation.
+    };
+
+    // Typed QuadInputSlot, reads like the input pointer it replaces. Register it with Shader::addSymbol(..., quad = true).
+    template <typename T>
+    struct QuadIn
+    {
+        QuadInputSlot slot;
+
+        inline T const& operator*() const { return *reinterpret_cast<T const*>(slot.value); }
+
+        inline T const* operator->() const { return reinterpret_cast<T const*>(slot.value); }
+    };
+
+    // Component-wise difference of one shader input between two lanes, only float based inputs are supported.
+    template <typename T>
+    inline T quadDelta(QuadIn<T> const& in, U32 fromLane, U32 toLane)
+    {
+        static_assert(sizeof(T) % sizeof(float) == 0, "derivatives are only defined for float inputs");
+
+        // not bound by a quad dispatch.
+        assert(in.slot.laneData != nullptr);
+        float const* from = reinterpret_cast<float const*>(in.slot.laneData[fromLane]);
+        float const* to = reinterpret_cast<float const*>(in.slot.laneData[toLane]);
+
+        T result;
+        float* out = reinterpret_cast<float*>(&result);
+        for (U32 index = 0; index < sizeof(T) / sizeof(float); ++index)
+        {
+            out[index] = to[index] - from[index];
+        }
+        return result;
+    }
+
+    // Screen space derivatives of a pixel shader input, one pixel apart in the quad.
+    template <typename T>
+    inline T ddx(QuadIn<T> const& in)
+    {
+        U32 const row = in.slot.lane & 2u;
+        return quadDelta(in, row, row | 1u);
+    }
+
+    template <typename T>
+    inline T ddy(QuadIn<T> const& in)
+    {
+        U32 const column = in.slot.lane & 1u;
+        return quadDelta(in, column, column | 2u);
+    }
+
+} // namespace Device
+
+#endif // _QUAD_H_
@@ -1,18 +1,25 @@
 #include <algorithm>
 
 #include "rasterizer.h"
+#include "output_merger.h"
 
 namespace Device {
 
     Rasterizer::Rasterizer()
         : m_width(1)
         , m_height(1)
+        , m_outLaneStride(0)
+        , m_earlyStencil(nullptr)
+        , m_outCoverage(nullptr)
+        , m_outPrimitiveId(nullptr)
     {
         // raster input is connected to primitive assember output.
         addIOPort(Input, std::string("vtx_index"), Type::UINT, Semantic::SV_VertexIndex);
         m_inVtxIdx = getValuePtr(Input, "vtx_index");
 
         m_triIndex = 0;
+        m_triPrimitiveId = 0;
+        m_numTriangles = 0;
     }
 
     void Rasterizer::resize(U32 width, U32 height)
@@ -41,9 +48,14 @@ namespace Device {
         return m_height;
     }
 
-    std::vector<BaryCentricCoff> Rasterizer::rasterizeTriangle(Vec4f const& va, Vec4f const& vb, Vec4f const& vc)
+    void Rasterizer::setEarlyStencil(OutputMerger const* outputMerger)
     {
-        std::vector<BaryCentricCoff> output;
+        m_earlyStencil = outputMerger;
+    }
+
+    std::vector<PixelQuad> Rasterizer::rasterizeTriangle(Vec4f const& va, Vec4f const& vb, Vec4f const& vc)
+    {
+        std::vector<PixelQuad> output;
 
         // setup triangle
         Triangle2D const triangle = setupTriangle(*(Vec2f*)&va, *(Vec2f*)&vb, *(Vec2f*)&vc);
@@ -55,28 +67,48 @@ namespace Device {
         ndcBox.ymin = clamp(std::min({va.y, vb.y, vc.y}), -1.0f, 1.0f);
         ndcBox.ymax = clamp(std::max({va.y, vb.y, vc.y}), -1.0f, 1.0f);
 
-        U32 const width = m_width;
-        U32 const height = m_height;
+        int const width = m_width;
+        int const height = m_height;
 
-        // setup screen space bonding box.
-        int xmin = std::floor(ndcBox.xmin * width); // left
-        int xmax = std::ceil(ndcBox.xmax * width); // right
-        int ymin = std::floor(ndcBox.ymin * height); // bottom
-        int ymax = std::ceil(ndcBox.ymax * height); // top
+        // setup screen space bounding box in pixels, pixel i is centered at (2 * i + 1 - width) / width.
+        AABB<int> box;
+        box.xmin = std::max(0, (int)std::ceil(((ndcBox.xmin + 1.0f) * width - 1.0f) / 2.0f));
+        box.xmax = std::min(width - 1, (int)std::floor(((ndcBox.xmax + 1.0f) * width - 1.0f) / 2.0f));
+        box.ymin = std::max(0, (int)std::ceil(((ndcBox.ymin + 1.0f) * height - 1.0f) / 2.0f));
+        box.ymax = std::min(height - 1, (int)std::floor(((ndcBox.ymax + 1.0f) * height - 1.0f) / 2.0f));
 
-        // Note: the nearest odd number
-        for (int x = xmin / 2 * 2 + 1; x < xmax; x += 2)
+        // walk quads aligned to even pixels.
+        for (int qx = box.xmin & ~1; qx <= box.xmax; qx += 2)
         {
-            for (int y = ymin / 2 * 2 + 1; y < ymax; y += 2)
+            for (int qy = box.ymin & ~1; qy <= box.ymax; qy += 2)
             {
-                Vec2f pixel{float(x)/width, float(y)/height};
-                // TODO: near/far clipping?
-                if (insideTriangle(triangle, pixel))
+                PixelQuad quad;
+                quad.coverage = 0;
+
+                for (U32 lane = 0; lane < QUAD_LANES; ++lane)
                 {
-                    // Prepare(interpolate) pixel input information and pass to pixel shader for rendering.
-                    output.push_back(BaryCentricCoff{});
-                    BaryCentricCoff& coff = output.back();
-                    coff = calcBaryCentricCoordinates(triangle, pixel);
+                    int const x = qx + (lane & 1);
+                    int const y = qy + (lane >> 1);
+                    Vec2f pixel{float(2 * x + 1 - width)/width, float(2 * y + 1 - height)/height};
+
+                    // TODO: near/far clipping?
+                    if (x < width && y < height && insideTriangle(triangle, pixel))
+                    {
+                        quad.coverage |= 1u << lane;
+                    }
+
+                    // helper lanes are interpolated as well, the coefficients extrapolate the triangle.
+                    quad.coffs[lane] = calcBaryCentricCoordinates(triangle, pixel);
+                }
+
+                if (quad.coverage != 0 && m_earlyStencil != nullptr)
+                {
+                    quad.coverage = m_earlyStencil->testStencil(qx, qy, quad.coverage);
+                }
+
+                if (quad.coverage != 0)
+                {
+                    output.push_back(quad);
                 }
             }
         }
@@ -113,15 +145,15 @@ namespace Device {
             vPos.y /= vPos.w;
             vPos.z /= vPos.w;
         }
+
+        // a new draw, primitive ids restart.
+        m_numTriangles = 0;
     }
 
     void Rasterizer::adjustOutputPorts(Comp const& nextComp)
     {
         // clean up old state
-        m_types[Comp::Output].clear();
-        m_symbols[Comp::Output].clear();
-        m_values[Comp::Output].clear();
-        m_semantics[Comp::Output].clear();
+        resetPorts(Comp::Output);
 
         // setup new port stats.
         U32 numPorts = nextComp.getNumPorts(Comp::Input);
@@ -133,6 +165,30 @@ namespace Device {
 
             addIOPort(Comp::Output, name, type, semantic);
         }
+
+        // pixel quad coverage, written by the rasterizer itself.
+        m_outCoverage = getValuePtr(Comp::Output, Semantic::SV_Coverage);
+
+        // primitive id, written by the rasterizer if the next component reads it.
+        m_outPrimitiveId = nullptr;
+        for (U32 portIdx = 0; portIdx < numPorts; ++portIdx)
+        {
+            if (getSemantic(Comp::Output, portIdx) == Semantic::SV_PrimitiveID)
+            {
+                m_outPrimitiveId = getValuePtr(Comp::Output, portIdx);
+            }
+        }
+    }
+
+    void Rasterizer::setInterpolationPlan(InterpolationPlan const& plan)
+    {
+        assert(plan.varyings.size() <= getNumPorts(Comp::Output));
+        m_interpPlan = plan;
+    }
+
+    void Rasterizer::setLaneStride(U32 outLaneStride)
+    {
+        m_outLaneStride = outLaneStride;
     }
 
     bool Rasterizer::isOneInOneOut() const
@@ -152,6 +208,7 @@ namespace Device {
         if (m_triIndex == 3)
         {
             assert(!hasPendingOutput());
+            m_triPrimitiveId = m_numTriangles++;
 
             Vec4f* va = (Vec4f*)m_vsOutBuffer.getElement(m_triVtxIndices[0]).getData(m_vsOutPositionChannel);
             Vec4f* vb = (Vec4f*)m_vsOutBuffer.getElement(m_triVtxIndices[1]).getData(m_vsOutPositionChannel);
@@ -172,43 +229,33 @@ namespace Device {
     void Rasterizer::produceOneOutput()
     {
         assert(m_triProcessed < m_triPending.size());
-        BaryCentricCoff const& coff = m_triPending[m_triProcessed++];
-
-        // TODO: move this after ps and vsout binding.
-        LinearStruct const& structure = m_vsOutBuffer.getElementStruct();
+        PixelQuad const& quad = m_triPending[m_triProcessed++];
 
         // Note: assume rasterizer out ports are bound.
         // Note: rasterizer out ports are dynamically constructed, which matchs psIn
-        U32 numOutPorts = getNumPorts(Output);
-        StreamBuffer::Element element_a = m_vsOutBuffer.getElement(m_triVtxIndices[0]);
-        StreamBuffer::Element element_b = m_vsOutBuffer.getElement(m_triVtxIndices[1]);
-        StreamBuffer::Element element_c = m_vsOutBuffer.getElement(m_triVtxIndices[2]);
+        // Note: output ports are fields of one psIn element, port 0 is at the element start.
+        // Note: the psIn element is a quad, lanes are m_outLaneStride apart.
+        U8* dst = getValuePtr(Comp::Output, 0)->read();
+        U8* coverage = m_outCoverage->read();
+        U8 const* a = m_vsOutBuffer.getElement(m_triVtxIndices[0]).getAddr();
+        U8 const* b = m_vsOutBuffer.getElement(m_triVtxIndices[1]).getAddr();
+        U8 const* c = m_vsOutBuffer.getElement(m_triVtxIndices[2]).getAddr();
+
+        std::vector<Varying> const& varyings = m_interpPlan.varyings;
+        for (U32 lane = 0; lane < QUAD_LANES; ++lane)
+        {
+            U32 const laneOffset = lane * m_outLaneStride;
+            m_interpPlan.kernel(dst + laneOffset, a, b, c, quad.coffs[lane], varyings.data(), varyings.size());
+            *(U32*)(coverage + laneOffset) = quad.coverage;
+        }
 
-        for (U32 outPortIdx = 0; outPortIdx < numOutPorts; ++outPortIdx)
+        if (m_outPrimitiveId != nullptr)
         {
-            Type const& type = getType(Comp::Output, outPortIdx);
-
-            // TODO: cache below values
-            Value va{type}, vb{type}, vc{type};
-            U32 channel = structure.getFieldIndex(getSemantic(Comp::Output, outPortIdx));
-
-            va.bind(element_a.getData(channel));
-            vb.bind(element_b.getData(channel));
-            vc.bind(element_c.getData(channel));
-
-            Value* out = getValuePtr(Comp::Output, outPortIdx);
-            out->interpolate(&va, coff.u, &vb, coff.v, &vc, coff.w);
-
-            // debug
-            //{
-            //    if (outPortIdx == 0)
-            //    {
-            //        // output position
-            //        // std::cout << *out << std::endl; // " " <<  va << " " << vb << " " << vc << std::endl;
-            //        Vec3f pos = out->readAs<Vec3f>();
-            //        std::cout << U32(pos.x * width) << " " << U32(pos.y * height) << std::endl;
-            //    }
-            //}
+            U8* primitiveId = m_outPrimitiveId->read();
+            for (U32 lane = 0; lane < QUAD_LANES; ++lane)
+            {
+                *(U32*)(primitiveId + lane * m_outLaneStride) = m_triPrimitiveId;
+            }
         }
     }
 }
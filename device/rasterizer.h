@@ -5,9 +5,20 @@
 #include "buffer.h"
 #include "geometry.h"
 #include "component.h"
+#include "interpolator.h"
+#include "quad.h"
 
 namespace Device {
 
+    class OutputMerger;
+
+    // A rasterized 2x2 pixel quad, helper lanes have coefficients outside of the triangle.
+    struct PixelQuad
+    {
+        BaryCentricCoff coffs[QUAD_LANES];
+        U32 coverage;
+    };
+
     class Rasterizer: public Comp
     {
     protected:
@@ -17,12 +28,21 @@ namespace Device {
         // rasterizer internal state
         StreamBuffer m_vsOutBuffer;
         U32 m_vsOutPositionChannel;
+        InterpolationPlan m_interpPlan;
+        U32 m_outLaneStride;
+
+        // quads are tested against its stencil before they are shaded, nullptr if disabled.
+        OutputMerger const* m_earlyStencil;
 
         Value* m_inVtxIdx;
+        Value* m_outCoverage;
+        Value* m_outPrimitiveId; // nullptr if the next component does not read SV_PrimitiveID.
 
         U32 m_triVtxIndices[3];
         U32 m_triIndex;
-        std::vector<BaryCentricCoff> m_triPending;
+        U32 m_triPrimitiveId;
+        U32 m_numTriangles; // triangles of the draw so far, restarts in bindVSOutput.
+        std::vector<PixelQuad> m_triPending;
         U32 m_triProcessed;
 
     public:
@@ -38,7 +58,11 @@ namespace Device {
 
         U32 getHeight() const;
 
-        std::vector<BaryCentricCoff> rasterizeTriangle(Vec4f const& va, Vec4f const& vb, Vec4f const& vc);
+        // Pixels failing the stencil test of outputMerger are not covered, the stencil state must be read only.
+        void setEarlyStencil(OutputMerger const* outputMerger);
+
+        // Returns the quads touched by the triangle, quads without any covered pixel are dropped.
+        std::vector<PixelQuad> rasterizeTriangle(Vec4f const& va, Vec4f const& vb, Vec4f const& vc);
 
         void rasterizeLine(Vec2f const& va, Vec2f const& b);
 
@@ -50,6 +74,12 @@ namespace Device {
         // Adjust this component's output ports to next components input port.
         void adjustOutputPorts(Comp const& nextComp);
 
+        // Set the interpolation plan, must match the adjusted output ports.
+        void setInterpolationPlan(InterpolationPlan const& plan);
+
+        // Lane stride of the quad out stream element.
+        void setLaneStride(U32 outLaneStride);
+
         bool isOneInOneOut() const;
 
         void runOne();
@@ -3,6 +3,14 @@
 
 namespace Device {
 
+    constexpr U32 Semantic::INDEX_BITS;
+    constexpr U32 Semantic::MAX_INDEX;
+    constexpr U32 Semantic::NUM_IDS;
+    constexpr U32 Semantic::INVALID_ID;
+    constexpr U32 Semantic::SV_TARGET_BASE;
+    constexpr U32 Semantic::SV_TARGET_COUNT;
+    constexpr U32 SemanticMap::NOT_FOUND;
+
     Semantic const Semantic::Position0 = Semantic{ Semantic::Position, 0};
     Semantic const Semantic::Position1 = Semantic{ Semantic::Position, 1};
     Semantic const Semantic::Position2 = Semantic{ Semantic::Position, 2};
@@ -25,7 +33,18 @@ namespace Device {
 
     Semantic const Semantic::SV_Position = Semantic{ Semantic::SYSTEM_VALUE, 1};
     Semantic const Semantic::SV_Depth = Semantic{ Semantic::SYSTEM_VALUE, 2};
-    Semantic const Semantic::SV_Target = Semantic{ Semantic::SYSTEM_VALUE, 3};
+    Semantic const Semantic::SV_Target = Semantic{ Semantic::SYSTEM_VALUE, Semantic::SV_TARGET_BASE};
     Semantic const Semantic::SV_VertexIndex = Semantic{ Semantic::SYSTEM_VALUE, 4};
+    Semantic const Semantic::SV_Coverage = Semantic{ Semantic::SYSTEM_VALUE, 5};
+    Semantic const Semantic::SV_PrimitiveID = Semantic{ Semantic::SYSTEM_VALUE, 6};
+
+    Semantic const Semantic::SV_Target0 = Semantic{ Semantic::SYSTEM_VALUE, Semantic::SV_TARGET_BASE + 0};
+    Semantic const Semantic::SV_Target1 = Semantic{ Semantic::SYSTEM_VALUE, Semantic::SV_TARGET_BASE + 1};
+    Semantic const Semantic::SV_Target2 = Semantic{ Semantic::SYSTEM_VALUE, Semantic::SV_TARGET_BASE + 2};
+    Semantic const Semantic::SV_Target3 = Semantic{ Semantic::SYSTEM_VALUE, Semantic::SV_TARGET_BASE + 3};
+    Semantic const Semantic::SV_Target4 = Semantic{ Semantic::SYSTEM_VALUE, Semantic::SV_TARGET_BASE + 4};
+    Semantic const Semantic::SV_Target5 = Semantic{ Semantic::SYSTEM_VALUE, Semantic::SV_TARGET_BASE + 5};
+    Semantic const Semantic::SV_Target6 = Semantic{ Semantic::SYSTEM_VALUE, Semantic::SV_TARGET_BASE + 6};
+    Semantic const Semantic::SV_Target7 = Semantic{ Semantic::SYSTEM_VALUE, Semantic::SV_TARGET_BASE + 7};
 
 } // namespace Device
@@ -1,5 +1,7 @@
 #ifndef _SEMANTIC_H_
 #define _SEMANTIC_H_
+#include <cstring>
+
 #include "vmath.h"
 
 namespace Device {
@@ -15,8 +17,16 @@ namespace Device {
             Texcoord,
 
             SYSTEM_VALUE,
+
+            NAME_COUNT,
         };
 
+        // name and index are packed into a compact id, see id().
+        static constexpr U32 INDEX_BITS = 5;
+        static constexpr U32 MAX_INDEX = 1u << INDEX_BITS;
+        static constexpr U32 NUM_IDS = NAME_COUNT << INDEX_BITS;
+        static constexpr U32 INVALID_ID = (U32)INVALID << INDEX_BITS; // id of indices out of range.
+
         EName name;
         U32 index;
 
@@ -40,6 +50,13 @@ namespace Device {
             return !(*this == other);
         }
 
+        // Indices out of range have no id of their own, they map to INVALID_ID.
+        inline U32 id() const
+        {
+            assert(index < MAX_INDEX);
+            return index < MAX_INDEX ? ((U32)name << INDEX_BITS) | index : INVALID_ID;
+        }
+
         static Semantic const Position0;
         static Semantic const Position1;
         static Semantic const Position2;
@@ -62,11 +79,75 @@ namespace Device {
 
         static Semantic const SV_Position;    // SV: output of vertex shader, required by rasterizer
         static Semantic const SV_Depth;       // SV: output of pixel shader, required by depth test
-        static Semantic const SV_Target;      // SV: output of pixel shader, pixel color
+        static Semantic const SV_Target;      // SV: output of pixel shader, pixel color, same as SV_Target0
         static Semantic const SV_VertexIndex; // SV: output of primitive assember, required by rasterizer
+        static Semantic const SV_Coverage;    // SV: output of rasterizer, covered lanes of a pixel quad
+        static Semantic const SV_PrimitiveID; // SV: output of rasterizer, index of the triangle in the draw
+
+        // SV: output of pixel shader, color of render target n
+        static constexpr U32 SV_TARGET_BASE = 8;
+        static constexpr U32 SV_TARGET_COUNT = 8;
+        static Semantic const SV_Target0;
+        static Semantic const SV_Target1;
+        static Semantic const SV_Target2;
+        static Semantic const SV_Target3;
+        static Semantic const SV_Target4;
+        static Semantic const SV_Target5;
+        static Semantic const SV_Target6;
+        static Semantic const SV_Target7;
+
+        static inline Semantic svTarget(U32 index)
+        {
+            assert(index < SV_TARGET_COUNT);
+            return Semantic{SYSTEM_VALUE, SV_TARGET_BASE + index};
+        }
 
         static Semantic const UNKNOWN;
     };
 
+    // Maps semantics to small slot numbers through a flat table indexed by Semantic::id().
+    // Semantics with Semantic::INVALID_ID are never stored, looking them up finds nothing.
+    class SemanticMap
+    {
+    public:
+        static constexpr U32 NOT_FOUND = 0xFF;
+
+    protected:
+        U8 m_slots[Semantic::NUM_IDS];
+
+    public:
+        SemanticMap()
+        {
+            clear();
+        }
+
+        inline void clear()
+        {
+            std::memset(m_slots, NOT_FOUND, sizeof(m_slots));
+        }
+
+        inline void set(Semantic const& semantic, U32 slot)
+        {
+            assert(slot < NOT_FOUND);
+            U32 const id = semantic.id();
+            if (id != Semantic::INVALID_ID)
+            {
+                m_slots[id] = (U8)slot;
+            }
+        }
+
+        inline bool has(Semantic const& semantic) const
+        {
+            return m_slots[semantic.id()] != NOT_FOUND;
+        }
+
+        // Returns the slot of semantic, or notFound if it is not in the map.
+        inline U32 get(Semantic const& semantic, U32 notFound) const
+        {
+            U8 slot = m_slots[semantic.id()];
+            return slot == NOT_FOUND ? notFound : slot;
+        }
+    };
+
 } // namespace Device
 #endif // _SEMANTIC_H_
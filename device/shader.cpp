@@ -1,12 +1,24 @@
 #include <algorithm>
+#include <atomic>
 
 #include "shader.h"
 #include "texture.h"
 
 namespace Device {
-    void Shader::addSymbol(Section section, std::string const& name, Type const& type, Semantic const& semantic, U8* addr)
+    static std::atomic<U32> s_nextShaderId{1};
+
+    Shader::Shader()
+        : m_entryFunc{nullptr}
+        , m_id{s_nextShaderId++}
     {
-        m_symbolSections[section].push_back(Symbol{name, type, semantic, addr});
+    }
+
+    void Shader::addSymbol(Section section, std::string const& name, Type const& type, Semantic const& semantic, U8* addr, bool quad)
+    {
+        assert(!quad || section == Input);
+        m_symbolLookup[section][name] = m_symbolSections[section].size();
+        m_symbolSections[section].push_back(Symbol{name, type, semantic, addr, quad});
+        m_id = s_nextShaderId++;
     }
 
     void Shader::setEntry(Shader::MainEntry mainProc)
@@ -21,20 +33,14 @@ namespace Device {
 
     Shader::Symbol Shader::getSymbol(Section section, std::string const& name) const
     {
-        SymbolList const& symbolSection = m_symbolSections[section];
+        std::unordered_map<std::string, U32>::const_iterator itr = m_symbolLookup[section].find(name);
 
-        std::vector<Symbol>::const_iterator itr = std::find_if(symbolSection.begin(), symbolSection.end(),
-            [&](Symbol const& symbol) -> bool {
-                return symbol.name == name;
-            }
-        );
-
-        if (itr == symbolSection.end())
+        if (itr == m_symbolLookup[section].end())
         {
-            return Shader::Symbol{"", Type{}, Semantic{}, nullptr};
+            return Shader::Symbol{"", Type{}, Semantic{}, nullptr, false};
         }
 
-        return *itr;
+        return m_symbolSections[section][itr->second];
     }
 
     Type Shader::getConstantType(std::string const& name) const
@@ -48,6 +54,11 @@ namespace Device {
     }
 
 
+    U32 Shader::getId() const
+    {
+        return m_id;
+    }
+
     void Shader::execute()
     {
         m_entryFunc();
@@ -57,39 +68,40 @@ namespace Device {
     #define SHADER_OUT static
     #define SHADER_CONST static
     #define SHADER_MAIN static
+    // Shader inputs and outputs are pointers, bound in place to stream memory per invocation.
     namespace VSSimple
     {
-        SHADER_IN Vec3f inPosition;
-        SHADER_IN Vec3f inNormal;
-        SHADER_IN Vec2f inTexCoord;
-        SHADER_IN Vec3f inColor;
+        SHADER_IN Vec3f const* inPosition;
+        SHADER_IN Vec3f const* inNormal;
+        SHADER_IN Vec2f const* inTexCoord;
+        SHADER_IN Vec3f const* inColor;
 
-        SHADER_OUT Vec4f outPosClip;
-        SHADER_OUT Vec3f outPosView;
-        SHADER_OUT Vec3f outColor;
-        SHADER_OUT Vec3f outNormal;
-        SHADER_OUT Vec2f outTexCoord;
+        SHADER_OUT Vec4f* outPosClip;
+        SHADER_OUT Vec3f* outPosView;
+        SHADER_OUT Vec3f* outColor;
+        SHADER_OUT Vec3f* outNormal;
+        SHADER_OUT Vec2f* outTexCoord;
 
         SHADER_CONST Mat44f mWorldView;
         SHADER_CONST Mat44f mWorldViewProj;
 
         static void vs_main()
         {
-            Vec4f pos{inPosition.x, inPosition.y, inPosition.z, 1.0};
+            Vec4f pos{inPosition->x, inPosition->y, inPosition->z, 1.0};
 
             Vec4f posView = mWorldView * pos;
-            outPosView = {posView.x, posView.y, posView.z};
+            *outPosView = {posView.x, posView.y, posView.z};
 
-            outPosClip = mWorldViewProj * pos;
-            // std::cout << "VS: " << outPosClip << std::endl;
+            *outPosClip = mWorldViewProj * pos;
+            // std::cout << "VS: " << *outPosClip << std::endl;
 
-            outColor = inColor;
-            outTexCoord = inTexCoord;
+            *outColor = *inColor;
+            *outTexCoord = *inTexCoord;
 
             // TODO: direct Mat44f * Vec3f?
-            Vec4f normal = {inNormal.x, inNormal.y, inNormal.z, 0};
+            Vec4f normal = {inNormal->x, inNormal->y, inNormal->z, 0};
             normal = mWorldView * normal;
-            outNormal = {normal.x, normal.y, normal.z};
+            *outNormal = {normal.x, normal.y, normal.z};
         }
     }
 
@@ -104,9 +116,10 @@ namespace Device {
 
         shader.addSymbol(Shader::Output   , std::string("posClip")        , Type::FLOAT4   , Semantic::SV_Position , (U8*)&VSSimple::outPosClip);
         shader.addSymbol(Shader::Output   , std::string("posView")        , Type::FLOAT3   , Semantic::Position0   , (U8*)&VSSimple::outPosView);
-        shader.addSymbol(Shader::Output   , std::string("normal")         , Type::FLOAT3   , Semantic::Normal0     , (U8*)&VSSimple::outNormal);
-        shader.addSymbol(Shader::Output   , std::string("color")          , Type::FLOAT3   , Semantic::Color0      , (U8*)&VSSimple::outColor);
-        shader.addSymbol(Shader::Output   , std::string("texcoord")       , Type::FLOAT2   , Semantic::Texcoord0   , (U8*)&VSSimple::outTexCoord);
+        // normal, color and texcoord do not need fp32, store them as half in the stream.
+        shader.addSymbol(Shader::Output   , std::string("normal")         , Type::HALF3    , Semantic::Normal0     , (U8*)&VSSimple::outNormal);
+        shader.addSymbol(Shader::Output   , std::string("color")          , Type::HALF3    , Semantic::Color0      , (U8*)&VSSimple::outColor);
+        shader.addSymbol(Shader::Output   , std::string("texcoord")       , Type::HALF2    , Semantic::Texcoord0   , (U8*)&VSSimple::outTexCoord);
 
         shader.addSymbol(Shader::Constant , std::string("mWorldView")     , Type::FLOAT4X4 , Semantic{}            , (U8*)&VSSimple::mWorldView);
         shader.addSymbol(Shader::Constant , std::string("mWorldViewProj") , Type::FLOAT4X4 , Semantic{}            , (U8*)&VSSimple::mWorldViewProj);
@@ -118,14 +131,14 @@ namespace Device {
 
     namespace PSSimple
     {
-        SHADER_IN Vec4f inPosClip;
-        SHADER_IN Vec3f inPosView;
-        SHADER_IN Vec3f inColor;
-        SHADER_IN Vec3f inNormal;
-        SHADER_IN Vec2f inTexCoord;
+        SHADER_IN Vec4f const* inPosClip;
+        SHADER_IN Vec3f const* inPosView;
+        SHADER_IN Vec3f const* inColor;
+        SHADER_IN Vec3f const* inNormal;
+        SHADER_IN QuadIn<Vec2f> inTexCoord;
 
-        SHADER_OUT Vec3f outPosition;
-        SHADER_OUT Vec3f outColor;
+        SHADER_OUT Vec3f* outPosition;
+        SHADER_OUT Vec3f* outColor;
 
         SHADER_CONST Vec3f cLightPos;
         SHADER_CONST Vec3f cLightAmbient;
@@ -139,22 +152,13 @@ namespace Device {
         SHADER_CONST Texture::Sampler2D cSampler0;
         SHADER_CONST Texture::Texture2D cTexture0;
 
-        static void Blinn_Phong();
         // [ref](https://en.wikipedia.org/wiki/Blinn%E2%80%93Phong_shading_model)
-        static void ps_main()
-        {
-            // TODO: do we need to pass by this info in PS?
-            outPosition = {inPosClip.x, inPosClip.y, inPosClip.z};
-            // std::cout << "PS: " << inPosClip << std::endl;
-
-            // outColor = inColor;
-            Blinn_Phong();
-        }
-
-        static void Blinn_Phong()
+        // Shared by the forward and the deferred lighting shaders, texCoordDdx and texCoordDdy select the mip level.
+        static Vec3f Blinn_Phong(Vec3f const& posView, Vec3f const& normalView, Texture::Texture2D const& texture, Texture::Sampler2D const& sampler,
+            Vec2f const& texCoord, Vec2f const& texCoordDdx, Vec2f const& texCoordDdy)
         {
-            Vec3f normal = normalize(inNormal);
-            Vec3f lightDir = cLightPos - inPosView;
+            Vec3f normal = normalize(normalView);
+            Vec3f lightDir = cLightPos - posView;
 
             float distance = lightDir.length();
             distance = distance * distance;
@@ -164,7 +168,7 @@ namespace Device {
             float specular = 0.0;
 
             if(lambertian > 0.0) {
-                Vec3f viewDir = normalize(0.0f - inPosView);
+                Vec3f viewDir = normalize(0.0f - posView);
 
                 // this is blinn phong
                 Vec3f halfDir = normalize(lightDir + viewDir);
@@ -179,15 +183,42 @@ namespace Device {
             Vec3f specularLinear = specular * cLightSpecular * cLightPower / distance;
 
             Vec3f lightColor = ambientLinear + diffuseLinear + specularLinear;
-            Vec4f texColor = Texture::Sample(cTexture0, cSampler0, inTexCoord);
-            outColor = lightColor * Vec3f{texColor.x, texColor.y, texColor.z};
+            Vec4f texColor = Texture::SampleGrad(texture, sampler, texCoord, texCoordDdx, texCoordDdy);
+            // the color is linear, textures are sRGB decoded on fetch and targets encode on present.
+            // Note: cLightAmbient, cLightDiffuse and cLightSpecular are linear as well.
+            return lightColor * Vec3f{texColor.x, texColor.y, texColor.z};
+        }
 
-            // apply gamma correction (assume cLightAmbient, cLightDiffuse and cLightSpecular
-            // have been linearized, i.e. have no gamma correction in them)
-            // Vec3f colorGammaCorrected = pow(colorLinear, Vec3f(1.0/screenGamma));
+        static void ps_main()
+        {
+            // TODO: do we need to pass by this info in PS?
+            *outPosition = {inPosClip->x, inPosClip->y, inPosClip->z};
+            // std::cout << "PS: " << *inPosClip << std::endl;
+
+            // *outColor = *inColor;
+            *outColor = Blinn_Phong(*inPosView, *inNormal, cTexture0, cSampler0, *inTexCoord, ddx(inTexCoord), ddy(inTexCoord));
+        }
+
+        // Deferred lighting, inputs are read from the G-buffer, see loadPS_GBuffer.
+        // Each material id has its own texture, the light is shared with ps_main.
+        static constexpr U32 NUM_MATERIALS = 4;
+
+        SHADER_IN Vec3f const* inGPosView;
+        SHADER_IN Vec3f const* inGNormal;
+        SHADER_IN Vec3f const* inGTexCoordMaterial;
+        SHADER_IN Vec3f const* inGTexCoordDdx;
+        SHADER_IN Vec3f const* inGTexCoordDdy;
+
+        SHADER_OUT Vec3f* outLitColor;
+
+        SHADER_CONST Texture::Sampler2D cMaterialSamplers[NUM_MATERIALS];
+        SHADER_CONST Texture::Texture2D cMaterialTextures[NUM_MATERIALS];
 
-            // use the gamma corrected color in the fragment
-            // gl_FragColor = vec4(colorGammaCorrected, 1.0);
+        static void ps_lighting_main()
+        {
+            U32 const material = std::min((U32)inGTexCoordMaterial->z, NUM_MATERIALS - 1);
+            *outLitColor = Blinn_Phong(*inGPosView, *inGNormal, cMaterialTextures[material], cMaterialSamplers[material],
+                Vec2f{inGTexCoordMaterial->x, inGTexCoordMaterial->y}, Vec2f{inGTexCoordDdx->x, inGTexCoordDdx->y}, Vec2f{inGTexCoordDdy->x, inGTexCoordDdy->y});
         }
     }
 
@@ -197,9 +228,9 @@ namespace Device {
 
         shader.addSymbol(Shader::Input    , std::string("posClip")         , Type::FLOAT4    , Semantic::SV_Position , (U8*)&PSSimple::inPosClip);
         shader.addSymbol(Shader::Input    , std::string("posView")         , Type::FLOAT3    , Semantic::Position0   , (U8*)&PSSimple::inPosView);
-        shader.addSymbol(Shader::Input    , std::string("normal")          , Type::FLOAT3    , Semantic::Normal0     , (U8*)&PSSimple::inNormal);
-        shader.addSymbol(Shader::Input    , std::string("color")           , Type::FLOAT3    , Semantic::Color0      , (U8*)&PSSimple::inColor);
-        shader.addSymbol(Shader::Input    , std::string("texcoord")        , Type::FLOAT2    , Semantic::Texcoord0   , (U8*)&PSSimple::inTexCoord);
+        shader.addSymbol(Shader::Input    , std::string("normal")          , Type::HALF3     , Semantic::Normal0     , (U8*)&PSSimple::inNormal);
+        shader.addSymbol(Shader::Input    , std::string("color")           , Type::HALF3     , Semantic::Color0      , (U8*)&PSSimple::inColor);
+        shader.addSymbol(Shader::Input    , std::string("texcoord")        , Type::HALF2     , Semantic::Texcoord0   , (U8*)&PSSimple::inTexCoord, true);
 
         shader.addSymbol(Shader::Output   , std::string("position")        , Type::FLOAT3    , Semantic::SV_Position , (U8*)&PSSimple::outPosition);
         shader.addSymbol(Shader::Output   , std::string("color")           , Type::FLOAT3    , Semantic::SV_Target   , (U8*)&PSSimple::outColor);
@@ -221,6 +252,213 @@ namespace Device {
         return shader;
     }
 
+    Shader loadPS_SimpleLighting()
+    {
+        Shader shader;
+
+        shader.addSymbol(Shader::Input    , std::string("posView")         , Type::FLOAT3    , Semantic::Position0   , (U8*)&PSSimple::inGPosView);
+        shader.addSymbol(Shader::Input    , std::string("normal")          , Type::FLOAT3    , Semantic::Normal0     , (U8*)&PSSimple::inGNormal);
+        shader.addSymbol(Shader::Input    , std::string("texcoordMaterial"), Type::FLOAT3    , Semantic::Texcoord0   , (U8*)&PSSimple::inGTexCoordMaterial);
+        shader.addSymbol(Shader::Input    , std::string("texcoordDdx")     , Type::FLOAT3    , Semantic::Texcoord1   , (U8*)&PSSimple::inGTexCoordDdx);
+        shader.addSymbol(Shader::Input    , std::string("texcoordDdy")     , Type::FLOAT3    , Semantic::Texcoord2   , (U8*)&PSSimple::inGTexCoordDdy);
+
+        shader.addSymbol(Shader::Output   , std::string("color")           , Type::FLOAT3    , Semantic::SV_Target   , (U8*)&PSSimple::outLitColor);
+
+        shader.addSymbol(Shader::Constant , std::string("cLightPos")       , Type::FLOAT3    , Semantic{}            , (U8*)&PSSimple::cLightPos);
+        shader.addSymbol(Shader::Constant , std::string("cLightAmbient")   , Type::FLOAT3    , Semantic{}            , (U8*)&PSSimple::cLightAmbient);
+        shader.addSymbol(Shader::Constant , std::string("cLightDiffuse")   , Type::FLOAT3    , Semantic{}            , (U8*)&PSSimple::cLightDiffuse);
+        shader.addSymbol(Shader::Constant , std::string("cLightSpecular")  , Type::FLOAT3    , Semantic{}            , (U8*)&PSSimple::cLightSpecular);
+        shader.addSymbol(Shader::Constant , std::string("cLightPower")     , Type::FLOAT     , Semantic{}            , (U8*)&PSSimple::cLightPower);
+        shader.addSymbol(Shader::Constant , std::string("cLightShininess") , Type::FLOAT     , Semantic{}            , (U8*)&PSSimple::cLightShininess);
+        for (U32 material = 0; material < PSSimple::NUM_MATERIALS; ++material)
+        {
+            shader.addSymbol(Shader::Constant , "cSampler" + std::to_string(material), Type::Sampler2D , Semantic{}, (U8*)&PSSimple::cMaterialSamplers[material]);
+            shader.addSymbol(Shader::Constant , "cTexture" + std::to_string(material), Type::Texture2D , Semantic{}, (U8*)&PSSimple::cMaterialTextures[material]);
+        }
+
+        shader.setEntry(&PSSimple::ps_lighting_main);
+
+        return shader;
+    }
+
+    namespace PSGBuffer
+    {
+        SHADER_IN Vec4f const* inPosClip;
+        SHADER_IN Vec3f const* inPosView;
+        SHADER_IN Vec3f const* inNormal;
+        SHADER_IN QuadIn<Vec2f> inTexCoord;
+
+        SHADER_OUT Vec3f* outPosition;
+        SHADER_OUT Vec3f* outPosView;
+        SHADER_OUT Vec3f* outNormal;
+        SHADER_OUT Vec3f* outTexCoordMaterial;
+        SHADER_OUT Vec3f* outTexCoordDdx;
+        SHADER_OUT Vec3f* outTexCoordDdy;
+
+        SHADER_CONST float cMaterialId;
+
+        static void ps_main()
+        {
+            *outPosition = {inPosClip->x, inPosClip->y, inPosClip->z};
+            *outPosView = *inPosView;
+            *outNormal = normalize(*inNormal);
+            *outTexCoordMaterial = {inTexCoord->x, inTexCoord->y, cMaterialId};
+
+            // helper lanes of the draw are only available here, the lighting pass reads the derivatives back.
+            Vec2f const texCoordDdx = ddx(inTexCoord);
+            Vec2f const texCoordDdy = ddy(inTexCoord);
+            *outTexCoordDdx = {texCoordDdx.x, texCoordDdx.y, 0.0f};
+            *outTexCoordDdy = {texCoordDdy.x, texCoordDdy.y, 0.0f};
+        }
+    }
+
+    Shader loadPS_GBuffer()
+    {
+        Shader shader;
+
+        shader.addSymbol(Shader::Input    , std::string("posClip")         , Type::FLOAT4    , Semantic::SV_Position , (U8*)&PSGBuffer::inPosClip);
+        shader.addSymbol(Shader::Input    , std::string("posView")         , Type::FLOAT3    , Semantic::Position0   , (U8*)&PSGBuffer::inPosView);
+        shader.addSymbol(Shader::Input    , std::string("normal")          , Type::HALF3     , Semantic::Normal0     , (U8*)&PSGBuffer::inNormal);
+        shader.addSymbol(Shader::Input    , std::string("texcoord")        , Type::HALF2     , Semantic::Texcoord0   , (U8*)&PSGBuffer::inTexCoord, true);
+
+        shader.addSymbol(Shader::Output   , std::string("position")        , Type::FLOAT3    , Semantic::SV_Position , (U8*)&PSGBuffer::outPosition);
+        shader.addSymbol(Shader::Output   , std::string("posView")         , Type::FLOAT3    , Semantic::SV_Target1  , (U8*)&PSGBuffer::outPosView);
+        shader.addSymbol(Shader::Output   , std::string("normal")          , Type::FLOAT3    , Semantic::SV_Target2  , (U8*)&PSGBuffer::outNormal);
+        shader.addSymbol(Shader::Output   , std::string("texcoordMaterial"), Type::FLOAT3    , Semantic::SV_Target3  , (U8*)&PSGBuffer::outTexCoordMaterial);
+        shader.addSymbol(Shader::Output   , std::string("texcoordDdx")     , Type::FLOAT3    , Semantic::SV_Target4  , (U8*)&PSGBuffer::outTexCoordDdx);
+        shader.addSymbol(Shader::Output   , std::string("texcoordDdy")     , Type::FLOAT3    , Semantic::SV_Target5  , (U8*)&PSGBuffer::outTexCoordDdy);
+
+        shader.addSymbol(Shader::Constant , std::string("cMaterialId")     , Type::FLOAT     , Semantic{}            , (U8*)&PSGBuffer::cMaterialId);
+
+        shader.setEntry(&PSGBuffer::ps_main);
+
+        return shader;
+    }
+
+    namespace PSVisibility
+    {
+        SHADER_IN Vec4f const* inPosClip;
+        SHADER_IN U32 const* inPrimitiveId;
+
+        SHADER_OUT Vec3f* outPosition;
+        SHADER_OUT U32* outId;
+
+        SHADER_CONST U32 cDrawId;
+
+        static void ps_main()
+        {
+            *outPosition = {inPosClip->x, inPosClip->y, inPosClip->z};
+            *outId = (cDrawId << VISIBILITY_PRIMITIVE_BITS) | *inPrimitiveId;
+        }
+    }
+
+    Shader loadPS_Visibility()
+    {
+        Shader shader;
+
+        shader.addSymbol(Shader::Input    , std::string("posClip")         , Type::FLOAT4    , Semantic::SV_Position    , (U8*)&PSVisibility::inPosClip);
+        shader.addSymbol(Shader::Input    , std::string("primitiveId")     , Type::UINT      , Semantic::SV_PrimitiveID , (U8*)&PSVisibility::inPrimitiveId);
+        shader.addSymbol(Shader::Output   , std::string("position")        , Type::FLOAT3    , Semantic::SV_Position    , (U8*)&PSVisibility::outPosition);
+        shader.addSymbol(Shader::Output   , std::string("id")              , Type::UINT      , Semantic::SV_Target1     , (U8*)&PSVisibility::outId);
+        shader.addSymbol(Shader::Constant , std::string("cDrawId")         , Type::UINT      , Semantic{}               , (U8*)&PSVisibility::cDrawId);
+
+        shader.setEntry(&PSVisibility::ps_main);
+
+        return shader;
+    }
+
+    namespace VSFlat
+    {
+        SHADER_IN Vec3f const* inPosition;
+
+        SHADER_OUT Vec4f* outPosClip;
+
+        SHADER_CONST Mat44f mWorldViewProj;
+
+        static void vs_main()
+        {
+            *outPosClip = mWorldViewProj * Vec4f{inPosition->x, inPosition->y, inPosition->z, 1.0f};
+        }
+    }
+
+    Shader loadVS_Flat()
+    {
+        Shader shader;
+
+        shader.addSymbol(Shader::Input    , std::string("position")       , Type::FLOAT3   , Semantic::Position0   , (U8*)&VSFlat::inPosition);
+        shader.addSymbol(Shader::Output   , std::string("posClip")        , Type::FLOAT4   , Semantic::SV_Position , (U8*)&VSFlat::outPosClip);
+        shader.addSymbol(Shader::Constant , std::string("mWorldViewProj") , Type::FLOAT4X4 , Semantic{}            , (U8*)&VSFlat::mWorldViewProj);
+
+        shader.setEntry(&VSFlat::vs_main);
+
+        return shader;
+    }
+
+    namespace PSFlat
+    {
+        SHADER_IN Vec4f const* inPosClip;
+
+        SHADER_OUT Vec3f* outPosition;
+        SHADER_OUT Vec3f* outColor;
+
+        SHADER_CONST Vec3f cColor;
+
+        static void ps_main()
+        {
+            *outPosition = {inPosClip->x, inPosClip->y, inPosClip->z};
+            *outColor = cColor;
+        }
+    }
+
+    Shader loadPS_Flat()
+    {
+        Shader shader;
+
+        shader.addSymbol(Shader::Input    , std::string("posClip")         , Type::FLOAT4    , Semantic::SV_Position , (U8*)&PSFlat::inPosClip);
+        shader.addSymbol(Shader::Output   , std::string("position")        , Type::FLOAT3    , Semantic::SV_Position , (U8*)&PSFlat::outPosition);
+        shader.addSymbol(Shader::Output   , std::string("color")           , Type::FLOAT3    , Semantic::SV_Target   , (U8*)&PSFlat::outColor);
+        shader.addSymbol(Shader::Constant , std::string("cColor")          , Type::FLOAT3    , Semantic{}            , (U8*)&PSFlat::cColor);
+
+        shader.setEntry(&PSFlat::ps_main);
+
+        return shader;
+    }
+
+    namespace PSFlatMRT
+    {
+        SHADER_IN Vec4f const* inPosClip;
+
+        SHADER_OUT Vec3f* outPosition;
+        SHADER_OUT Vec4f* outColor;
+        SHADER_OUT Vec4f* outColor2;
+
+        SHADER_CONST Vec4f cColor;
+        SHADER_CONST Vec4f cColor2;
+
+        static void ps_main()
+        {
+            *outPosition = {inPosClip->x, inPosClip->y, inPosClip->z};
+            *outColor = cColor;
+            *outColor2 = cColor2;
+        }
+    }
+
+    Shader loadPS_FlatMRT()
+    {
+        Shader shader;
+
+        shader.addSymbol(Shader::Input    , std::string("posClip")         , Type::FLOAT4    , Semantic::SV_Position , (U8*)&PSFlatMRT::inPosClip);
+        shader.addSymbol(Shader::Output   , std::string("position")        , Type::FLOAT3    , Semantic::SV_Position , (U8*)&PSFlatMRT::outPosition);
+        shader.addSymbol(Shader::Output   , std::string("color")           , Type::FLOAT4    , Semantic::SV_Target0  , (U8*)&PSFlatMRT::outColor);
+        shader.addSymbol(Shader::Output   , std::string("color2")          , Type::FLOAT4    , Semantic::SV_Target2  , (U8*)&PSFlatMRT::outColor2);
+        shader.addSymbol(Shader::Constant , std::string("cColor")          , Type::FLOAT4    , Semantic{}            , (U8*)&PSFlatMRT::cColor);
+        shader.addSymbol(Shader::Constant , std::string("cColor2")         , Type::FLOAT4    , Semantic{}            , (U8*)&PSFlatMRT::cColor2);
+
+        shader.setEntry(&PSFlatMRT::ps_main);
+
+        return shader;
+    }
+
     Shader loadShader(std::string const& filePath)
     {
         // TODO:
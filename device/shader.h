@@ -10,11 +10,13 @@
 #include <vector>
 #include <deque>
 #include <map>
+#include <unordered_map>
 
 #include "vmath.h"
 #include "buffer.h"
 #include "semantic.h"
 #include "component.h"
+#include "quad.h"
 
 namespace Device {
 
@@ -31,22 +33,33 @@ namespace Device {
 
         typedef void (*MainEntry)(void);
 
+        // For Input and Output symbols addr is the address of the shader's pointer variable,
+        // the shader processor points it to the port data before each invocation.
+        // For Constant symbols addr is the address of the variable itself.
+        // Quad inputs are QuadIn variables, pixel shaders read their derivatives with ddx and ddy.
         struct Symbol
         {
             std::string name;
             Type type;
             Semantic semantic;
             U8* addr;
+            bool quad;
         };
 
     protected:
         typedef std::vector<Symbol> SymbolList;
         SymbolList m_symbolSections[SectionCnt];
+        std::unordered_map<std::string, U32> m_symbolLookup[SectionCnt];
 
         MainEntry m_entryFunc;
 
+        // identifies the symbol table, see getId.
+        U32 m_id;
+
     public:
-        void addSymbol(Section section, std::string const& name, Type const& type, Semantic const& semantic, U8* addr);
+        Shader();
+
+        void addSymbol(Section section, std::string const& name, Type const& type, Semantic const& semantic, U8* addr, bool quad = false);
 
         void setEntry(MainEntry mainProc);
 
@@ -58,6 +71,10 @@ namespace Device {
 
         U8* getConstantAddr(std::string const& name) const;
 
+        // Unique per symbol table, pipeline states are cached by it. Copies keep the id,
+        // adding a symbol assigns a new one, so a shader built at a reused address never matches an old state.
+        U32 getId() const;
+
         void execute();
     };
 
@@ -67,6 +84,31 @@ namespace Device {
 
     Shader loadPS_Simple();
 
+    // Deferred geometry pass, writes the G-buffer: view position to SV_Target1, normal to SV_Target2,
+    // texcoord and cMaterialId to SV_Target3, ddx and ddy of the texcoord to SV_Target4 and SV_Target5.
+    // Pairs with loadVS_Simple.
+    Shader loadPS_GBuffer();
+
+    // Deferred lighting pass of loadPS_Simple, reads the G-buffer and shades with the texture of the material id.
+    // The texture level follows the derivatives of the geometry pass, as in loadPS_Simple.
+    // Textures and samplers of the materials are cTexture<n> and cSampler<n>, the light is shared with loadPS_Simple.
+    Shader loadPS_SimpleLighting();
+
+    // Visibility buffer ids, the triangle index is in the low bits and the draw index cDrawId in the high bits.
+    static constexpr U32 VISIBILITY_PRIMITIVE_BITS = 24;
+
+    // Visibility buffer pass, writes the id of the triangle covering the pixel to SV_Target1 as a UINT.
+    Shader loadPS_Visibility();
+
+    // Transform only, positions are Position0.
+    Shader loadVS_Flat();
+
+    // A constant color cColor.
+    Shader loadPS_Flat();
+
+    // Constant colors with alpha, cColor to SV_Target0 and cColor2 to SV_Target2.
+    Shader loadPS_FlatMRT();
+
 } // namespace Device
 
 #endif // _SHADER_H_
@@ -1,6 +1,17 @@
 #include "shader_processor.h"
 
 namespace Device {
+    // Unbound shader inputs read zeros.
+    static float const s_defaultInput[16] = {};
+
+    ShaderProcessor::ShaderProcessor(Dispatch dispatch)
+        : m_dispatch{dispatch}
+        , m_shader{nullptr}
+        , m_inLaneStride{0}
+        , m_outLaneStride{0}
+    {
+    }
+
     void ShaderProcessor::attach(Shader* shader)
     {
         m_shader = shader;
@@ -8,15 +19,12 @@ namespace Device {
         // reset all io ports.
         for (U32 portType = 0; portType < IOEnd; ++portType)
         {
-            m_types[portType].clear();
-            m_values[portType].clear();
-            m_symbols[portType].clear();
-            m_semantics[portType].clear();
+            resetPorts((IOType)portType);
         }
 
         // reset shader references.
-        m_shaderInputAddrs.clear();
-        m_shaderOutputAddrs.clear();
+        m_shaderInputs.clear();
+        m_shaderOutputs.clear();
 
         // dynamically adjust input ports according to shader's input variables.
         std::vector<Shader::Symbol> const& inputDescs = shader->getSymbols(Shader::Input);
@@ -24,7 +32,14 @@ namespace Device {
         {
             Shader::Symbol const& symbol = inputDescs[varIndex];
             addIOPort(Input, symbol.name, symbol.type, symbol.semantic);
-            m_shaderInputAddrs.push_back(symbol.addr);
+            QuadInputSlot* quad = symbol.quad ? (QuadInputSlot*)symbol.addr : nullptr;
+            m_shaderInputs.push_back(PortBinding{(U8**)symbol.addr, NumHalfChannels(symbol.type), quad});
+            if (quad != nullptr)
+            {
+                // derivatives need the other lanes, only quad dispatch has them.
+                quad->laneData = nullptr;
+                quad->lane = 0;
+            }
         }
 
         // dynamically adjust output ports according to shader's output variables.
@@ -33,8 +48,27 @@ namespace Device {
         {
             Shader::Symbol const& symbol = outputDescs[varIndex];
             addIOPort(Output, symbol.name, symbol.type, symbol.semantic);
-            m_shaderOutputAddrs.push_back(symbol.addr);
+            m_shaderOutputs.push_back(PortBinding{(U8**)symbol.addr, NumHalfChannels(symbol.type), nullptr});
+        }
+
+        U32 numLanes = 1;
+        if (m_dispatch == PerQuad)
+        {
+            // coverage is passed through to the output merger, it follows the shader ports.
+            addIOPort(Input, std::string("coverage"), Type::UINT, Semantic::SV_Coverage);
+            addIOPort(Output, std::string("coverage"), Type::UINT, Semantic::SV_Coverage);
+            numLanes = QUAD_LANES;
         }
+
+        m_inputScratch.assign(m_shaderInputs.size() * numLanes, PortScratch{});
+        m_outputScratch.assign(m_shaderOutputs.size(), PortScratch{});
+        m_quadInputs.assign(m_shaderInputs.size() * numLanes, nullptr);
+    }
+
+    void ShaderProcessor::setLaneStrides(U32 inLaneStride, U32 outLaneStride)
+    {
+        m_inLaneStride = inLaneStride;
+        m_outLaneStride = outLaneStride;
     }
 
     bool ShaderProcessor::isOneInOneOut() const
@@ -42,35 +76,128 @@ namespace Device {
         return true;
     }
 
-    void ShaderProcessor::runOne()
+    U8 const* ShaderProcessor::bindInput(U32 portIdx, U8* pCompInPort, float* scratch) const
     {
-        // copy to shader input
-        for (U32 portIdx = 0; portIdx < m_values[Input].size(); ++portIdx)
+        PortBinding const& binding = m_shaderInputs[portIdx];
+
+        if (pCompInPort == nullptr)
         {
-            Type& type = m_types[Input][portIdx];
-            Value& value = m_values[Input][portIdx];
-            U8* pShaderInput = m_shaderInputAddrs[portIdx];
-            U8* pCompInPort = value.read();
-            if (pShaderInput != nullptr && pCompInPort != nullptr)
+            return (U8 const*)s_defaultInput;
+        }
+        else if (binding.numHalfChannels != 0)
+        {
+            // half port, shader variable is float.
+            halfToFloat(scratch, (Half const*)pCompInPort, binding.numHalfChannels);
+            return (U8 const*)scratch;
+        }
+        else
+        {
+            return pCompInPort;
+        }
+    }
+
+    void ShaderProcessor::bindOutputs(U32 lane)
+    {
+        // point shader outputs to the out stream element.
+        for (U32 portIdx = 0; portIdx < m_shaderOutputs.size(); ++portIdx)
+        {
+            PortBinding const& binding = m_shaderOutputs[portIdx];
+            U8* pCompOutPort = m_values[Output][portIdx].read();
+
+            if (pCompOutPort == nullptr || binding.numHalfChannels != 0)
+            {
+                *binding.slot = (U8*)m_outputScratch[portIdx].data;
+            }
+            else
             {
-                std::memcpy(pShaderInput, pCompInPort, SizeOf(type));
+                *binding.slot = pCompOutPort + lane * m_outLaneStride;
             }
         }
+    }
+
+    void ShaderProcessor::storeHalfOutputs(U32 lane)
+    {
+        for (U32 portIdx = 0; portIdx < m_shaderOutputs.size(); ++portIdx)
+        {
+            PortBinding const& binding = m_shaderOutputs[portIdx];
+            U8* pCompOutPort = m_values[Output][portIdx].read();
+
+            if (pCompOutPort != nullptr && binding.numHalfChannels != 0)
+            {
+                floatToHalf((Half*)(pCompOutPort + lane * m_outLaneStride), m_outputScratch[portIdx].data, binding.numHalfChannels);
+            }
+        }
+    }
+
+    void ShaderProcessor::runOne()
+    {
+        if (m_dispatch == PerQuad)
+        {
+            runQuad();
+            return;
+        }
+
+        // point shader inputs to the in stream element, only half ports are copied.
+        for (U32 portIdx = 0; portIdx < m_shaderInputs.size(); ++portIdx)
+        {
+            U8* pCompInPort = m_values[Input][portIdx].read();
+            *m_shaderInputs[portIdx].slot = (U8*)bindInput(portIdx, pCompInPort, m_inputScratch[portIdx].data);
+        }
+
+        bindOutputs(0);
 
         m_shader->execute();
 
-        // copy to shader output
-        for (U32 portIdx = 0; portIdx < m_values[Output].size(); ++portIdx)
+        // store half outputs.
+        storeHalfOutputs(0);
+    }
+
+    void ShaderProcessor::runQuad()
+    {
+        U32 const numInputs = m_shaderInputs.size();
+        U32 const coveragePort = numInputs;
+        U32 const coverage = m_values[Input][coveragePort].readAs<U32>();
+
+        // resolve inputs of all lanes first, helper lanes are needed by derivatives.
+        for (U32 portIdx = 0; portIdx < numInputs; ++portIdx)
         {
-            Type& type = m_types[Output][portIdx];
-            Value& value = m_values[Output][portIdx];
-            U8* pShaderOutput = m_shaderOutputAddrs[portIdx];
-            U8* pCompOutPort = value.read();
-            if (pShaderOutput != nullptr && pCompOutPort)
+            U8* pCompInPort = m_values[Input][portIdx].read();
+            for (U32 lane = 0; lane < QUAD_LANES; ++lane)
             {
-                std::memcpy(pCompOutPort, pShaderOutput, SizeOf(type));
+                U32 const entry = portIdx * QUAD_LANES + lane;
+                U8* pLaneInPort = pCompInPort == nullptr ? nullptr : pCompInPort + lane * m_inLaneStride;
+                m_quadInputs[entry] = bindInput(portIdx, pLaneInPort, m_inputScratch[entry].data);
             }
         }
+
+        U8* pOutCoverage = m_values[Output][m_shaderOutputs.size()].read();
+
+        for (U32 lane = 0; lane < QUAD_LANES; ++lane)
+        {
+            *(U32*)(pOutCoverage + lane * m_outLaneStride) = coverage;
+
+            // helper lanes are not shaded, their outputs are never read.
+            if (!isLaneCovered(coverage, lane))
+            {
+                continue;
+            }
+
+            for (U32 portIdx = 0; portIdx < numInputs; ++portIdx)
+            {
+                PortBinding const& binding = m_shaderInputs[portIdx];
+                *binding.slot = (U8*)m_quadInputs[portIdx * QUAD_LANES + lane];
+                if (binding.quad != nullptr)
+                {
+                    binding.quad->laneData = &m_quadInputs[portIdx * QUAD_LANES];
+                    binding.quad->lane = lane;
+                }
+            }
+            bindOutputs(lane);
+
+            m_shader->execute();
+
+            storeHalfOutputs(lane);
+        }
     }
 
     void ShaderProcessor::comsumeOneInput()
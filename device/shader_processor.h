@@ -4,20 +4,68 @@
 #include "vmath.h"
 #include "component.h"
 #include "shader.h"
+#include "quad.h"
 
 namespace Device {
     class ShaderProcessor: public Comp
     {
+    public:
+        enum Dispatch
+        {
+            PerElement, // one invocation per stream element.
+            PerQuad,    // stream elements are 2x2 pixel quads, covered lanes are shaded.
+        };
+
     protected:
+        // Binds one shader io pointer variable to its port.
+        struct PortBinding
+        {
+            U8** slot;            // the shader's pointer variable.
+            U32 numHalfChannels;  // non-zero if the port is half and must be converted.
+            QuadInputSlot* quad;  // same variable as slot if it is a QuadIn, else null.
+        };
+
+        // Float storage for ports that can not be bound in place.
+        struct PortScratch
+        {
+            float data[16];
+        };
+
+        Dispatch const m_dispatch;
         Shader* m_shader;
 
-        std::vector<U8*> m_shaderInputAddrs;
+        std::vector<PortBinding> m_shaderInputs;
+        std::vector<PortBinding> m_shaderOutputs;
 
-        std::vector<U8*> m_shaderOutputAddrs;
+        // one entry per port, or per port and lane in quad dispatch.
+        std::vector<PortScratch> m_inputScratch;
+        std::vector<PortScratch> m_outputScratch;
+
+        // quad dispatch state, lane strides of the in/out stream elements.
+        U32 m_inLaneStride;
+        U32 m_outLaneStride;
+        std::vector<U8 const*> m_quadInputs; // port major, QUAD_LANES entries per port.
+
+    protected:
+        // Returns what the shader input pointer of port should point to.
+        U8 const* bindInput(U32 portIdx, U8* pCompInPort, float* scratch) const;
+
+        void bindOutputs(U32 lane);
+
+        void storeHalfOutputs(U32 lane);
+
+        void runQuad();
 
     public:
+        ShaderProcessor(Dispatch dispatch = PerElement);
+
         void attach(Shader* shader);
 
+        inline Shader const* getShader() const { return m_shader; }
+
+        // Lane strides of the quad in/out stream elements, only used in quad dispatch.
+        void setLaneStrides(U32 inLaneStride, U32 outLaneStride);
+
         bool isOneInOneOut() const;
 
         void runOne();
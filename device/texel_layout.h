@@ -0,0 +1,149 @@
+#ifndef _TEXEL_LAYOUT_H_
+#define _TEXEL_LAYOUT_H_
+
+#include <cassert>
+#include <algorithm>
+
+#include "vmath.h"
+#include "utils.h"
+#include "texture.h"
+
+// Texel addressing of each TexelLayout, shared by textures and render targets.
+
+namespace Device { namespace Texture {
+
+    inline U32 nextPowerOfTwo(U32 value)
+    {
+        return value <= 1 ? 1 : 1u << (32 - __builtin_clz(value - 1));
+    }
+
+    // Spread the lower 16 bits of value to the even bits.
+    inline U32 spreadBits(U32 value)
+    {
+        value &= 0x0000ffffu;
+        value = (value | (value << 8)) & 0x00ff00ffu;
+        value = (value | (value << 4)) & 0x0f0f0f0fu;
+        value = (value | (value << 2)) & 0x33333333u;
+        value = (value | (value << 1)) & 0x55555555u;
+        return value;
+    }
+
+    // Returns the number of texels a level of width x height occupies, including padding.
+    inline U32 getLevelNumTexels(TexelLayout layout, U32 width, U32 height)
+    {
+        switch (layout)
+        {
+            case TexelLayout::LINEAR:
+                return width * height;
+            case TexelLayout::TILED_4X4:
+                return ((width + 3) / 4) * ((height + 3) / 4) * 16;
+            case TexelLayout::MORTON:
+                return nextPowerOfTwo(width) * nextPowerOfTwo(height);
+            case TexelLayout::TILED_8X8_MORTON:
+                return ((width + 7) / 8) * ((height + 7) / 8) * 64;
+            default:
+                assert(0);
+                return 0;
+        }
+    }
+
+    // Texel index within a level, the per level constants are computed once at construction.
+    template <TexelLayout layout>
+    struct TexelIndexer;
+
+    template <>
+    struct TexelIndexer<TexelLayout::LINEAR>
+    {
+        U32 pitch;
+
+        TexelIndexer(U32 width, U32 height) : pitch{width} { (void)height; }
+
+        FORCE_INLINE U32 index(U32 x, U32 y) const
+        {
+            return x + pitch * y;
+        }
+    };
+
+    template <>
+    struct TexelIndexer<TexelLayout::TILED_4X4>
+    {
+        U32 tilesPerRow;
+
+        TexelIndexer(U32 width, U32 height) : tilesPerRow{(width + 3) / 4} { (void)height; }
+
+        FORCE_INLINE U32 index(U32 x, U32 y) const
+        {
+            U32 const tile = (x >> 2) + (y >> 2) * tilesPerRow;
+            return tile * 16 + (x & 3) + (y & 3) * 4;
+        }
+    };
+
+    template <>
+    struct TexelIndexer<TexelLayout::MORTON>
+    {
+        // interleave the bits both dimensions share, the rest of the longer one is on top.
+        U32 mask;
+        U32 shift;      // log2 of the shared square size.
+        bool xIsLonger;
+
+        TexelIndexer(U32 width, U32 height)
+        {
+            U32 const paddedWidth = nextPowerOfTwo(width);
+            U32 const paddedHeight = nextPowerOfTwo(height);
+            U32 const square = std::min(paddedWidth, paddedHeight);
+            mask = square - 1;
+            shift = __builtin_ctz(square);
+            xIsLonger = paddedWidth > paddedHeight;
+        }
+
+        FORCE_INLINE U32 index(U32 x, U32 y) const
+        {
+            U32 const z = spreadBits(x & mask) | (spreadBits(y & mask) << 1);
+            U32 const high = (xIsLonger ? x : y) >> shift;
+            return z + (high << (2 * shift));
+        }
+    };
+
+    template <>
+    struct TexelIndexer<TexelLayout::TILED_8X8_MORTON>
+    {
+        U32 tilesPerRow;
+
+        TexelIndexer(U32 width, U32 height) : tilesPerRow{(width + 7) / 8} { (void)height; }
+
+        // Spread 3 bits of value to the even bits.
+        static FORCE_INLINE U32 spread3(U32 value)
+        {
+            value = (value | (value << 2)) & 0x13u;
+            return (value | (value << 1)) & 0x15u;
+        }
+
+        FORCE_INLINE U32 index(U32 x, U32 y) const
+        {
+            U32 const tile = (x >> 3) + (y >> 3) * tilesPerRow;
+            return (tile << 6) | spread3(x & 7) | (spread3(y & 7) << 1);
+        }
+    };
+
+    inline U32 getTexelIndex(TexelLayout layout, U32 width, U32 height, U32 x, U32 y)
+    {
+        switch (layout)
+        {
+            case TexelLayout::LINEAR:
+                return TexelIndexer<TexelLayout::LINEAR>{width, height}.index(x, y);
+            case TexelLayout::TILED_4X4:
+                return TexelIndexer<TexelLayout::TILED_4X4>{width, height}.index(x, y);
+            case TexelLayout::MORTON:
+                return TexelIndexer<TexelLayout::MORTON>{width, height}.index(x, y);
+            case TexelLayout::TILED_8X8_MORTON:
+                return TexelIndexer<TexelLayout::TILED_8X8_MORTON>{width, height}.index(x, y);
+            default:
+                assert(0);
+                return 0;
+        }
+    }
+
+} // namespace Texture
+} // namespace Device
+
+#endif // _TEXEL_LAYOUT_H_
@@ -1,7 +1,20 @@
+#include <atomic>
+#include <cmath>
+#include <cfloat>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
 #include <algorithm>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include "vmath.h"
+#include "utils.h"
 #include "texture.h"
+#include "texel_layout.h"
+#include "texture_stats.h"
 #include "bitmap_image.h"
 
 namespace Device {
@@ -26,6 +39,11 @@ namespace Texture {
             F32,
             U32,
             U8,
+            // n bit unsigned normalized, packed from the lowest bit up into a little endian texel.
+            UN2,
+            UN10,
+            UN16,
+            UN24,
             Count
         };
 
@@ -33,7 +51,7 @@ namespace Texture {
         char const* m_name;
         ChannelFormat m_channelFormats[(U8)ChannelType::Count];
         U32 m_numChannels;
-        U8 m_channelOffsets[(U8)ChannelType::Count];
+        U8 m_channelOffsets[(U8)ChannelType::Count]; // in bits.
         U8 m_size;
 
     public:
@@ -65,8 +83,11 @@ namespace Texture {
                 }
 
                 m_channelOffsets[channel] = m_size;
-                m_size += getChannelWidth((ChannelType)channel);
+                m_size += getChannelBits((ChannelType)channel);
             }
+
+            assert(m_size % 8 == 0);
+            m_size /= 8;
         }
 
         inline char const* getName() const
@@ -89,18 +110,26 @@ namespace Texture {
             return m_channelFormats[(U8)channel];
         }
 
-        inline U32 getChannelWidth(ChannelType const& channel) const
+        inline U32 getChannelBits(ChannelType const& channel) const
         {
             switch (getChannelFormat(channel))
             {
                 case ChannelFormat::NONE:
                     return 0;
                 case ChannelFormat::F32:
-                    return 4;
+                    return 32;
                 case ChannelFormat::U32:
-                    return 4;
+                    return 32;
                 case ChannelFormat::U8:
-                    return 1;
+                    return 8;
+                case ChannelFormat::UN2:
+                    return 2;
+                case ChannelFormat::UN10:
+                    return 10;
+                case ChannelFormat::UN16:
+                    return 16;
+                case ChannelFormat::UN24:
+                    return 24;
 
                 default:
                     assert(0);
@@ -121,16 +150,29 @@ namespace Texture {
                 return 0.0f;
             }
 
+            U8* channelAddr = texelAddr + m_channelOffsets[(U8)channel] / 8;
             switch (m_channelFormats[(U8)channel])
             {
                 case ChannelFormat::NONE:
                     return 0.0f;
                 case ChannelFormat::F32:
-                    return *reinterpret_cast<float*>(texelAddr + m_channelOffsets[(U8)channel]);
+                    return *reinterpret_cast<float*>(channelAddr);
                 case ChannelFormat::U32:
-                    return *reinterpret_cast<U32*>(texelAddr + m_channelOffsets[(U8)channel]);
+                    return *reinterpret_cast<U32*>(channelAddr);
                 case ChannelFormat::U8:
-                    return *reinterpret_cast<U8*>(texelAddr + m_channelOffsets[(U8)channel]);
+                    return *reinterpret_cast<U8*>(channelAddr);
+                case ChannelFormat::UN2:
+                case ChannelFormat::UN10:
+                case ChannelFormat::UN16:
+                case ChannelFormat::UN24:
+                {
+                    // packed formats are at most 32 bits.
+                    U32 bits = 0;
+                    std::memcpy(&bits, texelAddr, m_size);
+                    U32 const width = getChannelBits(channel);
+                    U32 const maxValue = (1u << width) - 1;
+                    return (float)((bits >> m_channelOffsets[(U8)channel]) & maxValue) / maxValue;
+                }
                 default:
                     assert(0);
                     return 0.0f;
@@ -142,6 +184,10 @@ namespace Texture {
     static constexpr TexelType::ChannelFormat TF32 = TexelType::ChannelFormat::F32;
     static constexpr TexelType::ChannelFormat TU32 = TexelType::ChannelFormat::U32;
     static constexpr TexelType::ChannelFormat TU8  = TexelType::ChannelFormat::U8;
+    static constexpr TexelType::ChannelFormat TN2  = TexelType::ChannelFormat::UN2;
+    static constexpr TexelType::ChannelFormat TN10 = TexelType::ChannelFormat::UN10;
+    static constexpr TexelType::ChannelFormat TN16 = TexelType::ChannelFormat::UN16;
+    static constexpr TexelType::ChannelFormat TN24 = TexelType::ChannelFormat::UN24;
 
     static TexelType const s_texelTypes[] =
     {
@@ -154,143 +200,1790 @@ namespace Texture {
         TexelType{ "R8G8B8_UINT"        , TU8  ,TU8  ,TU8  ,TNIL ,TNIL ,TNIL }, // R8G8B8_UINT
         TexelType{ "B8G8R8_UINT"        , TU8  ,TU8  ,TU8  ,TNIL ,TNIL ,TNIL }, // B8G8R8_UINT
         TexelType{ "D32_FLOAT"          , TNIL ,TNIL ,TNIL ,TNIL ,TF32 ,TNIL }, // D32_FLOAT
+        // block compressed formats describe their decoded texels.
+        TexelType{ "BC1_UNORM"          , TU8  ,TU8  ,TU8  ,TU8  ,TNIL ,TNIL }, // BC1_UNORM
+        TexelType{ "BC3_UNORM"          , TU8  ,TU8  ,TU8  ,TU8  ,TNIL ,TNIL }, // BC3_UNORM
+        TexelType{ "R8G8B8A8_SRGB"      , TU8  ,TU8  ,TU8  ,TU8  ,TNIL ,TNIL }, // R8G8B8A8_SRGB
+        TexelType{ "B8G8R8_SRGB"        , TU8  ,TU8  ,TU8  ,TNIL ,TNIL ,TNIL }, // B8G8R8_SRGB
+        TexelType{ "R8G8B8A8_UNORM"     , TU8  ,TU8  ,TU8  ,TU8  ,TNIL ,TNIL }, // R8G8B8A8_UNORM
+        TexelType{ "R10G10B10A2_UNORM"  , TN10 ,TN10 ,TN10 ,TN2  ,TNIL ,TNIL }, // R10G10B10A2_UNORM
+        TexelType{ "D24_UNORM_S8_UINT"  , TNIL ,TNIL ,TNIL ,TNIL ,TN24 ,TU8  }, // D24_UNORM_S8_UINT
+        TexelType{ "D16_UNORM"          , TNIL ,TNIL ,TNIL ,TNIL ,TN16 ,TNIL }, // D16_UNORM
+        TexelType{ "R32_UINT"           , TU32 ,TNIL ,TNIL ,TNIL ,TNIL ,TNIL }, // R32_UINT
+        TexelType{ "BC1_SRGB"           , TU8  ,TU8  ,TU8  ,TU8  ,TNIL ,TNIL }, // BC1_SRGB
+        TexelType{ "BC3_SRGB"           , TU8  ,TU8  ,TU8  ,TU8  ,TNIL ,TNIL }, // BC3_SRGB
+    };
+
+    U32 getTexelSize(TexelFormat format)
+    {
+        return s_texelTypes[(U32)format].getSize();
+    }
+
+    static inline U32 getBlockSize(TexelFormat format)
+    {
+        switch (format)
+        {
+            case TexelFormat::BC1_UNORM:
+            case TexelFormat::BC1_SRGB:
+                return 8;
+            case TexelFormat::BC3_UNORM:
+            case TexelFormat::BC3_SRGB:
+                return 16;
+            default:
+                assert(0);
+                return 0;
+        }
+    }
+
+    // Format of the decoded RGBA8 texels of a block compressed format.
+    static inline TexelFormat getBlockTexelFormat(TexelFormat format)
+    {
+        return format == TexelFormat::BC1_SRGB || format == TexelFormat::BC3_SRGB ? TexelFormat::R8G8B8A8_SRGB : TexelFormat::R8G8B8A8_UINT;
+    }
+
+    static inline U32 getNumBlocks(U32 size)
+    {
+        return (size + BLOCK_DIM - 1) / BLOCK_DIM;
+    }
+
+    // Returns the bytes a level occupies, blocks of block compressed formats are laid out like texels.
+    static U32 getLevelStorageSize(TexelFormat format, TexelLayout layout, U32 width, U32 height)
+    {
+        if (isBlockCompressed(format))
+        {
+            return getLevelNumTexels(layout, getNumBlocks(width), getNumBlocks(height)) * getBlockSize(format);
+        }
+        return getLevelNumTexels(layout, width, height) * s_texelTypes[(U32)format].getSize();
+    }
+
+    ////////////////////////////////////////////////////////////
+    // Block compression.
+    // [ref](https://docs.microsoft.com/en-us/windows/win32/direct3d10/d3d10-graphics-programming-guide-resources-block-compression)
+
+    // Decoded texels are RGBA8 packed in a U32, red in the lowest byte.
+    static inline U32 packRGBA8(U32 r, U32 g, U32 b, U32 a)
+    {
+        return r | (g << 8) | (b << 16) | (a << 24);
+    }
+
+    static inline U32 getChannel(U32 texel, U32 channel)
+    {
+        return (texel >> (channel * 8)) & 0xffu;
+    }
+
+    // The four packed palette colors of a color block.
+    static void makeColorPalette(U16 c0, U16 c1, bool fourColors, U32* palette)
+    {
+        // endpoints are 565, high bits are replicated into the low ones so 0x1f maps to 0xff.
+        U32 r[2], g[2], b[2];
+        U16 const endpoints[2] = {c0, c1};
+        for (U32 index = 0; index < 2; ++index)
+        {
+            U32 const r5 = (endpoints[index] >> 11) & 0x1fu;
+            U32 const g6 = (endpoints[index] >> 5) & 0x3fu;
+            U32 const b5 = endpoints[index] & 0x1fu;
+            r[index] = (r5 << 3) | (r5 >> 2);
+            g[index] = (g6 << 2) | (g6 >> 4);
+            b[index] = (b5 << 3) | (b5 >> 2);
+        }
+
+        palette[0] = packRGBA8(r[0], g[0], b[0], 255);
+        palette[1] = packRGBA8(r[1], g[1], b[1], 255);
+        if (fourColors || c0 > c1)
+        {
+            palette[2] = packRGBA8((2 * r[0] + r[1]) / 3, (2 * g[0] + g[1]) / 3, (2 * b[0] + b[1]) / 3, 255);
+            palette[3] = packRGBA8((r[0] + 2 * r[1]) / 3, (g[0] + 2 * g[1]) / 3, (b[0] + 2 * b[1]) / 3, 255);
+        }
+        else
+        {
+            // three colors and transparent black.
+            palette[2] = packRGBA8((r[0] + r[1]) / 2, (g[0] + g[1]) / 2, (b[0] + b[1]) / 2, 255);
+            palette[3] = 0;
+        }
+    }
+
+    static void makeAlphaPalette(U32 a0, U32 a1, U32* palette)
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+        if (a0 > a1)
+        {
+            for (U32 index = 1; index < 7; ++index)
+            {
+                palette[index + 1] = ((7 - index) * a0 + index * a1) / 7;
+            }
+        }
+        else
+        {
+            for (U32 index = 1; index < 5; ++index)
+            {
+                palette[index + 1] = ((5 - index) * a0 + index * a1) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    static void decodeColorBlock(U8 const* block, bool fourColors, U32* texels)
+    {
+        U16 const c0 = block[0] | (block[1] << 8);
+        U16 const c1 = block[2] | (block[3] << 8);
+        U32 palette[4];
+        makeColorPalette(c0, c1, fourColors, palette);
+
+        U32 const indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((U32)block[7] << 24);
+        for (U32 texel = 0; texel < BLOCK_DIM * BLOCK_DIM; ++texel)
+        {
+            texels[texel] = palette[(indices >> (texel * 2)) & 3u];
+        }
+    }
+
+    static void decodeAlphaBlock(U8 const* block, U32* texels)
+    {
+        U32 palette[8];
+        makeAlphaPalette(block[0], block[1], palette);
+
+        std::uint64_t indices = 0;
+        for (U32 byte = 0; byte < 6; ++byte)
+        {
+            indices |= (std::uint64_t)block[2 + byte] << (byte * 8);
+        }
+        for (U32 texel = 0; texel < BLOCK_DIM * BLOCK_DIM; ++texel)
+        {
+            U32 const index = (indices >> (texel * 3)) & 7u;
+            texels[texel] = (texels[texel] & 0x00ffffffu) | (palette[index] << 24);
+        }
+    }
+
+    // Decodes the 16 texels of one block, row-major.
+    static void decodeBlock(TexelFormat format, U8 const* block, U32* texels)
+    {
+        switch (format)
+        {
+            case TexelFormat::BC1_UNORM:
+            case TexelFormat::BC1_SRGB:
+                decodeColorBlock(block, false, texels);
+                break;
+            case TexelFormat::BC3_UNORM:
+            case TexelFormat::BC3_SRGB:
+                decodeColorBlock(block + 8, true, texels);
+                decodeAlphaBlock(block, texels);
+                break;
+            default:
+                assert(0);
+        }
+    }
+
+    static inline U16 packColor565(U32 r, U32 g, U32 b)
+    {
+        return (U16)((((r * 31 + 127) / 255) << 11) | (((g * 63 + 127) / 255) << 5) | ((b * 31 + 127) / 255));
+    }
+
+    // Endpoints are the extreme texels along the principal axis of the block colors,
+    // every texel takes the nearest palette color.
+    static void encodeColorBlock(U32 const* texels, U8* block)
+    {
+        float mean[3] = {0.0f, 0.0f, 0.0f};
+        for (U32 texel = 0; texel < BLOCK_DIM * BLOCK_DIM; ++texel)
+        {
+            for (U32 channel = 0; channel < 3; ++channel)
+            {
+                mean[channel] += getChannel(texels[texel], channel) / 16.0f;
+            }
+        }
+
+        float covariance[3][3] = {};
+        for (U32 texel = 0; texel < BLOCK_DIM * BLOCK_DIM; ++texel)
+        {
+            float d[3];
+            for (U32 channel = 0; channel < 3; ++channel)
+            {
+                d[channel] = getChannel(texels[texel], channel) - mean[channel];
+            }
+            for (U32 row = 0; row < 3; ++row)
+            {
+                for (U32 column = 0; column < 3; ++column)
+                {
+                    covariance[row][column] += d[row] * d[column];
+                }
+            }
+        }
+
+        // a few power iterations are plenty for 16 points. They start from the covariance column of the widest channel,
+        // a fixed start like (1, 1, 1) is orthogonal to e.g. a red to green gradient and collapses to zero.
+        U32 widest = 0;
+        for (U32 channel = 1; channel < 3; ++channel)
+        {
+            widest = covariance[channel][channel] > covariance[widest][widest] ? channel : widest;
+        }
+        float axis[3] = {covariance[0][widest], covariance[1][widest], covariance[2][widest]};
+        if (covariance[widest][widest] == 0.0f)
+        {
+            // one color, any axis.
+            axis[0] = axis[1] = axis[2] = 1.0f;
+        }
+        for (U32 iteration = 0; iteration < 4; ++iteration)
+        {
+            float next[3];
+            for (U32 row = 0; row < 3; ++row)
+            {
+                next[row] = covariance[row][0] * axis[0] + covariance[row][1] * axis[1] + covariance[row][2] * axis[2];
+            }
+            float const length = std::max(std::max(std::fabs(next[0]), std::fabs(next[1])), std::fabs(next[2]));
+            if (length == 0.0f)
+            {
+                break;
+            }
+            for (U32 row = 0; row < 3; ++row)
+            {
+                axis[row] = next[row] / length;
+            }
+        }
+
+        U32 minTexel = texels[0], maxTexel = texels[0];
+        float minProjection = FLT_MAX, maxProjection = -FLT_MAX;
+        for (U32 texel = 0; texel < BLOCK_DIM * BLOCK_DIM; ++texel)
+        {
+            float const projection =
+                getChannel(texels[texel], 0) * axis[0] +
+                getChannel(texels[texel], 1) * axis[1] +
+                getChannel(texels[texel], 2) * axis[2];
+            if (projection < minProjection)
+            {
+                minProjection = projection;
+                minTexel = texels[texel];
+            }
+            if (projection > maxProjection)
+            {
+                maxProjection = projection;
+                maxTexel = texels[texel];
+            }
+        }
+
+        // c0 > c1 selects the four color mode.
+        U16 c0 = packColor565(getChannel(maxTexel, 0), getChannel(maxTexel, 1), getChannel(maxTexel, 2));
+        U16 c1 = packColor565(getChannel(minTexel, 0), getChannel(minTexel, 1), getChannel(minTexel, 2));
+        if (c0 < c1)
+        {
+            std::swap(c0, c1);
+        }
+
+        U32 indices = 0;
+        if (c0 != c1)
+        {
+            U32 palette[4];
+            makeColorPalette(c0, c1, true, palette);
+            for (U32 texel = 0; texel < BLOCK_DIM * BLOCK_DIM; ++texel)
+            {
+                U32 best = 0;
+                int bestDistance = INT_MAX;
+                for (U32 index = 0; index < 4; ++index)
+                {
+                    int const dr = (int)getChannel(texels[texel], 0) - (int)getChannel(palette[index], 0);
+                    int const dg = (int)getChannel(texels[texel], 1) - (int)getChannel(palette[index], 1);
+                    int const db = (int)getChannel(texels[texel], 2) - (int)getChannel(palette[index], 2);
+                    int const distance = dr * dr + dg * dg + db * db;
+                    if (distance < bestDistance)
+                    {
+                        bestDistance = distance;
+                        best = index;
+                    }
+                }
+                indices |= best << (texel * 2);
+            }
+        }
+
+        block[0] = c0 & 0xff;
+        block[1] = c0 >> 8;
+        block[2] = c1 & 0xff;
+        block[3] = c1 >> 8;
+        block[4] = indices & 0xff;
+        block[5] = (indices >> 8) & 0xff;
+        block[6] = (indices >> 16) & 0xff;
+        block[7] = indices >> 24;
+    }
+
+    static void encodeAlphaBlock(U32 const* texels, U8* block)
+    {
+        U32 a0 = 0, a1 = 255;
+        for (U32 texel = 0; texel < BLOCK_DIM * BLOCK_DIM; ++texel)
+        {
+            a0 = std::max(a0, getChannel(texels[texel], 3));
+            a1 = std::min(a1, getChannel(texels[texel], 3));
+        }
+
+        // a0 > a1 selects the eight level mode, a flat block keeps all indices at a0.
+        std::uint64_t indices = 0;
+        if (a0 != a1)
+        {
+            U32 palette[8];
+            makeAlphaPalette(a0, a1, palette);
+            for (U32 texel = 0; texel < BLOCK_DIM * BLOCK_DIM; ++texel)
+            {
+                int const alpha = getChannel(texels[texel], 3);
+                U32 best = 0;
+                for (U32 index = 1; index < 8; ++index)
+                {
+                    if (std::abs(alpha - (int)palette[index]) < std::abs(alpha - (int)palette[best]))
+                    {
+                        best = index;
+                    }
+                }
+                indices |= (std::uint64_t)best << (texel * 3);
+            }
+        }
+
+        block[0] = a0;
+        block[1] = a1;
+        for (U32 byte = 0; byte < 6; ++byte)
+        {
+            block[2 + byte] = (indices >> (byte * 8)) & 0xff;
+        }
+    }
+
+    static void encodeBlock(TexelFormat format, U32 const* texels, U8* block)
+    {
+        switch (format)
+        {
+            case TexelFormat::BC1_UNORM:
+            case TexelFormat::BC1_SRGB:
+                encodeColorBlock(texels, block);
+                break;
+            case TexelFormat::BC3_UNORM:
+            case TexelFormat::BC3_SRGB:
+                encodeAlphaBlock(texels, block);
+                encodeColorBlock(texels, block + 8);
+                break;
+            default:
+                assert(0);
+        }
+    }
+
+    // Decoded blocks of the sampling thread, direct mapped on the block address.
+    struct DecodedBlockCache
+    {
+        static constexpr U32 NUM_ENTRIES = 64;
+
+        struct Entry
+        {
+            U8 const* block;
+            U32 generation;
+            U32 texels[BLOCK_DIM * BLOCK_DIM];
+        };
+
+        Entry entries[NUM_ENTRIES];
     };
 
+    static thread_local DecodedBlockCache t_blockCache;
+
+    // Bumped whenever texel storage may change, cached blocks of an older generation never match.
+    static std::atomic<U32> s_blockGeneration{1};
+
+    static inline U32 getBlockGeneration()
+    {
+        return s_blockGeneration.load(std::memory_order_relaxed);
+    }
+
+    // Returns the 16 decoded texels of block, decoded at most once while it stays in the cache.
+    static FORCE_INLINE U32 const* fetchDecodedBlock(TexelFormat format, U8 const* block, U32 generation)
+    {
+        std::uintptr_t const address = reinterpret_cast<std::uintptr_t>(block) / getBlockSize(format);
+        // fold higher bits in, vertically adjacent blocks of power of two wide levels would collide otherwise.
+        U32 const slot = (address ^ (address >> 6) ^ (address >> 12)) % DecodedBlockCache::NUM_ENTRIES;
+
+        DecodedBlockCache::Entry& entry = t_blockCache.entries[slot];
+        if (entry.block != block || entry.generation != generation)
+        {
+            decodeBlock(format, block, entry.texels);
+            entry.block = block;
+            entry.generation = generation;
+        }
+        return entry.texels;
+    }
+
+    void Texture2D::invalidateSampling()
+    {
+        m_sampleFunc = nullptr;
+        s_blockGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Texture2D::Texture2D(Texture2D const& other)
+        : Texture2D{}
+    {
+        *this = other;
+    }
+
+    Texture2D& Texture2D::operator=(Texture2D const& other)
+    {
+        if (this == &other)
+        {
+            return *this;
+        }
+
+        m_format = other.m_format;
+        m_layout = other.m_layout;
+        m_width = other.m_width;
+        m_height = other.m_height;
+        m_storage = other.m_storage;
+        m_texData = other.ownsStorage() ? m_storage.data() : other.m_texData;
+        m_mipLevels = other.m_mipLevels;
+        m_mipStorage = other.m_mipStorage;
+        m_mipData = other.ownsMipStorage() ? m_mipStorage.data() : other.m_mipData;
+        m_sampleFunc = other.m_sampleFunc;
+        m_sampleBatchFunc = other.m_sampleBatchFunc;
+        m_sampleKey = other.m_sampleKey;
+
+        // the copied blocks may live where other blocks were cached.
+        s_blockGeneration.fetch_add(1, std::memory_order_relaxed);
+        return *this;
+    }
+
+    Texture2D Texture2D::view(Texture2D const& source)
+    {
+        // the blocks are where they were cached already, the block generation is kept.
+        Texture2D result;
+        result.m_format = source.m_format;
+        result.m_layout = source.m_layout;
+        result.m_width = source.m_width;
+        result.m_height = source.m_height;
+        result.m_texData = source.m_texData;
+        result.m_mipLevels = source.m_mipLevels;
+        result.m_mipData = source.m_mipData;
+        result.m_sampleFunc = source.m_sampleFunc;
+        result.m_sampleBatchFunc = source.m_sampleBatchFunc;
+        result.m_sampleKey = source.m_sampleKey;
+        return result;
+    }
+
     void Texture2D::writeTexel(U32 x, U32 y, U8* pNewTexel)
     {
+        assert(!isBlockCompressed(m_format));
         TexelType const& texelType = s_texelTypes[(U32)m_format];
         U32 texelSize = texelType.getSize();
-        U32 offset = (x + m_width * y) * texelSize;
-        U8* texelAddr = m_texData + offset;
+        U8* texelAddr = readTexel(x, y);
 
         std::memcpy(texelAddr, pNewTexel, texelSize);
     }
 
     U8* Texture2D::readTexel(U32 x, U32 y) const
     {
+        assert(!isBlockCompressed(m_format));
         TexelType const& texelType = s_texelTypes[(U32)m_format];
         U32 texelSize = texelType.getSize();
-        U32 offset = (x + m_width * y) * texelSize;
+        U32 offset = getTexelIndex(m_layout, m_width, m_height, x, y) * texelSize;
         return m_texData + offset;
     }
 
-    Vec4f Texture2D::getTexelAsVec4f(U32 x, U32 y) const
+    U8* Texture2D::readTexel(U32 level, U32 x, U32 y) const
+    {
+        if (level == 0)
+        {
+            return readTexel(x, y);
+        }
+
+        MipLevel const& mip = m_mipLevels[level - 1];
+        TexelType const& texelType = s_texelTypes[(U32)m_format];
+        U32 texelSize = texelType.getSize();
+        U32 offset = mip.offset + getTexelIndex(m_layout, mip.width, mip.height, x, y) * texelSize;
+        return m_mipData + offset;
+    }
+
+    // sRGB transfer tables, decoding every 8 bit value and encoding linear values in 4096 steps.
+    struct SrgbTables
+    {
+        static constexpr U32 ENCODE_STEPS = 4096;
+
+        float decode[256];
+        U8 encode[ENCODE_STEPS];
+
+        SrgbTables()
+        {
+            for (U32 value = 0; value < 256; ++value)
+            {
+                float const c = value / 255.0f;
+                decode[value] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+            }
+
+            for (U32 step = 0; step < ENCODE_STEPS; ++step)
+            {
+                float const c = (float)step / (ENCODE_STEPS - 1);
+                float const srgb = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+                encode[step] = (U8)(srgb * 255.0f + 0.5f);
+            }
+        }
+    };
+
+    static SrgbTables const s_srgbTables;
+
+    static FORCE_INLINE float decodeSrgb(U8 value)
+    {
+        return s_srgbTables.decode[value];
+    }
+
+    static FORCE_INLINE U8 encodeSrgb(float value)
+    {
+        U32 const step = (U32)(clamp(value, 0.0f, 1.0f) * (SrgbTables::ENCODE_STEPS - 1) + 0.5f);
+        return s_srgbTables.encode[step];
+    }
+
+    float srgbToLinear(U8 value)
+    {
+        return decodeSrgb(value);
+    }
+
+    U8 linearToSrgb(float value)
     {
-        U8* pTexel = readTexel(x, y);
+        return encodeSrgb(value);
+    }
 
-        switch (m_format)
+    // Note: 3 channel formats only read 3 channels, the last texel of a level has no padding behind it.
+    Vec4f decodeTexel(TexelFormat format, U8 const* pTexel)
+    {
+        switch (format)
         {
             case TexelFormat::R32G32B32A32_FLOAT:
             {
-                Vec4f data = *reinterpret_cast<Vec4f*>(pTexel);
+                Vec4f data = *reinterpret_cast<Vec4f const*>(pTexel);
                 return data;
             }
             case TexelFormat::R32G32B32A32_UINT:
             {
-                Vec4<U32> data = *reinterpret_cast<Vec4<U32>*>(pTexel);
+                Vec4<U32> data = *reinterpret_cast<Vec4<U32> const*>(pTexel);
                 return Vec4f{(float)data.x/255, (float)data.y/255, (float)data.z/255, (float)data.w/255};
             }
             case TexelFormat::R32G32B32_FLOAT:
             {
-                Vec4f data = *reinterpret_cast<Vec4f*>(pTexel);
+                Vec3f data = *reinterpret_cast<Vec3f const*>(pTexel);
                 return Vec4f{data.x, data.y, data.z, 1.0f};
             }
             case TexelFormat::R32G32B32_UINT:
             {
-                Vec4<U32> data = *reinterpret_cast<Vec4<U32>*>(pTexel);
+                Vec3<U32> data = *reinterpret_cast<Vec3<U32> const*>(pTexel);
                 return Vec4f{(float)data.x/255, (float)data.y/255, (float)data.z/255, 1.0f};
             }
             case TexelFormat::R8G8B8A8_UINT:
             {
-                Vec4<U8> data = *reinterpret_cast<Vec4<U8>*>(pTexel);
+                Vec4<U8> data = *reinterpret_cast<Vec4<U8> const*>(pTexel);
                 return Vec4f{(float)data.x/255, (float)data.y/255, (float)data.z/255, (float)data.w/255};
             }
             case TexelFormat::R8G8B8_UINT:
             {
-                Vec4<U8> data = *reinterpret_cast<Vec4<U8>*>(pTexel);
+                Vec3<U8> data = *reinterpret_cast<Vec3<U8> const*>(pTexel);
                 return Vec4f{(float)data.x/255, (float)data.y/255, (float)data.z/255, 1.0f};
             }
             case TexelFormat::B8G8R8_UINT:
             {
-                Vec4<U8> data = *reinterpret_cast<Vec4<U8>*>(pTexel);
+                Vec3<U8> data = *reinterpret_cast<Vec3<U8> const*>(pTexel);
                 return Vec4f{(float)data.z/255, (float)data.y/255, (float)data.x/255, 1.0f};
             }
             case TexelFormat::D32_FLOAT:
             {
-                float data = *reinterpret_cast<float*>(pTexel);
+                float data = *reinterpret_cast<float const*>(pTexel);
                 return Vec4f{data, data, data, data};
             }
+            case TexelFormat::R8G8B8A8_SRGB:
+                return Vec4f{decodeSrgb(pTexel[0]), decodeSrgb(pTexel[1]), decodeSrgb(pTexel[2]), pTexel[3] / 255.0f};
+            case TexelFormat::B8G8R8_SRGB:
+                return Vec4f{decodeSrgb(pTexel[2]), decodeSrgb(pTexel[1]), decodeSrgb(pTexel[0]), 1.0f};
+            case TexelFormat::R8G8B8A8_UNORM:
+                return Vec4f{pTexel[0] / 255.0f, pTexel[1] / 255.0f, pTexel[2] / 255.0f, pTexel[3] / 255.0f};
+            case TexelFormat::R10G10B10A2_UNORM:
+            {
+                U32 const bits = *reinterpret_cast<U32 const*>(pTexel);
+                return Vec4f{(bits & 0x3ff) / 1023.0f, ((bits >> 10) & 0x3ff) / 1023.0f, ((bits >> 20) & 0x3ff) / 1023.0f, (bits >> 30) / 3.0f};
+            }
+            case TexelFormat::D24_UNORM_S8_UINT:
+            {
+                float const depth = (*reinterpret_cast<U32 const*>(pTexel) & 0xffffff) / 16777215.0f;
+                return Vec4f{depth, depth, depth, depth};
+            }
+            case TexelFormat::D16_UNORM:
+            {
+                float const depth = *reinterpret_cast<U16 const*>(pTexel) / 65535.0f;
+                return Vec4f{depth, depth, depth, depth};
+            }
+            case TexelFormat::R32_UINT:
+                return Vec4f{*reinterpret_cast<U32 const*>(pTexel) / 255.0f, 0.0f, 0.0f, 1.0f};
             default:
                 assert(0);
+                return Vec4f{};
         }
+    }
+
+    // Inverse of decodeTexel, integer channels are rounded to the nearest value.
+    void encodeTexel(TexelFormat format, Vec4f const& color, U8* pTexel)
+    {
+        auto toU8 = [](float value) { return (U8)clamp(value * 255.0f + 0.5f, 0.0f, 255.0f); };
+        auto toU32 = [](float value) { return (U32)std::max(value * 255.0f + 0.5f, 0.0f); };
 
+        switch (format)
+        {
+            case TexelFormat::R32G32B32A32_FLOAT:
+                *reinterpret_cast<Vec4f*>(pTexel) = color;
+                break;
+            case TexelFormat::R32G32B32A32_UINT:
+                *reinterpret_cast<Vec4<U32>*>(pTexel) = Vec4<U32>{toU32(color.x), toU32(color.y), toU32(color.z), toU32(color.w)};
+                break;
+            case TexelFormat::R32G32B32_FLOAT:
+                *reinterpret_cast<Vec3f*>(pTexel) = Vec3f{color.x, color.y, color.z};
+                break;
+            case TexelFormat::R32G32B32_UINT:
+                *reinterpret_cast<Vec3<U32>*>(pTexel) = Vec3<U32>{toU32(color.x), toU32(color.y), toU32(color.z)};
+                break;
+            case TexelFormat::R8G8B8A8_UINT:
+                *reinterpret_cast<Vec4<U8>*>(pTexel) = Vec4<U8>{toU8(color.x), toU8(color.y), toU8(color.z), toU8(color.w)};
+                break;
+            case TexelFormat::R8G8B8_UINT:
+                *reinterpret_cast<Vec3<U8>*>(pTexel) = Vec3<U8>{toU8(color.x), toU8(color.y), toU8(color.z)};
+                break;
+            case TexelFormat::B8G8R8_UINT:
+                *reinterpret_cast<Vec3<U8>*>(pTexel) = Vec3<U8>{toU8(color.z), toU8(color.y), toU8(color.x)};
+                break;
+            case TexelFormat::D32_FLOAT:
+                *reinterpret_cast<float*>(pTexel) = color.x;
+                break;
+            case TexelFormat::R8G8B8A8_SRGB:
+                pTexel[0] = encodeSrgb(color.x);
+                pTexel[1] = encodeSrgb(color.y);
+                pTexel[2] = encodeSrgb(color.z);
+                pTexel[3] = toU8(color.w);
+                break;
+            case TexelFormat::B8G8R8_SRGB:
+                pTexel[0] = encodeSrgb(color.z);
+                pTexel[1] = encodeSrgb(color.y);
+                pTexel[2] = encodeSrgb(color.x);
+                break;
+            case TexelFormat::R8G8B8A8_UNORM:
+                *reinterpret_cast<Vec4<U8>*>(pTexel) = Vec4<U8>{toU8(color.x), toU8(color.y), toU8(color.z), toU8(color.w)};
+                break;
+            case TexelFormat::R10G10B10A2_UNORM:
+                *reinterpret_cast<U32*>(pTexel) = packUnorm(color.x, 1023) | (packUnorm(color.y, 1023) << 10) |
+                    (packUnorm(color.z, 1023) << 20) | (packUnorm(color.w, 3) << 30);
+                break;
+            case TexelFormat::D24_UNORM_S8_UINT:
+            {
+                // stencil bits are kept.
+                U32& bits = *reinterpret_cast<U32*>(pTexel);
+                bits = (bits & 0xff000000u) | packUnorm(color.x, 0xffffff);
+                break;
+            }
+            case TexelFormat::D16_UNORM:
+                *reinterpret_cast<U16*>(pTexel) = (U16)packUnorm(color.x, 0xffff);
+                break;
+            case TexelFormat::R32_UINT:
+                *reinterpret_cast<U32*>(pTexel) = toU32(color.x);
+                break;
+            default:
+                assert(0);
+        }
     }
 
-    void Texture2D::generateMipmap()
+    Vec4f Texture2D::getTexelAsVec4f(U32 x, U32 y) const
     {
-        // TODO: to support mipmap, the rasterizer must pass adjacent pixel information to here.
+        return getTexelAsVec4f(0, x, y);
     }
 
-    // [ref](https://en.wikipedia.org/wiki/Bilinear_filtering)
-    static Vec4f SampleBilinear(Texture2D const& tex, float u, float v)
+    Vec4f Texture2D::getTexelAsVec4f(U32 level, U32 x, U32 y) const
     {
-        u = u * tex.getWidth() - 0.5f;
-        v = v * tex.getHeight() - 0.5f;
+        if (isBlockCompressed(m_format))
+        {
+            U32 const blocksWide = getNumBlocks(getLevelWidth(level));
+            U32 const blocksHigh = getNumBlocks(getLevelHeight(level));
+            U32 const index = getTexelIndex(m_layout, blocksWide, blocksHigh, x / BLOCK_DIM, y / BLOCK_DIM);
+            U8 const* block = getLevelStorage(level) + index * getBlockSize(m_format);
 
-        int x = std::floor(u);
-        int y = std::floor(v);
-        x = clamp(x, 0, (int)tex.getWidth());
-        y = clamp(y, 0, (int)tex.getHeight());
-        float u_ratio = u - x;
-        float v_ratio = v - y;
-        float u_opposite = 1 - u_ratio;
-        float v_opposite = 1 - v_ratio;
+            U32 const texel = fetchDecodedBlock(m_format, block, getBlockGeneration())[x % BLOCK_DIM + (y % BLOCK_DIM) * BLOCK_DIM];
+            return decodeTexel(getBlockTexelFormat(m_format), reinterpret_cast<U8 const*>(&texel));
+        }
 
-        Vec4f lb = tex.getTexelAsVec4f(x, y);
-        Vec4f rb = tex.getTexelAsVec4f(x+1, y);
-        Vec4f lt = tex.getTexelAsVec4f(x, y+1);
-        Vec4f rt = tex.getTexelAsVec4f(x+1, y+1);
+        return decodeTexel(m_format, readTexel(level, x, y));
+    }
 
-        Vec4f result = interpolate(interpolate(lb, u_opposite, rb, u_ratio), v_opposite,
-                                   interpolate(lt, u_opposite, rt, u_ratio), v_ratio);
+    void Texture2D::generateMipmap()
+    {
+        // block compressed levels are encoded from already filtered ones, see compress.
+        assert(!isBlockCompressed(m_format));
+
+        clearMipmap();
+
+        if (m_texData == nullptr || m_width == 0 || m_height == 0)
+        {
+            return;
+        }
+
+        // layout the whole chain in one allocation.
+        U32 width = m_width;
+        U32 height = m_height;
+        U32 size = 0;
+        while (width > 1 || height > 1)
+        {
+            width = std::max(width / 2, 1u);
+            height = std::max(height / 2, 1u);
+            m_mipLevels.push_back(MipLevel{width, height, size});
+            size += getLevelStorageSize(m_format, m_layout, width, height);
+        }
+        m_mipStorage.resize(size);
+        m_mipData = m_mipStorage.data();
+
+        // levels depend on the previous one, rows of a level are filtered in parallel.
+        for (U32 level = 1; level < getNumLevels(); ++level)
+        {
+            parallelFor(getLevelHeight(level), MIN_ROWS_PER_THREAD, [this, level](std::size_t begin, std::size_t end)
+            {
+                filterMipRows(level, begin, end);
+            });
+        }
+    }
+
+    void Texture2D::filterMipRows(U32 level, U32 beginRow, U32 endRow)
+    {
+        // each level is a 2x2 box filter of the previous one, odd edges repeat the last texel.
+        U32 const srcWidth = getLevelWidth(level - 1);
+        U32 const srcHeight = getLevelHeight(level - 1);
+        U32 const dstWidth = getLevelWidth(level);
+
+        for (U32 y = beginRow; y < endRow; ++y)
+        {
+            U32 const y0 = std::min(y * 2, srcHeight - 1);
+            U32 const y1 = std::min(y * 2 + 1, srcHeight - 1);
+            for (U32 x = 0; x < dstWidth; ++x)
+            {
+                U32 const x0 = std::min(x * 2, srcWidth - 1);
+                U32 const x1 = std::min(x * 2 + 1, srcWidth - 1);
+
+                Vec4f sum = getTexelAsVec4f(level - 1, x0, y0);
+                sum = sum + getTexelAsVec4f(level - 1, x1, y0);
+                sum = sum + getTexelAsVec4f(level - 1, x0, y1);
+                sum = sum + getTexelAsVec4f(level - 1, x1, y1);
+                encodeTexel(m_format, sum * 0.25f, readTexel(level, x, y));
+            }
+        }
+    }
+
+    // 8 bit sources widen to RGBA8, everything else to RGBA32F.
+    static TexelFormat getUploadFormat(TexelFormat srcFormat)
+    {
+        switch (srcFormat)
+        {
+            case TexelFormat::R8G8B8A8_UINT:
+            case TexelFormat::R8G8B8_UINT:
+            case TexelFormat::B8G8R8_UINT:
+                return TexelFormat::R8G8B8A8_UINT;
+            case TexelFormat::R8G8B8A8_SRGB:
+            case TexelFormat::B8G8R8_SRGB:
+                return TexelFormat::R8G8B8A8_SRGB;
+            default:
+                return TexelFormat::R32G32B32A32_FLOAT;
+        }
+    }
+
+    void Texture2D::uploadRows(TexelFormat srcFormat, U8 const* data, U32 beginRow, U32 endRow)
+    {
+        U32 const srcTexelSize = s_texelTypes[(U32)srcFormat].getSize();
+        for (U32 y = beginRow; y < endRow; ++y)
+        {
+            U8 const* src = data + y * m_width * srcTexelSize;
+            for (U32 x = 0; x < m_width; ++x, src += srcTexelSize)
+            {
+                U8* dst = readTexel(x, y);
+                switch (srcFormat)
+                {
+                    // byte shuffles, no round trip through float.
+                    case TexelFormat::R8G8B8A8_UINT:
+                    case TexelFormat::R8G8B8A8_SRGB:
+                        std::memcpy(dst, src, 4);
+                        break;
+                    case TexelFormat::R8G8B8_UINT:
+                        dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = 255;
+                        break;
+                    case TexelFormat::B8G8R8_UINT:
+                    case TexelFormat::B8G8R8_SRGB:
+                        dst[0] = src[2]; dst[1] = src[1]; dst[2] = src[0]; dst[3] = 255;
+                        break;
+                    default:
+                        encodeTexel(m_format, decodeTexel(srcFormat, src), dst);
+                        break;
+                }
+            }
+        }
+    }
+
+    void Texture2D::upload(TexelFormat srcFormat, U32 width, U32 height, U8 const* data, TexelLayout layout)
+    {
+        assert(data != nullptr || width * height == 0);
+        assert(!isBlockCompressed(srcFormat));
+
+        m_format = getUploadFormat(srcFormat);
+        m_layout = layout;
+        m_width = width;
+        m_height = height;
+        m_storage.assign(getLevelStorageSize(m_format, layout, width, height), 0);
+        m_texData = m_storage.empty() ? nullptr : m_storage.data();
+        invalidateSampling();
+
+        parallelFor(height, MIN_ROWS_PER_THREAD, [this, srcFormat, data](std::size_t begin, std::size_t end)
+        {
+            uploadRows(srcFormat, data, begin, end);
+        });
+
+        generateMipmap();
+    }
+
+    // Copies the units, texels or blocks, of a width x height level from one layout to another.
+    static void swizzleLevel(U8 const* src, TexelLayout srcLayout, U8* dst, TexelLayout dstLayout, U32 width, U32 height, U32 unitSize)
+    {
+        for (U32 y = 0; y < height; ++y)
+        {
+            for (U32 x = 0; x < width; ++x)
+            {
+                U32 const srcIndex = getTexelIndex(srcLayout, width, height, x, y);
+                U32 const dstIndex = getTexelIndex(dstLayout, width, height, x, y);
+                std::memcpy(dst + dstIndex * unitSize, src + srcIndex * unitSize, unitSize);
+            }
+        }
+    }
+
+    void Texture2D::swizzle(TexelLayout layout)
+    {
+        if (layout == m_layout || m_texData == nullptr)
+        {
+            return;
+        }
+
+        // block compressed formats move whole blocks.
+        bool const blocks = isBlockCompressed(m_format);
+        U32 const unitSize = blocks ? getBlockSize(m_format) : s_texelTypes[(U32)m_format].getSize();
+        auto unitsOf = [blocks](U32 size) { return blocks ? getNumBlocks(size) : size; };
+
+        // level 0
+        std::vector<U8> storage(getLevelStorageSize(m_format, layout, m_width, m_height));
+        swizzleLevel(m_texData, m_layout, storage.data(), layout, unitsOf(m_width), unitsOf(m_height), unitSize);
+
+        // mip chain, same level sizes with the new padding.
+        std::vector<MipLevel> mipLevels;
+        U32 size = 0;
+        for (MipLevel const& mip : m_mipLevels)
+        {
+            mipLevels.push_back(MipLevel{mip.width, mip.height, size});
+            size += getLevelStorageSize(m_format, layout, mip.width, mip.height);
+        }
+
+        std::vector<U8> mipStorage(size);
+        for (U32 level = 1; level < getNumLevels(); ++level)
+        {
+            MipLevel const& mip = mipLevels[level - 1];
+            swizzleLevel(getLevelStorage(level), m_layout, mipStorage.data() + mip.offset, layout, unitsOf(mip.width), unitsOf(mip.height), unitSize);
+        }
+
+        m_storage.swap(storage);
+        m_texData = m_storage.data();
+        m_mipLevels.swap(mipLevels);
+        m_mipStorage.swap(mipStorage);
+        m_mipData = m_mipStorage.data();
+        m_layout = layout;
+        invalidateSampling();
+    }
+
+    void Texture2D::compressBlockRows(TexelFormat blockFormat, U32 level, U8* dst, U32 beginRow, U32 endRow) const
+    {
+        U32 const width = getLevelWidth(level);
+        U32 const height = getLevelHeight(level);
+        U32 const blocksWide = getNumBlocks(width);
+        U32 const blocksHigh = getNumBlocks(height);
+        U32 const blockSize = getBlockSize(blockFormat);
+
+        for (U32 blockY = beginRow; blockY < endRow; ++blockY)
+        {
+            for (U32 blockX = 0; blockX < blocksWide; ++blockX)
+            {
+                // partial blocks at the right and top edges repeat the last texel.
+                U32 texels[BLOCK_DIM * BLOCK_DIM];
+                for (U32 y = 0; y < BLOCK_DIM; ++y)
+                {
+                    for (U32 x = 0; x < BLOCK_DIM; ++x)
+                    {
+                        U32 const texelX = std::min(blockX * BLOCK_DIM + x, width - 1);
+                        U32 const texelY = std::min(blockY * BLOCK_DIM + y, height - 1);
+                        Vec4f const color = getTexelAsVec4f(level, texelX, texelY);
+                        encodeTexel(getBlockTexelFormat(blockFormat), color, reinterpret_cast<U8*>(&texels[x + y * BLOCK_DIM]));
+                    }
+                }
+
+                U32 const index = getTexelIndex(m_layout, blocksWide, blocksHigh, blockX, blockY);
+                encodeBlock(blockFormat, texels, dst + index * blockSize);
+            }
+        }
+    }
+
+    void Texture2D::compress(TexelFormat blockFormat)
+    {
+        assert(isBlockCompressed(blockFormat));
+
+        // an sRGB texture quantized in linear space bands in the dark steps.
+        assert((getBlockTexelFormat(blockFormat) == TexelFormat::R8G8B8A8_SRGB) ==
+            (m_format == TexelFormat::R8G8B8A8_SRGB || m_format == TexelFormat::B8G8R8_SRGB));
+
+        if (m_texData == nullptr || isBlockCompressed(m_format))
+        {
+            return;
+        }
+
+        std::vector<U8> storage(getLevelStorageSize(blockFormat, m_layout, m_width, m_height));
+        std::vector<MipLevel> mipLevels;
+        U32 size = 0;
+        for (MipLevel const& mip : m_mipLevels)
+        {
+            mipLevels.push_back(MipLevel{mip.width, mip.height, size});
+            size += getLevelStorageSize(blockFormat, m_layout, mip.width, mip.height);
+        }
+        std::vector<U8> mipStorage(size);
+
+        // levels are independent, block rows of each are encoded in parallel.
+        for (U32 level = 0; level < getNumLevels(); ++level)
+        {
+            U8* dst = level == 0 ? storage.data() : mipStorage.data() + mipLevels[level - 1].offset;
+            parallelFor(getNumBlocks(getLevelHeight(level)), MIN_ROWS_PER_THREAD / BLOCK_DIM, [this, blockFormat, level, dst](std::size_t begin, std::size_t end)
+            {
+                compressBlockRows(blockFormat, level, dst, begin, end);
+            });
+        }
+
+        m_storage.swap(storage);
+        m_texData = m_storage.data();
+        m_mipLevels.swap(mipLevels);
+        m_mipStorage.swap(mipStorage);
+        m_mipData = m_mipStorage.data();
+        m_format = blockFormat;
+        invalidateSampling();
+    }
+
+    // Returns size - 1 if size is a power of two, wrapping is a bit mask then, -1 otherwise.
+    static inline int getWrapMask(int size)
+    {
+        return (size & (size - 1)) == 0 ? size - 1 : -1;
+    }
+
+    // Maps a texel coordinate outside of [0, size) back into the level, BORDER returns -1 for outside texels.
+    // mask is getWrapMask(size).
+    template <AddressMode mode>
+    static FORCE_INLINE int addressCoord(int coord, int size, int mask)
+    {
+        switch (mode)
+        {
+            case AddressMode::WRAP:
+            {
+                if (mask >= 0)
+                {
+                    return coord & mask;
+                }
+                int const rest = coord % size;
+                return rest < 0 ? rest + size : rest;
+            }
+            case AddressMode::MIRROR:
+            {
+                // wrap to a period of two levels, mirror the second one.
+                int const period = size * 2;
+                int rest;
+                if (mask >= 0)
+                {
+                    rest = coord & (period - 1);
+                }
+                else
+                {
+                    rest = coord % period;
+                    rest = rest < 0 ? rest + period : rest;
+                }
+                return rest < size ? rest : period - 1 - rest;
+            }
+            case AddressMode::CLAMP:
+                return clamp(coord, 0, size - 1);
+            case AddressMode::BORDER:
+                return coord >= 0 && coord < size ? coord : -1;
+            default:
+                assert(0);
+                return 0;
+        }
+    }
+
+    static inline int addressCoord(AddressMode mode, int coord, int size)
+    {
+        int const mask = getWrapMask(size);
+        switch (mode)
+        {
+            case AddressMode::WRAP:   return addressCoord<AddressMode::WRAP>(coord, size, mask);
+            case AddressMode::MIRROR: return addressCoord<AddressMode::MIRROR>(coord, size, mask);
+            case AddressMode::CLAMP:  return addressCoord<AddressMode::CLAMP>(coord, size, mask);
+            case AddressMode::BORDER: return addressCoord<AddressMode::BORDER>(coord, size, mask);
+            default:
+                assert(0);
+                return 0;
+        }
+    }
+
+#if defined(TEXTURE_STATS)
+    static void recordGenericFetch(Texture2D const& tex, U32 level, U32 x, U32 y)
+    {
+        TexelFormat const format = tex.getFormat();
+        if (isBlockCompressed(format))
+        {
+            U32 const index = getTexelIndex(tex.getLayout(), getNumBlocks(tex.getLevelWidth(level)), getNumBlocks(tex.getLevelHeight(level)), x / BLOCK_DIM, y / BLOCK_DIM);
+            recordTexelFetch(&tex, level, x, y, tex.getLevelStorage(level) + index * getBlockSize(format), getBlockSize(format));
+        }
+        else
+        {
+            recordTexelFetch(&tex, level, x, y, tex.readTexel(level, x, y), s_texelTypes[(U32)format].getSize());
+        }
+    }
+#endif
+
+    static inline Vec4f fetchTexel(Texture2D const& tex, Sampler2D const& samp, U32 level, int x, int y)
+    {
+        if (x < 0 || y < 0)
+        {
+            return samp.borderColor;
+        }
+#if defined(TEXTURE_STATS)
+        recordGenericFetch(tex, level, x, y);
+#endif
+        return tex.getTexelAsVec4f(level, x, y);
+    }
+
+    static FORCE_INLINE bool isLinearTexelFilter(FilterMode filter)
+    {
+        return filter == FilterMode::LINEAR ||
+            filter == FilterMode::LINEAR_MIPMAP_NEAREST ||
+            filter == FilterMode::LINEAR_MIPMAP_LINEAR;
+    }
+
+    // a + (b - a) * t, written per channel so it is always inlined.
+    static FORCE_INLINE Vec4f lerpTexel(Vec4f const& a, Vec4f const& b, float t)
+    {
+        return Vec4f{
+            a.x + (b.x - a.x) * t,
+            a.y + (b.y - a.y) * t,
+            a.z + (b.z - a.z) * t,
+            a.w + (b.w - a.w) * t};
+    }
+
+    // Results of one batched sample.
+    struct TexelBatch
+    {
+        Vec4f texels[SAMPLE_BATCH];
+    };
+
+    static FORCE_INLINE Vec4f blendLevels(Vec4f const& c0, Vec4f const& c1, float ratio)
+    {
+        return lerpTexel(c0, c1, ratio);
+    }
+
+    static FORCE_INLINE TexelBatch blendLevels(TexelBatch const& c0, TexelBatch const& c1, float ratio)
+    {
+        TexelBatch result;
+        for (U32 index = 0; index < SAMPLE_BATCH; ++index)
+        {
+            result.texels[index] = lerpTexel(c0.texels[index], c1.texels[index], ratio);
+        }
         return result;
     }
 
-    static Vec4f SampleNearest(Texture2D const& tex, float u, float v)
+    // Selects and blends mip levels by the mip part of filter, filterLevel(level) samples one level.
+    // Note: filter is a constant in specialized kernels, the switch folds away.
+    template <typename LevelFilter>
+    static FORCE_INLINE auto filterMips(FilterMode filter, U32 numLevels, float lod, LevelFilter const& filterLevel)
+        -> decltype(filterLevel(0u))
     {
-        u = u * tex.getWidth();
-        v = v * tex.getHeight();
+        typedef decltype(filterLevel(0u)) Result;
 
-        float x = std::nearbyint(u);
-        float y = std::nearbyint(v);
+        float const maxLevel = numLevels - 1;
+        lod = clamp(lod, 0.0f, maxLevel);
 
-        Vec4f result = tex.getTexelAsVec4f(x, y);
+        switch (filter)
+        {
+            case FilterMode::NEAREST:
+            case FilterMode::LINEAR:
+                return filterLevel(0);
+            case FilterMode::NEAREST_MIPMAP_NEAREST:
+            case FilterMode::LINEAR_MIPMAP_NEAREST:
+                return filterLevel((U32)std::nearbyint(lod));
+            case FilterMode::NEAREST_MIPMAP_LINEAR:
+            case FilterMode::LINEAR_MIPMAP_LINEAR:
+            {
+                // trilinear when the texel filter is linear, blend the two nearest levels.
+                U32 const level0 = (U32)std::floor(lod);
+                U32 const level1 = std::min(level0 + 1, (U32)maxLevel);
+                float const ratio = lod - level0;
+                Result const c0 = filterLevel(level0);
+                if (level1 == level0 || ratio == 0.0f)
+                {
+                    return c0;
+                }
+                Result const c1 = filterLevel(level1);
+                return blendLevels(c0, c1, ratio);
+            }
+            default:
+                assert(0);
+                return Result{};
+        }
+    }
+
+    ////////////////////////////////////////////////////////////
+    // Generic sampling, any format and sampler state, dispatches on every texel.
+
+    // [ref](https://en.wikipedia.org/wiki/Bilinear_filtering)
+    static Vec4f SampleBilinear(Texture2D const& tex, Sampler2D const& samp, U32 level, float u, float v)
+    {
+        int const width = tex.getLevelWidth(level);
+        int const height = tex.getLevelHeight(level);
+
+        u = u * width - 0.5f;
+        v = v * height - 0.5f;
+
+        int x = std::floor(u);
+        int y = std::floor(v);
+        float u_ratio = u - x;
+        float v_ratio = v - y;
+        float u_opposite = 1 - u_ratio;
+        float v_opposite = 1 - v_ratio;
+
+        int x0 = addressCoord(samp.addressU, x, width);
+        int y0 = addressCoord(samp.addressV, y, height);
+        int x1 = addressCoord(samp.addressU, x + 1, width);
+        int y1 = addressCoord(samp.addressV, y + 1, height);
+
+        Vec4f lb = fetchTexel(tex, samp, level, x0, y0);
+        Vec4f rb = fetchTexel(tex, samp, level, x1, y0);
+        Vec4f lt = fetchTexel(tex, samp, level, x0, y1);
+        Vec4f rt = fetchTexel(tex, samp, level, x1, y1);
+
+        Vec4f result = interpolate(interpolate(lb, u_opposite, rb, u_ratio), v_opposite,
+                                   interpolate(lt, u_opposite, rt, u_ratio), v_ratio);
         return result;
     }
 
-    Vec4f Sample(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv)
+    static Vec4f SampleNearest(Texture2D const& tex, Sampler2D const& samp, U32 level, float u, float v)
+    {
+        int const width = tex.getLevelWidth(level);
+        int const height = tex.getLevelHeight(level);
+
+        int x = addressCoord(samp.addressU, (int)std::floor(u * width), width);
+        int y = addressCoord(samp.addressV, (int)std::floor(v * height), height);
+
+        Vec4f result = fetchTexel(tex, samp, level, x, y);
+        return result;
+    }
+
+    static Vec4f SampleGeneric(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv, float lod)
+    {
+        bool const linear = isLinearTexelFilter(samp.filter);
+        auto filterLevel = [&](U32 level)
+        {
+            return linear ? SampleBilinear(tex, samp, level, uv.x, uv.y) : SampleNearest(tex, samp, level, uv.x, uv.y);
+        };
+        return filterMips(samp.filter, tex.getNumLevels(), lod, filterLevel);
+    }
+
+    static void SampleGenericBatch(Texture2D const& tex, Sampler2D const& samp, Vec2f const* uv, float lod, Vec4f* result)
+    {
+        for (U32 index = 0; index < SAMPLE_BATCH; ++index)
+        {
+            result[index] = SampleGeneric(tex, samp, uv[index], lod);
+        }
+    }
+
+    ////////////////////////////////////////////////////////////
+    // Specialized sampling, one kernel per (format, layout, filter, address mode).
+
+    // Raw texel load, UNORM channels stay in [0, 255] and are scaled once after filtering.
+    template <TexelFormat format>
+    struct TexelLoad;
+
+    template <>
+    struct TexelLoad<TexelFormat::R32G32B32A32_FLOAT>
+    {
+        static constexpr U32 Size = 16;
+        static inline float scale() { return 1.0f; }
+        static FORCE_INLINE Vec4f load(U8 const* p)
+        {
+            Vec4f texel;
+            std::memcpy(&texel, p, sizeof(texel));
+            return texel;
+        }
+    };
+
+    template <>
+    struct TexelLoad<TexelFormat::R32G32B32_FLOAT>
+    {
+        static constexpr U32 Size = 12;
+        static inline float scale() { return 1.0f; }
+        static FORCE_INLINE Vec4f load(U8 const* p)
+        {
+            Vec4f texel{0.0f, 0.0f, 0.0f, 1.0f};
+            std::memcpy(&texel, p, Size);
+            return texel;
+        }
+    };
+
+    template <>
+    struct TexelLoad<TexelFormat::R8G8B8A8_UINT>
+    {
+        static constexpr U32 Size = 4;
+        static inline float scale() { return 1.0f / 255.0f; }
+        static FORCE_INLINE Vec4f load(U8 const* p)
+        {
+            return Vec4f{(float)p[0], (float)p[1], (float)p[2], (float)p[3]};
+        }
+    };
+
+    template <>
+    struct TexelLoad<TexelFormat::R8G8B8_UINT>
+    {
+        static constexpr U32 Size = 3;
+        static inline float scale() { return 1.0f / 255.0f; }
+        static FORCE_INLINE Vec4f load(U8 const* p)
+        {
+            return Vec4f{(float)p[0], (float)p[1], (float)p[2], 255.0f};
+        }
+    };
+
+    template <>
+    struct TexelLoad<TexelFormat::B8G8R8_UINT>
+    {
+        static constexpr U32 Size = 3;
+        static inline float scale() { return 1.0f / 255.0f; }
+        static FORCE_INLINE Vec4f load(U8 const* p)
+        {
+            return Vec4f{(float)p[2], (float)p[1], (float)p[0], 255.0f};
+        }
+    };
+
+    // Channels are linear after the table lookup, no scale.
+    template <>
+    struct TexelLoad<TexelFormat::R8G8B8A8_SRGB>
+    {
+        static constexpr U32 Size = 4;
+        static inline float scale() { return 1.0f; }
+        static FORCE_INLINE Vec4f load(U8 const* p)
+        {
+            return Vec4f{decodeSrgb(p[0]), decodeSrgb(p[1]), decodeSrgb(p[2]), p[3] * (1.0f / 255.0f)};
+        }
+    };
+
+    // Block compressed formats, Size is the block size and load reads a decoded RGBA8 texel.
+    template <>
+    struct TexelLoad<TexelFormat::BC1_UNORM> : TexelLoad<TexelFormat::R8G8B8A8_UINT>
+    {
+        static constexpr U32 Size = 8;
+    };
+
+    template <>
+    struct TexelLoad<TexelFormat::BC3_UNORM> : TexelLoad<TexelFormat::R8G8B8A8_UINT>
+    {
+        static constexpr U32 Size = 16;
+    };
+
+    template <>
+    struct TexelLoad<TexelFormat::BC1_SRGB> : TexelLoad<TexelFormat::R8G8B8A8_SRGB>
+    {
+        static constexpr U32 Size = 8;
+    };
+
+    template <>
+    struct TexelLoad<TexelFormat::BC3_SRGB> : TexelLoad<TexelFormat::R8G8B8A8_SRGB>
+    {
+        static constexpr U32 Size = 16;
+    };
+
+#if defined(__SSE2__)
+    // Widens one RGBA8 texel to four floats in [0, 255].
+    static FORCE_INLINE __m128 widenRGBA8(U32 bits)
+    {
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const bytes = _mm_cvtsi32_si128((int)bits);
+        __m128i const words = _mm_unpacklo_epi8(bytes, zero);
+        return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+    }
+
+    static FORCE_INLINE __m128 lerpSSE(__m128 a, __m128 b, __m128 t)
+    {
+        return _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), t));
+    }
+
+    // Bilinear blend of four RGBA8 texels, all channels at once.
+    static FORCE_INLINE Vec4f blendBilinearRGBA8(U32 lb, U32 rb, U32 lt, U32 rt, float uRatio, float vRatio)
+    {
+        __m128 const u = _mm_set1_ps(uRatio);
+        __m128 const bottom = lerpSSE(widenRGBA8(lb), widenRGBA8(rb), u);
+        __m128 const top = lerpSSE(widenRGBA8(lt), widenRGBA8(rt), u);
+
+        Vec4f result;
+        _mm_storeu_ps(&result.x, lerpSSE(bottom, top, _mm_set1_ps(vRatio)));
+        return result;
+    }
+
+    // SSE2 has no floor, truncate and step down where truncation rounded up.
+    // Truncation goes through int32, floats of magnitude 2^23 or more are integers already and are kept as they are.
+    static FORCE_INLINE __m128 floorSSE(__m128 value)
+    {
+        __m128 const truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(value));
+        __m128 const roundedUp = _mm_cmpgt_ps(truncated, value);
+        __m128 const floored = _mm_sub_ps(truncated, _mm_and_ps(roundedUp, _mm_set1_ps(1.0f)));
+
+        __m128 const magnitude = _mm_andnot_ps(_mm_set1_ps(-0.0f), value);
+        __m128 const integral = _mm_cmpge_ps(magnitude, _mm_set1_ps(8388608.0f));
+        return _mm_or_ps(_mm_and_ps(integral, value), _mm_andnot_ps(integral, floored));
+    }
+#endif
+
+    // One mip level seen through a fixed format, layout and address mode.
+    template <TexelFormat format, TexelLayout layout, AddressMode address>
+    struct LevelSampler
+    {
+        // texels of block compressed formats are read from the decoded block cache.
+        static constexpr bool Blocks = isBlockCompressed(format);
+
+#if defined(TEXTURE_STATS)
+        Texture2D const& texture;
+        U32 level;
+#endif
+        U8 const* base;
+        int width;
+        int height;
+        int maskX;          // wrap masks, see getWrapMask.
+        int maskY;
+        Vec4f border;       // border color in raw channel range.
+        U32 generation;     // block cache generation, block formats only.
+        TexelIndexer<layout> indexer;
+
+        FORCE_INLINE LevelSampler(Texture2D const& tex, Sampler2D const& samp, U32 mipLevel)
+#if defined(TEXTURE_STATS)
+            : texture(tex)
+            , level{mipLevel}
+            , base{tex.getLevelStorage(mipLevel)}
+#else
+            : base{tex.getLevelStorage(mipLevel)}
+#endif
+            , width{(int)tex.getLevelWidth(mipLevel)}
+            , height{(int)tex.getLevelHeight(mipLevel)}
+            , maskX{getWrapMask(width)}
+            , maskY{getWrapMask(height)}
+            , border{samp.borderColor * (1.0f / TexelLoad<format>::scale())}
+            , generation{Blocks ? getBlockGeneration() : 0}
+            , indexer{Blocks ? getNumBlocks(width) : (U32)width, Blocks ? getNumBlocks(height) : (U32)height}
+        {
+        }
+
+        FORCE_INLINE U8 const* texelAddr(int x, int y) const
+        {
+            return base + indexer.index(x, y) * TexelLoad<format>::Size;
+        }
+
+        // Texel (x, y) is read at addr, compiled out unless TEXTURE_STATS.
+        FORCE_INLINE void record(int x, int y, U8 const* addr) const
+        {
+#if defined(TEXTURE_STATS)
+            recordTexelFetch(&texture, level, x, y, addr, TexelLoad<format>::Size);
+#else
+            (void)x; (void)y; (void)addr;
+#endif
+        }
+
+        // RGBA8 texel at (x, y) packed in a U32, formats of the SIMD path only.
+        FORCE_INLINE U32 loadBits(int x, int y) const
+        {
+            if (Blocks)
+            {
+                U8 const* block = texelAddr(x / BLOCK_DIM, y / BLOCK_DIM);
+                record(x, y, block);
+                U32 const* texels = fetchDecodedBlock(format, block, generation);
+                return texels[x % BLOCK_DIM + (y % BLOCK_DIM) * BLOCK_DIM];
+            }
+
+            U8 const* addr = texelAddr(x, y);
+            record(x, y, addr);
+            U32 bits;
+            std::memcpy(&bits, addr, sizeof(bits));
+            return bits;
+        }
+
+        FORCE_INLINE Vec4f fetch(int x, int y) const
+        {
+            if (address == AddressMode::BORDER && (x < 0 || y < 0))
+            {
+                return border;
+            }
+
+            if (Blocks)
+            {
+                U32 const bits = loadBits(x, y);
+                return TexelLoad<format>::load(reinterpret_cast<U8 const*>(&bits));
+            }
+
+            U8 const* addr = texelAddr(x, y);
+            record(x, y, addr);
+            return TexelLoad<format>::load(addr);
+        }
+
+        // The SIMD path, taps of BORDER may be outside of the level and go through fetch.
+        // sRGB blocks are filtered after the decode to linear, not on the encoded bytes.
+        static constexpr bool SimdBilinear =
+#if defined(__SSE2__)
+            (format == TexelFormat::R8G8B8A8_UINT || format == TexelFormat::BC1_UNORM || format == TexelFormat::BC3_UNORM) &&
+            address != AddressMode::BORDER;
+#else
+            false;
+#endif
+
+        FORCE_INLINE Vec4f nearest(float u, float v) const
+        {
+            int x = addressCoord<address>((int)std::floor(u * width), width, maskX);
+            int y = addressCoord<address>((int)std::floor(v * height), height, maskY);
+            return fetch(x, y);
+        }
+
+        FORCE_INLINE Vec4f bilinear(float u, float v) const
+        {
+            u = u * width - 0.5f;
+            v = v * height - 0.5f;
+
+            int const x = std::floor(u);
+            int const y = std::floor(v);
+            float const u_ratio = u - x;
+            float const v_ratio = v - y;
+
+            int const x0 = addressCoord<address>(x, width, maskX);
+            int const y0 = addressCoord<address>(y, height, maskY);
+            int const x1 = addressCoord<address>(x + 1, width, maskX);
+            int const y1 = addressCoord<address>(y + 1, height, maskY);
+
+            return blend(x0, y0, x1, y1, u_ratio, v_ratio);
+        }
+
+        FORCE_INLINE Vec4f blend(int x0, int y0, int x1, int y1, float u_ratio, float v_ratio) const
+        {
+#if defined(__SSE2__)
+            if (SimdBilinear)
+            {
+                return blendBilinearRGBA8(loadBits(x0, y0), loadBits(x1, y0), loadBits(x0, y1), loadBits(x1, y1), u_ratio, v_ratio);
+            }
+#endif
+            Vec4f const lb = fetch(x0, y0);
+            Vec4f const rb = fetch(x1, y0);
+            Vec4f const lt = fetch(x0, y1);
+            Vec4f const rt = fetch(x1, y1);
+
+            return lerpTexel(lerpTexel(lb, rb, u_ratio), lerpTexel(lt, rt, u_ratio), v_ratio);
+        }
+
+        FORCE_INLINE void nearestBatch(Vec2f const* uv, Vec4f* result) const
+        {
+            for (U32 index = 0; index < SAMPLE_BATCH; ++index)
+            {
+                result[index] = nearest(uv[index].x, uv[index].y);
+            }
+        }
+
+        FORCE_INLINE void bilinearBatch(Vec2f const* uv, Vec4f* result) const
+        {
+#if defined(__SSE2__)
+            if (SimdBilinear)
+            {
+                // texel space coordinates and weights of the whole batch at once.
+                __m128 const half = _mm_set1_ps(0.5f);
+                __m128 const u = _mm_sub_ps(_mm_mul_ps(_mm_setr_ps(uv[0].x, uv[1].x, uv[2].x, uv[3].x), _mm_set1_ps((float)width)), half);
+                __m128 const v = _mm_sub_ps(_mm_mul_ps(_mm_setr_ps(uv[0].y, uv[1].y, uv[2].y, uv[3].y), _mm_set1_ps((float)height)), half);
+                __m128 const uFloor = floorSSE(u);
+                __m128 const vFloor = floorSSE(v);
+
+                // texel coordinates outside of the int32 range convert to INT_MIN, addressCoord maps them into the level.
+                int xs[SAMPLE_BATCH], ys[SAMPLE_BATCH];
+                float uRatios[SAMPLE_BATCH], vRatios[SAMPLE_BATCH];
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(xs), _mm_cvttps_epi32(uFloor));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(ys), _mm_cvttps_epi32(vFloor));
+                _mm_storeu_ps(uRatios, _mm_sub_ps(u, uFloor));
+                _mm_storeu_ps(vRatios, _mm_sub_ps(v, vFloor));
+
+                for (U32 index = 0; index < SAMPLE_BATCH; ++index)
+                {
+                    int const x0 = addressCoord<address>(xs[index], width, maskX);
+                    int const y0 = addressCoord<address>(ys[index], height, maskY);
+                    int const x1 = addressCoord<address>(xs[index] + 1, width, maskX);
+                    int const y1 = addressCoord<address>(ys[index] + 1, height, maskY);
+                    result[index] = blend(x0, y0, x1, y1, uRatios[index], vRatios[index]);
+                }
+                return;
+            }
+#endif
+            for (U32 index = 0; index < SAMPLE_BATCH; ++index)
+            {
+                result[index] = bilinear(uv[index].x, uv[index].y);
+            }
+        }
+    };
+
+    template <TexelFormat format, TexelLayout layout, FilterMode filter, AddressMode address>
+    struct KernelLevelFilter
+    {
+        Texture2D const& tex;
+        Sampler2D const& samp;
+        Vec2f const& uv;
+
+        FORCE_INLINE Vec4f operator()(U32 level) const
+        {
+            LevelSampler<format, layout, address> const sampler{tex, samp, level};
+            return isLinearTexelFilter(filter) ? sampler.bilinear(uv.x, uv.y) : sampler.nearest(uv.x, uv.y);
+        }
+    };
+
+    template <TexelFormat format, TexelLayout layout, FilterMode filter, AddressMode address>
+    struct KernelBatchLevelFilter
+    {
+        Texture2D const& tex;
+        Sampler2D const& samp;
+        Vec2f const* uv;
+
+        FORCE_INLINE TexelBatch operator()(U32 level) const
+        {
+            LevelSampler<format, layout, address> const sampler{tex, samp, level};
+            TexelBatch result;
+            if (isLinearTexelFilter(filter))
+            {
+                sampler.bilinearBatch(uv, result.texels);
+            }
+            else
+            {
+                sampler.nearestBatch(uv, result.texels);
+            }
+            return result;
+        }
+    };
+
+    template <TexelFormat format, TexelLayout layout, FilterMode filter, AddressMode address>
+    static Vec4f SampleKernel(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv, float lod)
+    {
+        KernelLevelFilter<format, layout, filter, address> const filterLevel{tex, samp, uv};
+        Vec4f const result = filterMips(filter, tex.getNumLevels(), lod, filterLevel);
+        float const scale = TexelLoad<format>::scale();
+        return Vec4f{result.x * scale, result.y * scale, result.z * scale, result.w * scale};
+    }
+
+    template <TexelFormat format, TexelLayout layout, FilterMode filter, AddressMode address>
+    static void SampleBatchKernel(Texture2D const& tex, Sampler2D const& samp, Vec2f const* uv, float lod, Vec4f* result)
+    {
+        KernelBatchLevelFilter<format, layout, filter, address> const filterLevel{tex, samp, uv};
+        TexelBatch const batch = filterMips(filter, tex.getNumLevels(), lod, filterLevel);
+        float const scale = TexelLoad<format>::scale();
+        for (U32 index = 0; index < SAMPLE_BATCH; ++index)
+        {
+            Vec4f const& texel = batch.texels[index];
+            result[index] = Vec4f{texel.x * scale, texel.y * scale, texel.z * scale, texel.w * scale};
+        }
+    }
+
+    // Kernel tables walked by selectSampleKernel, one per sampling entry.
+    struct SingleKernels
+    {
+        typedef SampleFunc Func;
+
+        template <TexelFormat format, TexelLayout layout, FilterMode filter, AddressMode address>
+        static Func get() { return &SampleKernel<format, layout, filter, address>; }
+
+        static Func generic() { return &SampleGeneric; }
+    };
+
+    struct BatchKernels
+    {
+        typedef SampleBatchFunc Func;
+
+        template <TexelFormat format, TexelLayout layout, FilterMode filter, AddressMode address>
+        static Func get() { return &SampleBatchKernel<format, layout, filter, address>; }
+
+        static Func generic() { return &SampleGenericBatch; }
+    };
+
+    template <typename Kernels, TexelFormat format, TexelLayout layout, FilterMode filter>
+    static typename Kernels::Func selectSampleKernel(AddressMode address)
+    {
+        switch (address)
+        {
+            case AddressMode::WRAP:   return Kernels::template get<format, layout, filter, AddressMode::WRAP>();
+            case AddressMode::MIRROR: return Kernels::template get<format, layout, filter, AddressMode::MIRROR>();
+            case AddressMode::CLAMP:  return Kernels::template get<format, layout, filter, AddressMode::CLAMP>();
+            case AddressMode::BORDER: return Kernels::template get<format, layout, filter, AddressMode::BORDER>();
+            default:                  return nullptr;
+        }
+    }
+
+    template <typename Kernels, TexelFormat format, TexelLayout layout>
+    static typename Kernels::Func selectSampleKernel(FilterMode filter, AddressMode address)
+    {
+        switch (filter)
+        {
+            case FilterMode::NEAREST:                return selectSampleKernel<Kernels, format, layout, FilterMode::NEAREST>(address);
+            case FilterMode::LINEAR:                 return selectSampleKernel<Kernels, format, layout, FilterMode::LINEAR>(address);
+            case FilterMode::NEAREST_MIPMAP_NEAREST: return selectSampleKernel<Kernels, format, layout, FilterMode::NEAREST_MIPMAP_NEAREST>(address);
+            case FilterMode::LINEAR_MIPMAP_NEAREST:  return selectSampleKernel<Kernels, format, layout, FilterMode::LINEAR_MIPMAP_NEAREST>(address);
+            case FilterMode::NEAREST_MIPMAP_LINEAR:  return selectSampleKernel<Kernels, format, layout, FilterMode::NEAREST_MIPMAP_LINEAR>(address);
+            case FilterMode::LINEAR_MIPMAP_LINEAR:   return selectSampleKernel<Kernels, format, layout, FilterMode::LINEAR_MIPMAP_LINEAR>(address);
+            default:                                 return nullptr;
+        }
+    }
+
+    template <typename Kernels, TexelFormat format>
+    static typename Kernels::Func selectSampleKernel(TexelLayout layout, FilterMode filter, AddressMode address)
+    {
+        switch (layout)
+        {
+            case TexelLayout::LINEAR:    return selectSampleKernel<Kernels, format, TexelLayout::LINEAR>(filter, address);
+            case TexelLayout::TILED_4X4: return selectSampleKernel<Kernels, format, TexelLayout::TILED_4X4>(filter, address);
+            case TexelLayout::MORTON:    return selectSampleKernel<Kernels, format, TexelLayout::MORTON>(filter, address);
+            default:                     return nullptr;
+        }
+    }
+
+    template <typename Kernels>
+    static typename Kernels::Func selectSampleKernel(TexelFormat format, TexelLayout layout, Sampler2D const& samp)
+    {
+        // one address mode for both axes, mixed modes take the generic path.
+        if (samp.addressU != samp.addressV)
+        {
+            return Kernels::generic();
+        }
+
+        typename Kernels::Func func = nullptr;
+        switch (format)
+        {
+            case TexelFormat::R32G32B32A32_FLOAT:
+                func = selectSampleKernel<Kernels, TexelFormat::R32G32B32A32_FLOAT>(layout, samp.filter, samp.addressU);
+                break;
+            case TexelFormat::R32G32B32_FLOAT:
+                func = selectSampleKernel<Kernels, TexelFormat::R32G32B32_FLOAT>(layout, samp.filter, samp.addressU);
+                break;
+            case TexelFormat::R8G8B8A8_UINT:
+                func = selectSampleKernel<Kernels, TexelFormat::R8G8B8A8_UINT>(layout, samp.filter, samp.addressU);
+                break;
+            case TexelFormat::R8G8B8_UINT:
+                func = selectSampleKernel<Kernels, TexelFormat::R8G8B8_UINT>(layout, samp.filter, samp.addressU);
+                break;
+            case TexelFormat::B8G8R8_UINT:
+                func = selectSampleKernel<Kernels, TexelFormat::B8G8R8_UINT>(layout, samp.filter, samp.addressU);
+                break;
+            case TexelFormat::BC1_UNORM:
+                func = selectSampleKernel<Kernels, TexelFormat::BC1_UNORM>(layout, samp.filter, samp.addressU);
+                break;
+            case TexelFormat::BC3_UNORM:
+                func = selectSampleKernel<Kernels, TexelFormat::BC3_UNORM>(layout, samp.filter, samp.addressU);
+                break;
+            case TexelFormat::BC1_SRGB:
+                func = selectSampleKernel<Kernels, TexelFormat::BC1_SRGB>(layout, samp.filter, samp.addressU);
+                break;
+            case TexelFormat::BC3_SRGB:
+                func = selectSampleKernel<Kernels, TexelFormat::BC3_SRGB>(layout, samp.filter, samp.addressU);
+                break;
+            case TexelFormat::R8G8B8A8_SRGB:
+                func = selectSampleKernel<Kernels, TexelFormat::R8G8B8A8_SRGB>(layout, samp.filter, samp.addressU);
+                break;
+            default:
+                break;
+        }
+
+        return func != nullptr ? func : Kernels::generic();
+    }
+
+    static inline U32 packSampler(Sampler2D const& samp)
+    {
+        return (U32)samp.filter | ((U32)samp.addressU << 8) | ((U32)samp.addressV << 16);
+    }
+
+    SampleFunc Texture2D::getSampleFunc(Sampler2D const& samp) const
+    {
+        U32 const key = packSampler(samp);
+        if (m_sampleFunc == nullptr || m_sampleKey != key)
+        {
+            m_sampleFunc = selectSampleKernel<SingleKernels>(m_format, m_layout, samp);
+            m_sampleBatchFunc = selectSampleKernel<BatchKernels>(m_format, m_layout, samp);
+            m_sampleKey = key;
+        }
+        return m_sampleFunc;
+    }
+
+    SampleBatchFunc Texture2D::getSampleBatchFunc(Sampler2D const& samp) const
+    {
+        // both paths are resolved together.
+        getSampleFunc(samp);
+        return m_sampleBatchFunc;
+    }
+
+    Vec4f SampleLevel(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv, float lod)
     {
         if (tex.getStorage() == nullptr)
         {
             return Vec4f{};
         }
 
-        switch (samp.filter)
+#if defined(TEXTURE_STATS)
+        recordSamples(1);
+#endif
+        return tex.getSampleFunc(samp)(tex, samp, uv, lod);
+    }
+
+    Vec4f SampleLevelGeneric(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv, float lod)
+    {
+        if (tex.getStorage() == nullptr)
         {
-            case FilterMode::NEAREST:
-                return SampleNearest(tex, uv.x, uv.y);
-            case FilterMode::LINEAR:
-                return SampleBilinear(tex, uv.x, uv.y);
-            default:
-                return Vec4f{};
+            return Vec4f{};
+        }
+        return SampleGeneric(tex, samp, uv, lod);
+    }
+
+    void SampleLevelBatch(Texture2D const& tex, Sampler2D const& samp, Vec2f const* uv, float lod, Vec4f* result)
+    {
+        if (tex.getStorage() == nullptr)
+        {
+            for (U32 index = 0; index < SAMPLE_BATCH; ++index)
+            {
+                result[index] = Vec4f{};
+            }
+            return;
         }
+
+#if defined(TEXTURE_STATS)
+        recordSamples(SAMPLE_BATCH);
+#endif
+        tex.getSampleBatchFunc(samp)(tex, samp, uv, lod, result);
+    }
+
+    Vec4f SampleGrad(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv, Vec2f const& ddx, Vec2f const& ddy)
+    {
+        // lod = log2(rho), rho is the longer footprint axis in level 0 texel space.
+        // [ref](https://www.khronos.org/registry/OpenGL/specs/gl/glspec46.core.pdf) 8.14.1
+        float const width = tex.getWidth();
+        float const height = tex.getHeight();
+        float const dxu = ddx.x * width, dxv = ddx.y * height;
+        float const dyu = ddy.x * width, dyv = ddy.y * height;
+        float const rho2 = std::max(dxu * dxu + dxv * dxv, dyu * dyu + dyv * dyv);
+        float const lod = rho2 > 0.0f ? 0.5f * std::log2(rho2) : 0.0f;
+
+        return SampleLevel(tex, samp, uv, lod);
+    }
+
+    Vec4f Sample(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv)
+    {
+        return SampleLevel(tex, samp, uv, 0.0f);
     }
 
     void saveAsBmp(std::string const& filename, Texture2D const& texture)
+    {
+        saveAsBmp(filename, texture, [](U32, U32) { return false; }, nullptr);
+    }
+
+    void saveAsBmp(std::string const& filename, Texture2D const& texture, std::function<bool(U32, U32)> const& isClear, U8 const* clearTexel)
     {
         U32 width = texture.getWidth();
         U32 height = texture.getHeight();
 
+        TexelFormat const format = texture.getFormat();
+        bool const isDepth = s_texelTypes[(U32)format].hasChannel(TexelType::ChannelType::Depth);
+
         bitmap_image image(width, height);
         for (U32 x = 0; x < width; x ++)
         {
@@ -299,26 +1992,22 @@ namespace Texture {
                 U32 const screen_x = x;
                 U32 const screen_y = height - y - 1;
 
-                switch (texture.getFormat())
+                U8 const* texel = isClear(x, y) ? clearTexel : texture.readTexel(x, y);
+                if (isDepth)
                 {
-                    case TexelFormat::R32G32B32_FLOAT:
-                    {
-                        Vec3f const& color = texture.getTexel<Vec3f const>(x, y);
-                        image.set_pixel(screen_x, screen_y,
-                            clamp(U32(color.x * 255), 0u, 255u),
-                            clamp(U32(color.y * 255), 0u, 255u),
-                            clamp(U32(color.z * 255), 0u, 255u));
-                        break;
-                    }
-                    case TexelFormat::D32_FLOAT:
-                    {
-                        float depth = texture.getTexel<float>(x, y);
-                        U8 gray = depth * 256;
-                        image.set_pixel(screen_x, screen_y, gray, gray, gray);
-                        break;
-                    }
-                    default:
-                        assert(0);
+                    float depth = decodeTexel(format, texel).x;
+                    U8 gray = depth * 256;
+                    image.set_pixel(screen_x, screen_y, gray, gray, gray);
+                }
+                else if (format == TexelFormat::R8G8B8A8_SRGB)
+                {
+                    // already encoded.
+                    image.set_pixel(screen_x, screen_y, texel[0], texel[1], texel[2]);
+                }
+                else
+                {
+                    Vec4f const color = decodeTexel(format, texel);
+                    image.set_pixel(screen_x, screen_y, encodeSrgb(color.x), encodeSrgb(color.y), encodeSrgb(color.z));
                 }
             }
         }
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <iostream>
+#include <functional>
 
 #include "vmath.h"
 
@@ -17,12 +18,13 @@ namespace Device { namespace Texture {
         LINEAR_MIPMAP_LINEAR,
     };
 
+    // How texel coordinates outside of the level are resolved, per axis.
     enum class AddressMode
     {
-        WRAP,
-        MIRROR,
-        CLAMP,
-        BORDER,
+        WRAP,   // repeat.
+        MIRROR, // repeat, every other period is mirrored.
+        CLAMP,  // clamp to the edge texel.
+        BORDER, // outside texels read the sampler's border color.
     };
 
     struct Sampler2D
@@ -30,6 +32,7 @@ namespace Device { namespace Texture {
         FilterMode filter;
         AddressMode addressU;
         AddressMode addressV;
+        Vec4f borderColor;
     };
 
     std::ostream &operator<<(std::ostream &stream, Sampler2D const& samp);
@@ -47,46 +50,157 @@ namespace Device { namespace Texture {
         R8G8B8_UINT,
         B8G8R8_UINT,
         D32_FLOAT,
+        BC1_UNORM, // 4x4 blocks of 8 bytes, two 565 endpoints and 2 bit indices, opaque.
+        BC3_UNORM, // 4x4 blocks of 16 bytes, BC1 color plus two 8 bit alpha endpoints and 3 bit indices.
+        R8G8B8A8_SRGB, // color channels are sRGB encoded, they are linear once fetched, alpha is linear.
+        B8G8R8_SRGB,
+        R8G8B8A8_UNORM,
+        R10G10B10A2_UNORM, // red in the lowest bits of a 32 bit texel.
+        D24_UNORM_S8_UINT, // depth in the lowest 24 bits, stencil in the highest 8.
+        D16_UNORM,
+        R32_UINT, // one 32 bit channel, e.g. the ids of a visibility buffer.
+        BC1_SRGB, // BC1_UNORM with sRGB encoded color, like R8G8B8A8_SRGB once decoded.
+        BC3_SRGB, // BC3_UNORM with sRGB encoded color, alpha is linear.
     };
 
+    // Bytes per texel, a decoded texel for block compressed formats.
+    U32 getTexelSize(TexelFormat format);
+
+    // Conversion of one texel between format and float channels, block compressed formats are not supported.
+    // Note: encoding depth keeps the stencil bits of the texel.
+    Vec4f decodeTexel(TexelFormat format, U8 const* pTexel);
+
+    void encodeTexel(TexelFormat format, Vec4f const& color, U8* pTexel);
+
+    // Rounds value in [0, 1] to the nearest step of an unsigned normalized channel of maxValue steps.
+    inline U32 packUnorm(float value, U32 maxValue)
+    {
+        return (U32)(clamp(value, 0.0f, 1.0f) * maxValue + 0.5f);
+    }
+
+    // Block compressed formats store 4x4 texel blocks, blocks take the place of texels in the layout.
+    static constexpr U32 BLOCK_DIM = 4;
+
+    constexpr bool isBlockCompressed(TexelFormat format)
+    {
+        return format == TexelFormat::BC1_UNORM || format == TexelFormat::BC3_UNORM ||
+            format == TexelFormat::BC1_SRGB || format == TexelFormat::BC3_SRGB;
+    }
+
+    // Texel order inside each mip level.
+    enum class TexelLayout
+    {
+        LINEAR,    // row-major.
+        TILED_4X4, // 4x4 tiles in row-major order, texels are row-major inside a tile.
+        MORTON,    // Z-order curve, each dimension is padded to power of two.
+        TILED_8X8_MORTON, // 8x8 tiles in row-major order, texels are in Z-order inside a tile.
+    };
+
+    class Texture2D;
+
+    // A sampling path resolved for one texture and sampler state.
+    typedef Vec4f (*SampleFunc)(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv, float lod);
+
+    // The batched variant, SAMPLE_BATCH texcoords sampled at one level of detail.
+    static constexpr U32 SAMPLE_BATCH = 4;
+    typedef void (*SampleBatchFunc)(Texture2D const& tex, Sampler2D const& samp, Vec2f const* uv, float lod, Vec4f* result);
+
     class Texture2D
     {
     protected:
+        // mip level 1 and above, level 0 is m_texData.
+        struct MipLevel
+        {
+            U32 width;
+            U32 height;
+            U32 offset; // offset in m_mipStorage.
+        };
+
         TexelFormat m_format;
+        TexelLayout m_layout;
         U32 m_width;
         U32 m_height;
-        U8* m_texData;
-        U8* m_mipmapData;
+        U8* m_texData;         // level 0, borrowed unless it points to m_storage.
+        std::vector<U8> m_storage;
+
+        // mip chain is owned by the texture, unless it is a view.
+        std::vector<MipLevel> m_mipLevels;
+        U8* m_mipData;         // level 1 and above, borrowed unless it points to m_mipStorage.
+        std::vector<U8> m_mipStorage;
+
+        // sampling path of the last sampler state, depends on format and layout.
+        mutable SampleFunc m_sampleFunc;
+        mutable SampleBatchFunc m_sampleBatchFunc;
+        mutable U32 m_sampleKey;
+
+        inline void clearMipmap() { m_mipLevels.clear(); m_mipStorage.clear(); m_mipData = nullptr; }
+
+        // Called whenever format, layout or texel storage change, drops the resolved sampling paths and decoded blocks.
+        void invalidateSampling();
+
+        inline bool ownsStorage() const { return !m_storage.empty() && m_texData == m_storage.data(); }
+
+        inline bool ownsMipStorage() const { return !m_mipStorage.empty() && m_mipData == m_mipStorage.data(); }
+
+        // rows below this are not worth a thread of their own.
+        static constexpr U32 MIN_ROWS_PER_THREAD = 64;
+
+        // Box filter rows [beginRow, endRow) of level from level - 1.
+        void filterMipRows(U32 level, U32 beginRow, U32 endRow);
+
+        // Convert rows [beginRow, endRow) of linear srcFormat data into level 0.
+        void uploadRows(TexelFormat srcFormat, U8 const* data, U32 beginRow, U32 endRow);
+
+        // Encode block rows [beginRow, endRow) of level into dst in blockFormat.
+        void compressBlockRows(TexelFormat blockFormat, U32 level, U8* dst, U32 beginRow, U32 endRow) const;
 
     public:
         Texture2D()
             : m_format{TexelFormat::UNKNOWN}
+            , m_layout{TexelLayout::LINEAR}
             , m_width{0}
             , m_height{0}
             , m_texData{nullptr}
-            , m_mipmapData{nullptr}
+            , m_storage{}
+            , m_mipLevels{}
+            , m_mipData{nullptr}
+            , m_mipStorage{}
+            , m_sampleFunc{nullptr}
+            , m_sampleBatchFunc{nullptr}
+            , m_sampleKey{0}
         {
         }
 
+        // Borrowed storage is always linear.
         Texture2D(TexelFormat format, U32 width, U32 height, U8* storage)
             : m_format{format}
+            , m_layout{TexelLayout::LINEAR}
             , m_width{width}
             , m_height{height}
             , m_texData{storage}
-            , m_mipmapData{nullptr}
+            , m_storage{}
+            , m_mipLevels{}
+            , m_mipData{nullptr}
+            , m_mipStorage{}
+            , m_sampleFunc{nullptr}
+            , m_sampleBatchFunc{nullptr}
+            , m_sampleKey{0}
         {
         }
 
-        ~Texture2D()
-        {
-            if (m_mipmapData != nullptr)
-            {
-                free(m_mipmapData);
-                m_mipmapData = nullptr;
-            }
-        }
+        Texture2D(Texture2D const& other);
+
+        Texture2D(Texture2D&& other) = default;
+
+        Texture2D& operator=(Texture2D const& other);
 
-        inline void setFormat(TexelFormat format) { m_format = format; }
+        Texture2D& operator=(Texture2D&& other) = default;
+
+        // A texture borrowing every level of source, no texel is copied and cached blocks stay valid.
+        // source must outlive the view, and its texels must not change while the view is sampled.
+        static Texture2D view(Texture2D const& source);
+
+        inline void setFormat(TexelFormat format) { m_format = format; invalidateSampling(); }
 
         inline TexelFormat getFormat() const { return m_format; }
 
@@ -98,12 +212,24 @@ namespace Device { namespace Texture {
 
         inline U32 getHeight() const { return m_height; }
 
-        inline void setSize(U32 width, U32 height) { m_width = width; m_height = height; }
+        inline void setSize(U32 width, U32 height) { m_width = width; m_height = height; clearMipmap(); }
 
-        inline void setStorage(U8* storage) { m_texData = storage; }
+        // Borrow storage of layout, see texel_layout.h for the size of a level.
+        inline void setStorage(U8* storage, TexelLayout layout = TexelLayout::LINEAR) { m_texData = storage; m_layout = layout; m_storage.clear(); invalidateSampling(); clearMipmap(); }
 
         inline U8* getStorage() const { return m_texData; }
 
+        inline TexelLayout getLayout() const { return m_layout; }
+
+        inline U32 getNumLevels() const { return 1 + m_mipLevels.size(); }
+
+        inline U32 getLevelWidth(U32 level) const { return level == 0 ? m_width : m_mipLevels[level - 1].width; }
+
+        inline U32 getLevelHeight(U32 level) const { return level == 0 ? m_height : m_mipLevels[level - 1].height; }
+
+        // Texel (0, 0) starts the level in every layout.
+        inline U8 const* getLevelStorage(U32 level) const { return level == 0 ? m_texData : m_mipData + m_mipLevels[level - 1].offset; }
+
         template <typename T>
         void setTexel(U32 x, U32 y, T const& newTexel)
         {
@@ -119,21 +245,70 @@ namespace Device { namespace Texture {
 
         Vec4f getTexelAsVec4f(U32 x, U32 y) const;
 
+        Vec4f getTexelAsVec4f(U32 level, U32 x, U32 y) const;
+
         void writeTexel(U32 x, U32 y, U8* pNewTexel);
 
         U8* readTexel(U32 x, U32 y) const;
 
+        U8* readTexel(U32 level, U32 x, U32 y) const;
+
+        // Build the full mip chain down to 1x1 with a box filter, replaces any existing chain.
         void generateMipmap();
+
+        // Reorder texels of all levels into layout, level 0 storage becomes owned by the texture.
+        void swizzle(TexelLayout layout);
+
+        // Encode all levels into the block compressed blockFormat, sampling decodes blocks on the fly.
+        // Build the mip chain before, block compressed levels can not be filtered.
+        // sRGB textures take BC1_SRGB or BC3_SRGB, their colors stay sRGB encoded so dark steps are kept.
+        void compress(TexelFormat blockFormat);
+
+        // Convert row-major srcFormat data once into owned storage of layout and build the mip chain.
+        // The texel format becomes R8G8B8A8_UINT for 8 bit sources and R32G32B32A32_FLOAT otherwise,
+        // so fetches are aligned and need no swizzling. data is not referenced after the call.
+        void upload(TexelFormat srcFormat, U32 width, U32 height, U8 const* data, TexelLayout layout = TexelLayout::LINEAR);
+
+        // Returns the sampling path specialized on format, layout and samp, resolved once per sampler state.
+        SampleFunc getSampleFunc(Sampler2D const& samp) const;
+
+        SampleBatchFunc getSampleBatchFunc(Sampler2D const& samp) const;
     };
 
     std::ostream &operator<<(std::ostream &stream, Texture2D const& tex);
 
     // [Ref](http://www.shaderific.com/glsl-functions/)
     // From OpenGL texture() spec, it returns a vec4
+    // Mipmap filters sample level 0 here since no derivatives are given.
     Vec4f Sample(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv);
 
+    // Sample with an explicit level of detail.
+    Vec4f SampleLevel(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv, float lod);
+
+    // SampleLevel through the generic path, not specialized on the format or the sampler state.
+    // The reference of the specialized kernels.
+    Vec4f SampleLevelGeneric(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv, float lod);
+
+    // Sample SAMPLE_BATCH texcoords with one level of detail, e.g. the lanes of a quad.
+    void SampleLevelBatch(Texture2D const& tex, Sampler2D const& samp, Vec2f const* uv, float lod, Vec4f* result);
+
+    // Sample with the screen space derivatives of uv, used to select the level of detail.
+    Vec4f SampleGrad(Texture2D const& tex, Sampler2D const& samp, Vec2f const& uv, Vec2f const& ddx, Vec2f const& ddy);
+
+    // sRGB transfer functions through lookup tables, a table load instead of a pow.
+    // [ref](https://en.wikipedia.org/wiki/SRGB)
+    float srgbToLinear(U8 value);
+
+    // value is clamped to [0, 1] and quantized to 4096 steps before encoding.
+    U8 linearToSrgb(float value);
+
+    // Linear color targets are encoded to sRGB, depth targets are saved as gray.
     void saveAsBmp(std::string const& filename, Texture2D const& colorTarget);
 
+    // Texels for which isClear(x, y) holds are not read, clearTexel is saved in their place.
+    // clearTexel is a texel of the texture's format.
+    void saveAsBmp(std::string const& filename, Texture2D const& colorTarget, std::function<bool(U32, U32)> const& isClear, U8 const* clearTexel);
+
 } // namespace Texture
 } // namespace Device
 #endif // _TEXTURE_H_
@@ -0,0 +1,203 @@
+#include "texture_stats.h"
+
+#if defined(TEXTURE_STATS)
+
+#include <map>
+#include <vector>
+#include <string>
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+
+#include "texture.h"
+#include "bitmap_image.h"
+
+namespace Device { namespace Texture {
+
+    // Set associative, least recently used line of a set is replaced.
+    class TextureCacheSim
+    {
+    protected:
+        struct Line
+        {
+            std::uintptr_t tag;
+            std::uint64_t lastUse;
+        };
+
+        TextureCacheConfig m_config;
+        U32 m_numSets;
+        std::vector<Line> m_lines; // set major, m_config.ways lines per set.
+        std::uint64_t m_clock;
+
+    public:
+        std::uint64_t hits;
+        std::uint64_t misses;
+
+        TextureCacheSim(TextureCacheConfig const& config)
+            : m_config(config)
+            , m_numSets{std::max(config.capacity / (config.lineSize * config.ways), 1u)}
+            , m_lines(m_numSets * config.ways, Line{UINTPTR_MAX, 0})
+            , m_clock{0}
+            , hits{0}
+            , misses{0}
+        {
+            assert((config.lineSize & (config.lineSize - 1)) == 0);
+        }
+
+        inline TextureCacheConfig const& getConfig() const { return m_config; }
+
+        // Touches every line of [addr, addr + size).
+        void access(U8 const* addr, U32 size)
+        {
+            std::uintptr_t const first = reinterpret_cast<std::uintptr_t>(addr) / m_config.lineSize;
+            std::uintptr_t const last = (reinterpret_cast<std::uintptr_t>(addr) + size - 1) / m_config.lineSize;
+            for (std::uintptr_t line = first; line <= last; ++line)
+            {
+                accessLine(line);
+            }
+        }
+
+    protected:
+        void accessLine(std::uintptr_t line)
+        {
+            Line* set = m_lines.data() + (line % m_numSets) * m_config.ways;
+            Line* victim = set;
+            ++m_clock;
+
+            for (U32 way = 0; way < m_config.ways; ++way)
+            {
+                if (set[way].tag == line)
+                {
+                    set[way].lastUse = m_clock;
+                    ++hits;
+                    return;
+                }
+
+                if (set[way].lastUse < victim->lastUse)
+                {
+                    victim = set + way;
+                }
+            }
+
+            victim->tag = line;
+            victim->lastUse = m_clock;
+            ++misses;
+        }
+    };
+
+    // Fetch counts of one texture in cells of level 0 texels, reads of smaller levels are scaled up.
+    // Note: the texture may change before the report, its size is taken at the first fetch.
+    struct HeatMap
+    {
+        static constexpr U32 CELL_SIZE = 4;
+
+        U32 texWidth;
+        U32 texHeight;
+        U32 width;          // in cells.
+        U32 height;
+        std::vector<U32> counts;
+        std::uint64_t fetches;
+        std::uint64_t bytes;
+    };
+
+    static TextureCacheSim s_cache{TextureCacheConfig{64, 16 * 1024, 4}};
+    static std::map<Texture2D const*, HeatMap> s_heatMaps;
+    static std::uint64_t s_samples = 0;
+    static std::uint64_t s_fetches = 0;
+    static std::uint64_t s_bytesRead = 0;
+
+    static void resetTextureStats()
+    {
+        s_cache = TextureCacheSim{s_cache.getConfig()};
+        s_heatMaps.clear();
+        s_samples = 0;
+        s_fetches = 0;
+        s_bytesRead = 0;
+    }
+
+    void setTextureCacheConfig(TextureCacheConfig const& config)
+    {
+        s_cache = TextureCacheSim{config};
+        resetTextureStats();
+    }
+
+    void recordSamples(U32 count)
+    {
+        s_samples += count;
+    }
+
+    void recordTexelFetch(Texture2D const* tex, U32 level, U32 x, U32 y, U8 const* addr, U32 size)
+    {
+        ++s_fetches;
+        s_bytesRead += size;
+        s_cache.access(addr, size);
+
+        HeatMap& heatMap = s_heatMaps[tex];
+        if (heatMap.counts.empty())
+        {
+            heatMap.texWidth = tex->getWidth();
+            heatMap.texHeight = tex->getHeight();
+            heatMap.width = (heatMap.texWidth + HeatMap::CELL_SIZE - 1) / HeatMap::CELL_SIZE;
+            heatMap.height = (heatMap.texHeight + HeatMap::CELL_SIZE - 1) / HeatMap::CELL_SIZE;
+            heatMap.counts.assign(heatMap.width * heatMap.height, 0);
+            heatMap.fetches = 0;
+            heatMap.bytes = 0;
+        }
+
+        U32 const cellX = std::min((x << level) / HeatMap::CELL_SIZE, heatMap.width - 1);
+        U32 const cellY = std::min((y << level) / HeatMap::CELL_SIZE, heatMap.height - 1);
+        ++heatMap.counts[cellX + cellY * heatMap.width];
+        ++heatMap.fetches;
+        heatMap.bytes += size;
+    }
+
+    static void saveHeatMap(std::string const& filename, HeatMap const& heatMap)
+    {
+        // log scale, hot spots would hide everything else.
+        U32 const maxCount = *std::max_element(heatMap.counts.begin(), heatMap.counts.end());
+        float const scale = maxCount > 0 ? 255.0f / std::log(1.0f + maxCount) : 0.0f;
+
+        bitmap_image image(heatMap.width, heatMap.height);
+        for (U32 y = 0; y < heatMap.height; ++y)
+        {
+            for (U32 x = 0; x < heatMap.width; ++x)
+            {
+                U8 const heat = std::log(1.0f + heatMap.counts[x + y * heatMap.width]) * scale;
+                image.set_pixel(x, heatMap.height - y - 1, heat, heat / 4, 255 - heat);
+            }
+        }
+        image.save_image(filename);
+    }
+
+    void reportTextureStats(std::ostream& stream, char const* heatmapPrefix)
+    {
+        TextureCacheConfig const& config = s_cache.getConfig();
+        std::uint64_t const accesses = s_cache.hits + s_cache.misses;
+        std::uint64_t const bytesFetched = s_cache.misses * config.lineSize;
+        double const samples = std::max(s_samples, std::uint64_t{1});
+
+        stream << "texture cache " << config.capacity << "B, " << config.lineSize << "B lines, " << config.ways << " ways" << std::endl;
+        stream << "  samples " << s_samples
+            << ", texel fetches " << s_fetches << " (" << s_fetches / samples << " per sample)" << std::endl;
+        stream << "  line accesses " << accesses
+            << ", hit rate " << (accesses > 0 ? 100.0 * s_cache.hits / accesses : 0.0) << "%" << std::endl;
+        stream << "  bytes read " << s_bytesRead << " (" << s_bytesRead / samples << " per sample)"
+            << ", fetched " << bytesFetched << " (" << bytesFetched / samples << " per sample)" << std::endl;
+
+        U32 index = 0;
+        for (auto const& entry : s_heatMaps)
+        {
+            std::string const filename = std::string(heatmapPrefix) + std::to_string(index++) + ".bmp";
+            stream << "  texture " << entry.first << " " << entry.second.texWidth << "x" << entry.second.texHeight
+                << ", texel fetches " << entry.second.fetches << ", bytes read " << entry.second.bytes
+                << ", heat map " << filename << std::endl;
+            saveHeatMap(filename, entry.second);
+        }
+
+        resetTextureStats();
+    }
+
+} // namespace Texture
+} // namespace Device
+
+#endif // TEXTURE_STATS
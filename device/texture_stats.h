@@ -0,0 +1,42 @@
+#ifndef _TEXTURE_STATS_H_
+#define _TEXTURE_STATS_H_
+
+#include <iostream>
+
+#include "vmath.h"
+
+// Texture sampling statistics, compiled in with -DTEXTURE_STATS only.
+// Every texel or block read by the samplers goes through a simulated set associative cache,
+// Pipeline::present reports hit rates and bytes fetched, and writes a heat map per texture.
+// Note: the statistics are not thread safe, sampling runs on the pipeline thread.
+
+namespace Device { namespace Texture {
+
+    class Texture2D;
+
+    struct TextureCacheConfig
+    {
+        U32 lineSize; // bytes, power of two.
+        U32 capacity; // bytes.
+        U32 ways;
+    };
+
+#if defined(TEXTURE_STATS)
+
+    // Replaces the simulated cache and resets all statistics, the default is 16KB, 64B lines, 4 ways.
+    void setTextureCacheConfig(TextureCacheConfig const& config);
+
+    void recordSamples(U32 count);
+
+    // One texel of level read at addr, size is the bytes read, a whole block for block compressed formats.
+    void recordTexelFetch(Texture2D const* tex, U32 level, U32 x, U32 y, U8 const* addr, U32 size);
+
+    // Prints the statistics since the last report, saves heat maps as heatmapPrefix<n>.bmp and resets.
+    void reportTextureStats(std::ostream& stream, char const* heatmapPrefix);
+
+#endif
+
+} // namespace Texture
+} // namespace Device
+
+#endif // _TEXTURE_STATS_H_
@@ -2,8 +2,51 @@
 #define _UTILS_H_
 
 #include <vector>
+#include <thread>
+#include <algorithm>
+#include <functional>
+
+// Inline even where the compiler's size heuristics give up, e.g. helpers of heavily specialized kernels.
+#if defined(__GNUC__)
+#define FORCE_INLINE inline __attribute__((always_inline))
+#else
+#define FORCE_INLINE inline
+#endif
 
 namespace Device {
+    // [ref](https://www.boost.org/doc/libs/release/libs/container_hash/)
+    template <typename T>
+    inline void hashCombine(std::size_t& seed, T const& value)
+    {
+        seed ^= std::hash<T>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+    }
+
+    // Splits [0, count) into contiguous ranges and runs func(begin, end) on each, one thread per range.
+    // Returns after all ranges are done, small counts run on the calling thread.
+    inline void parallelFor(std::size_t count, std::size_t minPerThread, std::function<void (std::size_t begin, std::size_t end)> const& func)
+    {
+        std::size_t const maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+        std::size_t const numThreads = std::min(maxThreads, std::max(count / std::max(minPerThread, std::size_t{1}), std::size_t{1}));
+        if (numThreads <= 1)
+        {
+            func(0, count);
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        std::size_t const perThread = (count + numThreads - 1) / numThreads;
+        for (std::size_t begin = perThread; begin < count; begin += perThread)
+        {
+            threads.emplace_back(func, begin, std::min(begin + perThread, count));
+        }
+        func(0, std::min(perThread, count));
+
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
     // TODO: move this to some utility header.
     // TODO: this does not work when U is V
     // TODO: is this still needed?